@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StreamLoopbackBenchmark"
+
+#include "core/default/Device.h"
+#include "core/default/StreamIn.h"
+#include "core/default/StreamOut.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <hardware/audio.h>
+
+using ::android::sp;
+using ::android::hardware::EventFlag;
+using ::android::hardware::audio::common::CPP_VERSION::implementation::AudioInputFlagBitfield;
+using ::android::hardware::audio::common::CPP_VERSION::implementation::AudioOutputFlagBitfield;
+using ::android::hardware::audio::CPP_VERSION::implementation::Device;
+using ::android::hardware::audio::CPP_VERSION::implementation::StreamIn;
+using ::android::hardware::audio::CPP_VERSION::implementation::StreamOut;
+using namespace ::android::hardware::audio::common::CPP_VERSION;
+using namespace ::android::hardware::audio::CPP_VERSION;
+
+namespace {
+
+// 16 bit stereo
+constexpr uint32_t kFrameSize = 4;
+// The data MQs hold this many buffers, like the framework's default of two
+constexpr uint32_t kBuffersPerQueue = 2;
+
+// A legacy HAL device whose output stream writes into a ring which its input stream reads from,
+// so that what the client writes comes back on the input stream.
+class LoopbackDevice {
+  public:
+    LoopbackDevice() : mRing(kRingSize) {
+        memset(&mDevice, 0, sizeof(mDevice));
+        mDevice.device.common.close = [](hw_device_t*) { return 0; };
+        mDevice.device.open_output_stream = openOutputStream;
+        mDevice.device.close_output_stream = [](audio_hw_device*, audio_stream_out*) {};
+        mDevice.device.open_input_stream = openInputStream;
+        mDevice.device.close_input_stream = [](audio_hw_device*, audio_stream_in*) {};
+        mDevice.self = this;
+
+        memset(&mOut, 0, sizeof(mOut));
+        mOut.stream.write = write;
+        mOut.self = this;
+        memset(&mIn, 0, sizeof(mIn));
+        mIn.stream.read = read;
+        mIn.self = this;
+    }
+
+    audio_hw_device_t* get() { return &mDevice.device; }
+
+  private:
+    static constexpr size_t kRingSize = 64 * 1024;
+
+    // The HAL structs come first so that the pointers the HAL gets can be cast back
+    struct HwDevice {
+        audio_hw_device_t device;
+        LoopbackDevice* self;
+    };
+    struct OutStream {
+        audio_stream_out_t stream;
+        LoopbackDevice* self;
+    };
+    struct InStream {
+        audio_stream_in_t stream;
+        LoopbackDevice* self;
+    };
+
+    static LoopbackDevice* fromDevice(audio_hw_device* device) {
+        return reinterpret_cast<HwDevice*>(device)->self;
+    }
+
+    static int openOutputStream(audio_hw_device* device, audio_io_handle_t, audio_devices_t,
+                                audio_output_flags_t, audio_config*, audio_stream_out** out,
+                                const char*) {
+        *out = &fromDevice(device)->mOut.stream;
+        return 0;
+    }
+
+    static int openInputStream(audio_hw_device* device, audio_io_handle_t, audio_devices_t,
+                               audio_config*, audio_stream_in** in, audio_input_flags_t,
+                               const char*, audio_source_t) {
+        *in = &fromDevice(device)->mIn.stream;
+        return 0;
+    }
+
+    // The ring overwrites unread data and reads silence when empty, like real hardware would
+    static ssize_t write(audio_stream_out* stream, const void* buffer, size_t bytes) {
+        LoopbackDevice* self = reinterpret_cast<OutStream*>(stream)->self;
+        const uint8_t* data = static_cast<const uint8_t*>(buffer);
+        for (size_t done = 0; done < bytes;) {
+            size_t size = std::min(bytes - done, kRingSize - self->mWritePos);
+            memcpy(&self->mRing[self->mWritePos], data + done, size);
+            self->mWritePos = (self->mWritePos + size) % kRingSize;
+            done += size;
+        }
+        self->mFill = std::min(self->mFill + bytes, kRingSize);
+        return bytes;
+    }
+
+    static ssize_t read(audio_stream_in* stream, void* buffer, size_t bytes) {
+        LoopbackDevice* self = reinterpret_cast<InStream*>(stream)->self;
+        uint8_t* data = static_cast<uint8_t*>(buffer);
+        size_t available = std::min(bytes, self->mFill);
+        size_t readPos = (self->mWritePos + kRingSize - self->mFill) % kRingSize;
+        for (size_t done = 0; done < available;) {
+            size_t size = std::min(available - done, kRingSize - readPos);
+            memcpy(data + done, &self->mRing[readPos], size);
+            readPos = (readPos + size) % kRingSize;
+            done += size;
+        }
+        memset(data + available, 0, bytes - available);
+        self->mFill -= available;
+        return bytes;
+    }
+
+    HwDevice mDevice;
+    OutStream mOut;
+    InStream mIn;
+    std::vector<uint8_t> mRing;
+    size_t mWritePos = 0;
+    size_t mFill = 0;
+};
+
+// The client side of a stream's data path, as the framework sets it up in prepareForWriting()
+// and prepareForReading()
+template <typename Stream>
+struct StreamClient {
+    std::unique_ptr<typename Stream::CommandMQ> commandMQ;
+    std::unique_ptr<typename Stream::DataMQ> dataMQ;
+    std::unique_ptr<typename Stream::StatusMQ> statusMQ;
+    EventFlag* efGroup = nullptr;
+
+    ~StreamClient() {
+        if (efGroup != nullptr) {
+            EventFlag::deleteEventFlag(&efGroup);
+        }
+    }
+
+    template <typename CommandDesc, typename DataDesc, typename StatusDesc>
+    bool init(Result result, const CommandDesc& commandDesc, const DataDesc& dataDesc,
+              const StatusDesc& statusDesc) {
+        if (result != Result::OK) {
+            return false;
+        }
+        commandMQ = std::make_unique<typename Stream::CommandMQ>(commandDesc);
+        dataMQ = std::make_unique<typename Stream::DataMQ>(dataDesc);
+        statusMQ = std::make_unique<typename Stream::StatusMQ>(statusDesc);
+        return commandMQ->isValid() && dataMQ->isValid() && statusMQ->isValid() &&
+               EventFlag::createEventFlag(dataMQ->getEventFlagWord(), &efGroup) == android::OK;
+    }
+};
+
+bool writeBuffer(StreamClient<StreamOut>& client, const std::vector<uint8_t>& buffer) {
+    IStreamOut::WriteCommand command = IStreamOut::WriteCommand::WRITE;
+    if (!client.dataMQ->write(buffer.data(), buffer.size()) || !client.commandMQ->write(&command)) {
+        return false;
+    }
+    client.efGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY));
+    uint32_t efState = 0;
+    IStreamOut::WriteStatus status;
+    do {
+        client.efGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL), &efState);
+    } while (!client.statusMQ->read(&status));
+    return status.retval == Result::OK && status.reply.written == buffer.size();
+}
+
+bool readBuffer(StreamClient<StreamIn>& client, std::vector<uint8_t>* buffer) {
+    IStreamIn::ReadParameters parameters;
+    parameters.command = IStreamIn::ReadCommand::READ;
+    parameters.params.read = buffer->size();
+    if (!client.commandMQ->write(&parameters)) {
+        return false;
+    }
+    client.efGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL));
+    uint32_t efState = 0;
+    IStreamIn::ReadStatus status;
+    do {
+        client.efGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY), &efState);
+    } while (!client.statusMQ->read(&status));
+    return status.retval == Result::OK && status.reply.read == buffer->size() &&
+           client.dataMQ->read(buffer->data(), buffer->size());
+}
+
+// Writes a buffer of state.range(0) frames to an output stream and reads it back from an input
+// stream, through the stream writer and reader threads. The CPU time is that of the whole
+// process, so it includes the HAL threads.
+void BM_StreamLoopback(benchmark::State& state) {
+    const uint32_t framesPerBuffer = state.range(0);
+    LoopbackDevice loopbackDevice;
+    sp<Device> device = new Device(loopbackDevice.get());
+    AudioConfig config{};
+    AudioConfig suggestedConfig;
+    sp<IStreamOut> streamOut = std::get<sp<IStreamOut>>(device->openOutputStreamImpl(
+            0 /*ioHandle*/, DeviceAddress{}, config, AudioOutputFlagBitfield{}, &suggestedConfig));
+    sp<IStreamIn> streamIn = std::get<sp<IStreamIn>>(
+            device->openInputStreamImpl(0 /*ioHandle*/, DeviceAddress{}, config,
+                                        AudioInputFlagBitfield{}, AudioSource::MIC,
+                                        &suggestedConfig));
+    if (streamOut == nullptr || streamIn == nullptr) {
+        state.SkipWithError("failed to open the streams");
+        return;
+    }
+
+    StreamClient<StreamOut> writer;
+    bool writerReady = false;
+    streamOut->prepareForWriting(kFrameSize, framesPerBuffer * kBuffersPerQueue,
+                                 [&](Result result, const auto& commandDesc, const auto& dataDesc,
+                                     const auto& statusDesc, const auto&) {
+                                     writerReady = writer.init(result, commandDesc, dataDesc,
+                                                               statusDesc);
+                                 });
+    StreamClient<StreamIn> reader;
+    bool readerReady = false;
+    streamIn->prepareForReading(kFrameSize, framesPerBuffer * kBuffersPerQueue,
+                                [&](Result result, const auto& commandDesc, const auto& dataDesc,
+                                    const auto& statusDesc, const auto&) {
+                                    readerReady = reader.init(result, commandDesc, dataDesc,
+                                                              statusDesc);
+                                });
+    if (!writerReady || !readerReady) {
+        state.SkipWithError("failed to prepare the stream data paths");
+        return;
+    }
+
+    std::vector<uint8_t> output(framesPerBuffer * kFrameSize);
+    for (size_t i = 0; i < output.size(); i++) {
+        output[i] = i;
+    }
+    std::vector<uint8_t> input(output.size());
+    for (auto _ : state) {
+        if (!writeBuffer(writer, output) || !readBuffer(reader, &input)) {
+            state.SkipWithError("stream transfer failed");
+            break;
+        }
+    }
+    if (input != output) {
+        state.SkipWithError("the data read back differs from the data written");
+    }
+    state.SetBytesProcessed(state.iterations() * output.size() * 2);
+
+    streamOut->close();
+    streamIn->close();
+}
+// 5 ms and 20 ms at 48 kHz
+BENCHMARK(BM_StreamLoopback)->Arg(240)->Arg(960)->MeasureProcessCPUTime()->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
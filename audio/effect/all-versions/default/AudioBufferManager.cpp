@@ -16,7 +16,9 @@
 
 #include "AudioBufferManager.h"
 
-#include <atomic>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <hidlmemory/mapping.h>
 
@@ -26,28 +28,104 @@ ANDROID_SINGLETON_STATIC_INSTANCE(AudioBufferManager);
 
 bool AudioBufferManager::wrap(const AudioBuffer& buffer, sp<AudioBufferWrapper>* wrapper) {
     // Check if we have this buffer already
-    std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(buffer.id);
-    if (idx >= 0) {
-        *wrapper = mBuffers[idx].promote();
-        if (*wrapper != nullptr) {
-            (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
-            return true;
-        }
-        mBuffers.removeItemsAt(idx);
+    sp<AudioBufferWrapper> found;
+    if (find(buffer.id, &found)) {
+        found->getHalBuffer()->frameCount = buffer.frameCount;
+        *wrapper = found;
+        return true;
     }
-    // Need to create and init a new AudioBufferWrapper.
+    // Need to create and init a new AudioBufferWrapper. This is done without holding
+    // the lock, as a failed wrapper removes itself from the registry on destruction.
     sp<AudioBufferWrapper> tempBuffer(new AudioBufferWrapper(buffer));
     if (!tempBuffer->init()) return false;
-    *wrapper = tempBuffer;
-    mBuffers.add(buffer.id, *wrapper);
+    // The lookup below may end up holding the last reference to a wrapper that is being
+    // released. The destructor of the wrapper takes the lock, so it must only run after
+    // the lock is released.
+    std::vector<sp<AudioBufferWrapper>> staleWrappers;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        // Another effect may have wrapped the same buffer in the meantime.
+        if (!lookup(buffer.id, &found, &staleWrappers)) {
+            if (!addEntryLocked(tempBuffer)) {
+                ALOGW("Too many effect buffers, buffer %" PRIu64 " will not be shared",
+                      buffer.id);
+            }
+            found = tempBuffer;
+        }
+        releaseRetiredLocked();
+    }
+    found->getHalBuffer()->frameCount = buffer.frameCount;
+    *wrapper = found;
     return true;
 }
 
-void AudioBufferManager::removeEntry(uint64_t id) {
+bool AudioBufferManager::find(uint64_t id, sp<AudioBufferWrapper>* wrapper) {
+    const bool found = lookup(id, wrapper, nullptr);
+    // Entries removed during lookups leave their weak references behind. Release them once
+    // there are no more lookups, unless someone else is adding or removing entries.
+    if (mHasRetiredRefs.load()) {
+        std::unique_lock<std::mutex> lock(mLock, std::try_to_lock);
+        if (lock.owns_lock()) releaseRetiredLocked();
+    }
+    return found;
+}
+
+bool AudioBufferManager::lookup(uint64_t id, sp<AudioBufferWrapper>* wrapper,
+                                std::vector<sp<AudioBufferWrapper>>* staleWrappers) {
+    // While there are active lookups, the weak references of removed entries are retired
+    // instead of being released, so 'refs' remains valid even if the entry gets removed.
+    mActiveLookups.fetch_add(1);
+    bool found = false;
+    for (Entry& entry : mBuffers) {
+        RefBase::weakref_type* refs = entry.refs.load();
+        if (refs == nullptr || entry.id.load() != id) continue;
+        if (!refs->attemptIncStrong(this)) continue;  // the wrapper is being destroyed
+        AudioBufferWrapper* candidate = static_cast<AudioBufferWrapper*>(refs->refBase());
+        // The entry could have been reused between reading 'refs' and 'id'.
+        if (candidate->getId() == id) {
+            *wrapper = candidate;
+            found = true;
+        } else if (staleWrappers != nullptr) {
+            // Dropping the reference here could destroy the wrapper.
+            staleWrappers->push_back(candidate);
+        }
+        candidate->decStrong(this);
+        if (found) break;
+    }
+    mActiveLookups.fetch_sub(1);
+    return found;
+}
+
+bool AudioBufferManager::addEntryLocked(const sp<AudioBufferWrapper>& wrapper) {
+    for (Entry& entry : mBuffers) {
+        if (entry.refs.load(std::memory_order_relaxed) != nullptr) continue;
+        entry.id.store(wrapper->getId());
+        entry.refs.store(wrapper->createWeak(this));
+        return true;
+    }
+    return false;
+}
+
+void AudioBufferManager::releaseRetiredLocked() {
+    if (mRetiredRefs.empty() || mActiveLookups.load() != 0) return;
+    for (RefBase::weakref_type* refs : mRetiredRefs) {
+        refs->decWeak(this);
+    }
+    mRetiredRefs.clear();
+    mHasRetiredRefs.store(false);
+}
+
+void AudioBufferManager::removeEntry(AudioBufferWrapper* wrapper) {
     std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(id);
-    if (idx >= 0) mBuffers.removeItemsAt(idx);
+    for (Entry& entry : mBuffers) {
+        RefBase::weakref_type* refs = entry.refs.load(std::memory_order_relaxed);
+        if (refs == nullptr || refs->refBase() != wrapper) continue;
+        entry.refs.store(nullptr);
+        mRetiredRefs.push_back(refs);
+        mHasRetiredRefs.store(true);
+        break;
+    }
+    releaseRetiredLocked();
 }
 
 namespace hardware {
@@ -57,10 +135,13 @@ namespace CPP_VERSION {
 namespace implementation {
 
 AudioBufferWrapper::AudioBufferWrapper(const AudioBuffer& buffer)
-    : mHidlBuffer(buffer), mHalBuffer{0, {nullptr}} {}
+    : mHidlBuffer(buffer), mHalBuffer{0, {nullptr}}, mLocked(false) {}
 
 AudioBufferWrapper::~AudioBufferWrapper() {
-    AudioBufferManager::getInstance().removeEntry(mHidlBuffer.id);
+    AudioBufferManager::getInstance().removeEntry(this);
+    if (mLocked) {
+        munlock(mHalBuffer.raw, static_cast<size_t>(mHidlMemory->getSize()));
+    }
 }
 
 bool AudioBufferWrapper::init() {
@@ -79,9 +160,27 @@ bool AudioBufferWrapper::init() {
         return false;
     }
     mHalBuffer.frameCount = mHidlBuffer.frameCount;
+    prefault();
     return true;
 }
 
+void AudioBufferWrapper::prefault() {
+    // Fault in all the pages of the buffer now, so the first 'process' call does not
+    // take page faults on the audio thread. Locking the pages is best effort as it is
+    // subject to RLIMIT_MEMLOCK.
+    uint8_t* data = static_cast<uint8_t*>(mHalBuffer.raw);
+    const size_t size = static_cast<size_t>(mHidlMemory->getSize());
+    if (size == 0) return;
+    if (mlock(data, size) == 0) {
+        mLocked = true;
+        return;
+    }
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for (size_t offset = 0; offset < size; offset += pageSize) {
+        (void)*static_cast<volatile uint8_t*>(data + offset);
+    }
+}
+
 }  // namespace implementation
 }  // namespace CPP_VERSION
 }  // namespace effect
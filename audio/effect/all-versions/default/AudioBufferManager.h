@@ -19,11 +19,13 @@
 
 #include PATH(android/hardware/audio/effect/FILE_VERSION/types.h)
 
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 #include <android/hidl/memory/1.0/IMemory.h>
 #include <system/audio_effect.h>
-#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 
@@ -42,15 +44,19 @@ class AudioBufferWrapper : public RefBase {
     explicit AudioBufferWrapper(const AudioBuffer& buffer);
     virtual ~AudioBufferWrapper();
     bool init();
+    uint64_t getId() const { return mHidlBuffer.id; }
     audio_buffer_t* getHalBuffer() { return &mHalBuffer; }
 
    private:
     AudioBufferWrapper(const AudioBufferWrapper&) = delete;
     void operator=(AudioBufferWrapper) = delete;
 
+    void prefault();
+
     AudioBuffer mHidlBuffer;
     sp<IMemory> mHidlMemory;
     audio_buffer_t mHalBuffer;
+    bool mLocked;  // whether the pages of the buffer are locked in memory
 };
 
 }  // namespace implementation
@@ -65,6 +71,8 @@ using ::android::hardware::audio::effect::CPP_VERSION::implementation::AudioBuff
 namespace android {
 
 // This class needs to be in 'android' ns because Singleton macros require that.
+// Effects of the same chain share their buffers, thus wrappers are looked up by buffer id
+// and shared. Lookups do not take any lock, only adding and removing entries do.
 class AudioBufferManager : public Singleton<AudioBufferManager> {
    public:
     bool wrap(const AudioBuffer& buffer, sp<AudioBufferWrapper>* wrapper);
@@ -72,11 +80,31 @@ class AudioBufferManager : public Singleton<AudioBufferManager> {
    private:
     friend class hardware::audio::effect::CPP_VERSION::implementation::AudioBufferWrapper;
 
+    static constexpr size_t kMaxBuffers = 64;
+
+    // The registry holds a weak reference to each wrapper, so the reference counts
+    // can be safely accessed by lookups running concurrently with the removal.
+    struct Entry {
+        std::atomic<uint64_t> id{0};
+        std::atomic<RefBase::weakref_type*> refs{nullptr};  // nullptr if the entry is free
+    };
+
+    bool find(uint64_t id, sp<AudioBufferWrapper>* wrapper);
+    // Wrappers with a different id that were referenced during the lookup are added to
+    // 'staleWrappers' if it is not null, instead of being released.
+    bool lookup(uint64_t id, sp<AudioBufferWrapper>* wrapper,
+                std::vector<sp<AudioBufferWrapper>>* staleWrappers);
+    bool addEntryLocked(const sp<AudioBufferWrapper>& wrapper);
+    void releaseRetiredLocked();
+
     // Called by AudioBufferWrapper.
-    void removeEntry(uint64_t id);
+    void removeEntry(AudioBufferWrapper* wrapper);
 
-    std::mutex mLock;
-    KeyedVector<uint64_t, wp<AudioBufferWrapper>> mBuffers;
+    std::mutex mLock;  // serializes adding and removing entries
+    std::array<Entry, kMaxBuffers> mBuffers;
+    std::atomic<uint32_t> mActiveLookups{0};
+    std::vector<RefBase::weakref_type*> mRetiredRefs;  // guarded by mLock
+    std::atomic<bool> mHasRetiredRefs{false};
 };
 
 }  // namespace android
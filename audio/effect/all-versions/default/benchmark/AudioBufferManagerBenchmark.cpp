@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioBufferManagerBenchmark"
+
+#include "AudioBufferManager.h"
+
+#include <unistd.h>
+
+#include <vector>
+
+#include <android/hidl/allocator/1.0/IAllocator.h>
+#include <benchmark/benchmark.h>
+
+using ::android::AudioBufferManager;
+using ::android::sp;
+using ::android::hardware::hidl_memory;
+using ::android::hidl::allocator::V1_0::IAllocator;
+
+namespace {
+
+// Effects in the chain. As in an AudioFlinger effect chain, they all process the same input and
+// output buffers.
+constexpr size_t kChainLength = 10;
+// Stereo float
+constexpr size_t kFrameSize = 2 * sizeof(float);
+
+// Allocates a buffer the way the framework does for effect chains
+bool allocateBuffer(const sp<IAllocator>& allocator, uint64_t id, uint32_t frameCount,
+                    AudioBuffer* buffer) {
+    bool success = false;
+    allocator->allocate(frameCount * kFrameSize, [&](bool s, const hidl_memory& memory) {
+        success = s;
+        buffer->id = id;
+        buffer->frameCount = frameCount;
+        buffer->data = memory;
+    });
+    return success;
+}
+
+// Sets up the buffers of a chain of kChainLength effects the way Effect::setProcessBuffers() does,
+// for buffers of state.range(0) frames. The first effect maps and prefaults the buffers, the
+// others find them in the manager. The chain is torn down outside of the measurement, so every
+// setup starts with unmapped buffers.
+void BM_ChainSetup(benchmark::State& state) {
+    sp<IAllocator> allocator = IAllocator::getService("ashmem");
+    if (allocator == nullptr) {
+        state.SkipWithError("the ashmem allocator is not available");
+        return;
+    }
+    const uint64_t idBase = static_cast<uint64_t>(getpid()) << 32;
+    AudioBuffer inBuffer, outBuffer;
+    if (!allocateBuffer(allocator, idBase + 1, state.range(0), &inBuffer) ||
+        !allocateBuffer(allocator, idBase + 2, state.range(0), &outBuffer)) {
+        state.SkipWithError("failed to allocate the buffers");
+        return;
+    }
+
+    AudioBufferManager& manager = AudioBufferManager::getInstance();
+    std::vector<sp<AudioBufferWrapper>> wrappers;
+    wrappers.reserve(2 * kChainLength);
+    for (auto _ : state) {
+        for (size_t i = 0; i < kChainLength; i++) {
+            sp<AudioBufferWrapper> in, out;
+            if (!manager.wrap(inBuffer, &in) || !manager.wrap(outBuffer, &out)) {
+                state.SkipWithError("failed to wrap the buffers");
+                break;
+            }
+            wrappers.push_back(in);
+            wrappers.push_back(out);
+        }
+        state.PauseTiming();
+        wrappers.clear();
+        state.ResumeTiming();
+    }
+}
+// 5 ms, 20 ms and 100 ms at 48 kHz
+BENCHMARK(BM_ChainSetup)->Arg(240)->Arg(960)->Arg(4800);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -18,47 +18,37 @@
 
 #include "FormatConvert.h"
 
-namespace android {
-namespace hardware {
-namespace automotive {
-namespace evs {
-namespace common {
-
-// Round up to the nearest multiple of the given alignment value
-template<unsigned alignment>
-int Utils::align(int value) {
-    static_assert((alignment && !(alignment & (alignment - 1))),
-                  "alignment must be a power of 2");
-
-    unsigned mask = alignment - 1;
-    return (value + mask) & ~mask;
-}
-
-
-// Limit the given value to the provided range.  :)
-inline float Utils::clamp(float v, float min, float max) {
-    if (v < min) return min;
-    if (v > max) return max;
-    return v;
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Fixed point versions of the coefficients of the YUV to RGB conversion, with 16 fractional
+// bits:
+//   R = Y + 1.140*V
+//   G = Y - 0.395*U - 0.581*V
+//   B = Y + 2.032*U
+constexpr int kFixedPointShift = 16;
+constexpr int kCoefRV = 74711;   // 1.140 * 2^16
+constexpr int kCoefGU = -25887;  // -0.395 * 2^16
+constexpr int kCoefGV = -38076;  // -0.581 * 2^16
+constexpr int kCoefBU = 133169;  // 2.032 * 2^16
+
+inline uint32_t clampToByte(int v) {
+    return static_cast<uint32_t>(std::min(std::max(v, 0), 255));
 }
 
+// Converts a single pixel to RGBx (or BGRx).  This is written without any branches so that the
+// row loops below are vectorized by the compiler (NEON on ARM, SSE on x86).
+template<bool bgrxFormat>
+inline uint32_t yuvToRgbx(int Y, int Uin, int Vin) {
+    const int U = Uin - 128;
+    const int V = Vin - 128;
+    const int Yf = Y << kFixedPointShift;
 
-uint32_t Utils::yuvToRgbx(const unsigned char Y,
-                          const unsigned char Uin,
-                          const unsigned char Vin,
-                          bool bgrxFormat) {
-    // Don't use this if you want to see the best performance.  :)
-    // Better to do this in a pixel shader if we really have to, but on actual
-    // embedded hardware we expect to be able to texture directly from the YUV data
-    float U = Uin - 128.0f;
-    float V = Vin - 128.0f;
-
-    float Rf = Y + 1.140f*V;
-    float Gf = Y - 0.395f*U - 0.581f*V;
-    float Bf = Y + 2.032f*U;
-    unsigned char R = (unsigned char)clamp(Rf, 0.0f, 255.0f);
-    unsigned char G = (unsigned char)clamp(Gf, 0.0f, 255.0f);
-    unsigned char B = (unsigned char)clamp(Bf, 0.0f, 255.0f);
+    const uint32_t R = clampToByte((Yf + kCoefRV * V) >> kFixedPointShift);
+    const uint32_t G = clampToByte((Yf + kCoefGU * U + kCoefGV * V) >> kFixedPointShift);
+    const uint32_t B = clampToByte((Yf + kCoefBU * U) >> kFixedPointShift);
 
     if (!bgrxFormat) {
         return (R      ) |
@@ -73,6 +63,63 @@ uint32_t Utils::yuvToRgbx(const unsigned char Y,
     }
 }
 
+// Converts a row of pixels whose U and V samples are interleaved and shared by pairs of
+// pixels (U in the even columns and V in the odd columns of |rowUV|).
+template<bool bgrxFormat>
+void convertInterleavedUVRow(unsigned width, const uint8_t* rowY, const uint8_t* rowUV,
+                             uint32_t* rowDest) {
+    const unsigned pairs = width / 2;
+    for (unsigned p = 0; p < pairs; p++) {
+        const int U = rowUV[2*p];
+        const int V = rowUV[2*p + 1];
+        rowDest[2*p]     = yuvToRgbx<bgrxFormat>(rowY[2*p],     U, V);
+        rowDest[2*p + 1] = yuvToRgbx<bgrxFormat>(rowY[2*p + 1], U, V);
+    }
+    if (width & 1) {
+        rowDest[width - 1] = yuvToRgbx<bgrxFormat>(rowY[width - 1], rowUV[width - 1],
+                                                   rowUV[width]);
+    }
+}
+
+// Converts a row of pixels with one sample per pixel in each of the Y, U and V rows.
+template<bool bgrxFormat>
+void convertPlanarRow(unsigned width, const uint8_t* rowY, const uint8_t* rowU,
+                      const uint8_t* rowV, uint32_t* rowDest) {
+    for (unsigned c = 0; c < width; c++) {
+        rowDest[c] = yuvToRgbx<bgrxFormat>(rowY[c], rowU[c], rowV[c]);
+    }
+}
+
+// Converts a row of YUYV pixels, where each 32bit word holds two pixels (Y1, U, Y2, V).
+template<bool bgrxFormat>
+void convertYUYVRow(unsigned width, const uint8_t* rowSrc, uint32_t* rowDest) {
+    const unsigned pairs = width / 2;
+    for (unsigned p = 0; p < pairs; p++) {
+        const int U = rowSrc[4*p + 1];
+        const int V = rowSrc[4*p + 3];
+        rowDest[2*p]     = yuvToRgbx<bgrxFormat>(rowSrc[4*p],     U, V);
+        rowDest[2*p + 1] = yuvToRgbx<bgrxFormat>(rowSrc[4*p + 2], U, V);
+    }
+}
+
+} // namespace
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace common {
+
+// Round up to the nearest multiple of the given alignment value
+template<unsigned alignment>
+int Utils::align(int value) {
+    static_assert((alignment && !(alignment & (alignment - 1))),
+                  "alignment must be a power of 2");
+
+    unsigned mask = alignment - 1;
+    return (value + mask) & ~mask;
+}
+
 
 void Utils::copyNV21toRGB32(unsigned width, unsigned height,
                             uint8_t* src,
@@ -97,10 +144,10 @@ void Utils::copyNV21toRGB32(unsigned width, unsigned height,
 
         uint32_t* rowDest = dst + r*dstStridePixels;
 
-        for (unsigned c = 0; c < width; c++) {
-            unsigned uCol = (c & ~1);   // uCol is always even and repeats 1:2 with Y values
-            unsigned vCol = uCol | 1;   // vCol is always odd
-            rowDest[c] = yuvToRgbx(rowY[c], rowUV[uCol], rowUV[vCol], bgrxFormat);
+        if (!bgrxFormat) {
+            convertInterleavedUVRow<false>(width, rowY, rowUV, rowDest);
+        } else {
+            convertInterleavedUVRow<true>(width, rowY, rowUV, rowDest);
         }
     }
 }
@@ -134,8 +181,10 @@ void Utils::copyYV12toRGB32(unsigned width, unsigned height,
 
         uint32_t* rowDest = dst + r*dstStridePixels;
 
-        for (unsigned c = 0; c < width; c++) {
-            rowDest[c] = yuvToRgbx(rowY[c], rowU[c], rowV[c], bgrxFormat);
+        if (!bgrxFormat) {
+            convertPlanarRow<false>(width, rowY, rowU, rowV, rowDest);
+        } else {
+            convertPlanarRow<true>(width, rowY, rowU, rowV, rowDest);
         }
     }
 }
@@ -146,30 +195,17 @@ void Utils::copyYUYVtoRGB32(unsigned width, unsigned height,
                             uint32_t* dst, unsigned dstStridePixels,
                             bool bgrxFormat)
 {
-    uint32_t* srcWords = (uint32_t*)src;
-
-    const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-    const int dstRowPadding32 = dstStridePixels   - width;    // 4 bytes per pixel, 4 bytes per word
-
     for (unsigned r = 0; r < height; r++) {
-        for (unsigned c = 0; c < width/2; c++) {
-            // Note:  we're walking two pixels at a time here (even/odd)
-            uint32_t srcPixel = *srcWords++;
-
-            uint8_t Y1 = (srcPixel)       & 0xFF;
-            uint8_t U  = (srcPixel >> 8)  & 0xFF;
-            uint8_t Y2 = (srcPixel >> 16) & 0xFF;
-            uint8_t V  = (srcPixel >> 24) & 0xFF;
-
-            // On the RGB output, we're writing one pixel at a time
-            *(dst+0) = yuvToRgbx(Y1, U, V, bgrxFormat);
-            *(dst+1) = yuvToRgbx(Y2, U, V, bgrxFormat);
-            dst += 2;
-        }
+        // 2 bytes per source pixel
+        const uint8_t* rowSrc = src + r*srcStridePixels*2;
+        uint32_t* rowDest = dst + r*dstStridePixels;
 
-        // Skip over any extra data or end of row alignment padding
-        srcWords += srcRowPadding32;
-        dst += dstRowPadding32;
+        // Note:  we're walking two pixels at a time here (even/odd)
+        if (!bgrxFormat) {
+            convertYUYVRow<false>(width, rowSrc, rowDest);
+        } else {
+            convertYUYVRow<true>(width, rowSrc, rowDest);
+        }
     }
 }
 
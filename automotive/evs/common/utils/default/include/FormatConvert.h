@@ -82,12 +82,6 @@ public:
 private:
     template<unsigned alignment>
     static int align(int value);
-
-    static inline float clamp(float v, float min, float max);
-    static uint32_t yuvToRgbx(const unsigned char Y,
-                              const unsigned char Uin,
-                              const unsigned char Vin,
-                              bool bgrxFormat = false);
 };
 
 } // namespace common
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "FormatConvert.h"
+
+using android::hardware::automotive::evs::common::Utils;
+
+namespace {
+
+// Frame sizes are passed as (width, height) benchmark arguments.
+void frameSizes(benchmark::internal::Benchmark* benchmark) {
+    benchmark->Args({640, 480})->Args({1280, 720})->Args({1920, 1080})->Args({3840, 2160});
+}
+
+// Returns a buffer of random samples, large enough for any of the supported formats.
+std::vector<uint8_t> makeSource(unsigned width, unsigned height) {
+    std::vector<uint8_t> src((width + 16) * height * 2);
+    for (auto& sample : src) {
+        sample = std::rand();
+    }
+    return src;
+}
+
+// Reports the throughput of a benchmark in megapixels per second.
+void setPixelsProcessed(benchmark::State& state, unsigned width, unsigned height) {
+    state.counters["MPixels"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * width * height / 1e6,
+            benchmark::Counter::kIsRate);
+}
+
+void BM_copyNV21toRGB32(benchmark::State& state) {
+    const unsigned width = state.range(0);
+    const unsigned height = state.range(1);
+    std::vector<uint8_t> src = makeSource(width, height);
+    std::vector<uint32_t> dst(width * height);
+    for (auto _ : state) {
+        Utils::copyNV21toRGB32(width, height, src.data(), dst.data(), width);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setPixelsProcessed(state, width, height);
+}
+BENCHMARK(BM_copyNV21toRGB32)->Apply(frameSizes);
+
+void BM_copyYV12toRGB32(benchmark::State& state) {
+    const unsigned width = state.range(0);
+    const unsigned height = state.range(1);
+    std::vector<uint8_t> src = makeSource(width, height);
+    std::vector<uint32_t> dst(width * height);
+    for (auto _ : state) {
+        Utils::copyYV12toRGB32(width, height, src.data(), dst.data(), width);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setPixelsProcessed(state, width, height);
+}
+BENCHMARK(BM_copyYV12toRGB32)->Apply(frameSizes);
+
+void BM_copyYUYVtoRGB32(benchmark::State& state) {
+    const unsigned width = state.range(0);
+    const unsigned height = state.range(1);
+    std::vector<uint8_t> src = makeSource(width, height);
+    std::vector<uint32_t> dst(width * height);
+    for (auto _ : state) {
+        Utils::copyYUYVtoRGB32(width, height, src.data(), width, dst.data(), width);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    setPixelsProcessed(state, width, height);
+}
+BENCHMARK(BM_copyYUYVtoRGB32)->Apply(frameSizes);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "FormatConvert.h"
+
+using android::hardware::automotive::evs::common::Utils;
+
+namespace {
+
+// The floating point conversion the fixed point one replaced.
+uint32_t referenceYuvToRgbx(uint8_t Y, uint8_t Uin, uint8_t Vin, bool bgrxFormat) {
+    const auto clamp = [](float v) {
+        return static_cast<uint32_t>(static_cast<uint8_t>(v < 0.0f ? 0.0f :
+                                                          v > 255.0f ? 255.0f : v));
+    };
+    float U = Uin - 128.0f;
+    float V = Vin - 128.0f;
+    uint32_t R = clamp(Y + 1.140f*V);
+    uint32_t G = clamp(Y - 0.395f*U - 0.581f*V);
+    uint32_t B = clamp(Y + 2.032f*U);
+    return bgrxFormat ? (R << 16) | (G << 8) | B | 0xFF000000
+                      : R | (G << 8) | (B << 16) | 0xFF000000;
+}
+
+// Each color channel may be off by one from the reference, because of rounding.
+::testing::AssertionResult pixelsMatch(uint32_t expected, uint32_t actual) {
+    for (unsigned shift = 0; shift < 32; shift += 8) {
+        int diff = static_cast<int>((expected >> shift) & 0xFF) -
+                   static_cast<int>((actual >> shift) & 0xFF);
+        if (diff < -1 || diff > 1) {
+            return ::testing::AssertionFailure() << std::hex << "expected 0x" << expected
+                                                 << ", got 0x" << actual;
+        }
+    }
+    return ::testing::AssertionSuccess();
+}
+
+std::vector<uint8_t> makeSource(size_t size) {
+    std::vector<uint8_t> src(size);
+    for (auto& sample : src) {
+        sample = std::rand();
+    }
+    return src;
+}
+
+unsigned align16(unsigned value) {
+    return (value + 15) & ~15u;
+}
+
+class FormatConvertTest : public ::testing::TestWithParam<bool> {};
+
+// Every (Y, U, V) input is converted once: each frame holds all the Y and V values for one U.
+TEST_P(FormatConvertTest, YUYVMatchesFloatConversionForAllInputs) {
+    const bool bgrxFormat = GetParam();
+    const unsigned width = 256;
+    const unsigned height = 256;
+    std::vector<uint8_t> src(width * height * 2);
+    std::vector<uint32_t> dst(width * height);
+    for (unsigned U = 0; U < 256; U++) {
+        for (unsigned V = 0; V < height; V++) {
+            for (unsigned Y = 0; Y < width; Y += 2) {
+                uint8_t* pixels = &src[(V * width + Y) * 2];
+                pixels[0] = Y;
+                pixels[1] = U;
+                pixels[2] = Y + 1;
+                pixels[3] = V;
+            }
+        }
+        Utils::copyYUYVtoRGB32(width, height, src.data(), width, dst.data(), width, bgrxFormat);
+        for (unsigned V = 0; V < height; V++) {
+            for (unsigned Y = 0; Y < width; Y++) {
+                ASSERT_TRUE(pixelsMatch(referenceYuvToRgbx(Y, U, V, bgrxFormat),
+                                        dst[V * width + Y]))
+                        << "Y " << Y << " U " << U << " V " << V;
+            }
+        }
+    }
+}
+
+TEST_P(FormatConvertTest, NV21MatchesFloatConversion) {
+    const bool bgrxFormat = GetParam();
+    const unsigned width = 100;
+    const unsigned height = 60;
+    const unsigned dstStride = width + 8;
+    const unsigned strideLum = align16(width);
+    std::vector<uint8_t> src = makeSource(strideLum * height * 3 / 2);
+    std::vector<uint32_t> dst(dstStride * height);
+    Utils::copyNV21toRGB32(width, height, src.data(), dst.data(), dstStride, bgrxFormat);
+
+    const uint8_t* srcUV = src.data() + strideLum * height;
+    for (unsigned r = 0; r < height; r++) {
+        for (unsigned c = 0; c < width; c++) {
+            const uint8_t* rowUV = srcUV + r / 2 * strideLum;
+            ASSERT_TRUE(pixelsMatch(referenceYuvToRgbx(src[r * strideLum + c], rowUV[c & ~1u],
+                                                       rowUV[c | 1], bgrxFormat),
+                                    dst[r * dstStride + c]))
+                    << "row " << r << " column " << c;
+        }
+    }
+}
+
+TEST_P(FormatConvertTest, YV12MatchesFloatConversion) {
+    const bool bgrxFormat = GetParam();
+    const unsigned width = 100;
+    const unsigned height = 60;
+    const unsigned dstStride = width + 8;
+    const unsigned strideLum = align16(width);
+    const unsigned strideColor = align16(strideLum / 2);
+    const unsigned sizeY = strideLum * height;
+    const unsigned sizeColor = strideColor * height / 2;
+    // The rows are converted with one U and V sample per pixel, so the V plane is followed by
+    // enough samples for the last rows to be read in full.
+    std::vector<uint8_t> src = makeSource(sizeY + 2 * sizeColor + width);
+    std::vector<uint32_t> dst(dstStride * height);
+    Utils::copyYV12toRGB32(width, height, src.data(), dst.data(), dstStride, bgrxFormat);
+
+    for (unsigned r = 0; r < height; r++) {
+        const uint8_t* rowU = src.data() + sizeY + r / 2 * strideColor;
+        const uint8_t* rowV = src.data() + sizeY + sizeColor + r / 2 * strideColor;
+        for (unsigned c = 0; c < width; c++) {
+            ASSERT_TRUE(pixelsMatch(referenceYuvToRgbx(src[r * strideLum + c], rowU[c], rowV[c],
+                                                       bgrxFormat),
+                                    dst[r * dstStride + c]))
+                    << "row " << r << " column " << c;
+        }
+    }
+}
+
+TEST_P(FormatConvertTest, RowPaddingIsNotWritten) {
+    const bool bgrxFormat = GetParam();
+    const unsigned width = 64;
+    const unsigned height = 4;
+    const unsigned dstStride = width + 4;
+    const uint32_t kCanary = 0x12345678;
+    std::vector<uint8_t> src = makeSource(width * height * 2);
+    std::vector<uint32_t> dst(dstStride * height, kCanary);
+    Utils::copyYUYVtoRGB32(width, height, src.data(), width, dst.data(), dstStride, bgrxFormat);
+    for (unsigned r = 0; r < height; r++) {
+        for (unsigned c = width; c < dstStride; c++) {
+            EXPECT_EQ(kCanary, dst[r * dstStride + c]);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(RgbxAndBgrx, FormatConvertTest, ::testing::Bool());
+
+}  // namespace
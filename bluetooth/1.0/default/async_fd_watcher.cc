@@ -22,33 +22,61 @@
 #include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <initializer_list>
 #include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
-#include "fcntl.h"
-#include "sys/select.h"
+#include "sys/epoll.h"
+#include "sys/eventfd.h"
+#include "sys/timerfd.h"
 #include "unistd.h"
 
 static const int INVALID_FD = -1;
 
 static const int BT_RT_PRIORITY = 1;
 
+static const int MAX_EVENTS_PER_WAKEUP = 16;
+
 namespace android {
 namespace hardware {
 namespace bluetooth {
 namespace async {
 
+namespace {
+
+int AddFdToEpoll(int epoll_fd, int file_descriptor) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = file_descriptor;
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, file_descriptor, &event);
+}
+
+}  // namespace
+
 int AsyncFdWatcher::WatchFdForNonBlockingReads(
     int file_descriptor, const ReadCallback& on_read_fd_ready_callback) {
   // Add file descriptor and callback
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
     watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+    // If the thread is already running, start watching the new fd right away.
+    if (epoll_fd_ != INVALID_FD &&
+        AddFdToEpoll(epoll_fd_, file_descriptor) && errno != EEXIST) {
+      ALOGE("%s unable to watch fd %d: %s", __func__, file_descriptor,
+            strerror(errno));
+      watched_fds_.erase(file_descriptor);
+      return -1;
+    }
   }
 
   // Start the thread if not started yet
-  return tryStartThread();
+  if (tryStartThread()) {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    watched_fds_.erase(file_descriptor);
+    return -1;
+  }
+  return 0;
 }
 
 int AsyncFdWatcher::ConfigureTimeout(
@@ -74,15 +102,35 @@ AsyncFdWatcher::~AsyncFdWatcher() {}
 int AsyncFdWatcher::tryStartThread() {
   if (std::atomic_exchange(&running_, true)) return 0;
 
-  // Set up the communication channel
-  int pipe_fds[2];
-  if (pipe2(pipe_fds, O_NONBLOCK)) return -1;
-
-  notification_listen_fd_ = pipe_fds[0];
-  notification_write_fd_ = pipe_fds[1];
+  // Set up the epoll instance, the notification channel and the timer.
+  {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    notification_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    bool ready = epoll_fd_ != INVALID_FD && notification_fd_ != INVALID_FD &&
+                 timer_fd_ != INVALID_FD &&
+                 !AddFdToEpoll(epoll_fd_, notification_fd_) &&
+                 !AddFdToEpoll(epoll_fd_, timer_fd_);
+    for (auto it = watched_fds_.begin(); ready && it != watched_fds_.end();
+         ++it) {
+      ready = !AddFdToEpoll(epoll_fd_, it->first);
+    }
+    if (!ready) {
+      ALOGE("%s unable to set up epoll: %s", __func__, strerror(errno));
+      closeFdsLocked();
+      running_ = false;
+      return -1;
+    }
+  }
 
   thread_ = std::thread([this]() { ThreadRoutine(); });
-  if (!thread_.joinable()) return -1;
+  if (!thread_.joinable()) {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    closeFdsLocked();
+    running_ = false;
+    return -1;
+  }
 
   return 0;
 }
@@ -98,6 +146,7 @@ int AsyncFdWatcher::stopThread() {
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
     watched_fds_.clear();
+    closeFdsLocked();
   }
 
   {
@@ -105,20 +154,43 @@ int AsyncFdWatcher::stopThread() {
     timeout_cb_ = nullptr;
   }
 
-  close(notification_listen_fd_);
-  close(notification_write_fd_);
-
   return 0;
 }
 
+void AsyncFdWatcher::closeFdsLocked() {
+  for (int* fd : {&epoll_fd_, &notification_fd_, &timer_fd_}) {
+    if (*fd != INVALID_FD) {
+      close(*fd);
+      *fd = INVALID_FD;
+    }
+  }
+}
+
 int AsyncFdWatcher::notifyThread() {
-  uint8_t buffer[] = {0};
-  if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &buffer, 1)) < 0) {
+  if (notification_fd_ == INVALID_FD) return -1;
+  uint64_t value = 1;
+  if (TEMP_FAILURE_RETRY(write(notification_fd_, &value, sizeof(value))) < 0) {
     return -1;
   }
   return 0;
 }
 
+// (Re)starts the timeout, which fires when nothing happened for timeout_ms_.
+int AsyncFdWatcher::armTimeout() {
+  std::chrono::milliseconds timeout;
+  {
+    std::unique_lock<std::mutex> guard(timeout_mutex_);
+    timeout = timeout_ms_;
+  }
+  struct itimerspec spec = {};
+  if (timeout > std::chrono::milliseconds(0)) {
+    spec.it_value.tv_sec = timeout.count() / 1000;
+    spec.it_value.tv_nsec = (timeout.count() % 1000) * 1000000;
+  }
+  // A zero it_value disarms the timer.
+  return timerfd_settime(timer_fd_, 0, &spec, NULL);
+}
+
 void AsyncFdWatcher::ThreadRoutine() {
   // Make watching thread RT.
   struct sched_param rt_params;
@@ -128,33 +200,46 @@ void AsyncFdWatcher::ThreadRoutine() {
           getpid(), gettid(), strerror(errno));
   }
 
+  armTimeout();
   while (running_) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(notification_listen_fd_, &read_fds);
-    int max_read_fd = INVALID_FD;
-    for (auto& it : watched_fds_) {
-      FD_SET(it.first, &read_fds);
-      max_read_fd = std::max(max_read_fd, it.first);
-    }
-
-    struct timeval timeout;
-    struct timeval* timeout_ptr = NULL;
-    if (timeout_ms_ > std::chrono::milliseconds(0)) {
-      timeout.tv_sec = timeout_ms_.count() / 1000;
-      timeout.tv_usec = (timeout_ms_.count() % 1000) * 1000;
-      timeout_ptr = &timeout;
-    }
-
     // Wait until there is data available to read on some FD.
-    int nfds = std::max(notification_listen_fd_, max_read_fd);
-    int retval = select(nfds + 1, &read_fds, NULL, NULL, timeout_ptr);
+    struct epoll_event events[MAX_EVENTS_PER_WAKEUP];
+    int retval =
+        epoll_wait(epoll_fd_, events, MAX_EVENTS_PER_WAKEUP, -1 /* timeout */);
 
     // There was some error.
     if (retval < 0) continue;
 
+    bool timed_out = false;
+    bool data_ready = false;
+    {
+      // Hold the mutex to make sure that the callbacks are still valid.
+      std::unique_lock<std::mutex> guard(internal_mutex_);
+      for (int i = 0; i < retval && running_; i++) {
+        int fd = events[i].data.fd;
+        if (fd == notification_fd_) {
+          // Read data from the notification FD.
+          uint64_t value;
+          TEMP_FAILURE_RETRY(read(notification_fd_, &value, sizeof(value)));
+          continue;
+        }
+        if (fd == timer_fd_) {
+          uint64_t expirations;
+          TEMP_FAILURE_RETRY(read(timer_fd_, &expirations, sizeof(expirations)));
+          timed_out = true;
+          continue;
+        }
+        // Invoke the data ready callbacks if appropriate.
+        auto it = watched_fds_.find(fd);
+        if (it != watched_fds_.end()) {
+          data_ready = true;
+          it->second(it->first);
+        }
+      }
+    }
+
     // Timeout.
-    if (retval == 0) {
+    if (timed_out && !data_ready && running_) {
       // Allow the timeout callback to modify the timeout.
       TimeoutCallback saved_cb;
       {
@@ -162,26 +247,9 @@ void AsyncFdWatcher::ThreadRoutine() {
         if (timeout_ms_ > std::chrono::milliseconds(0)) saved_cb = timeout_cb_;
       }
       if (saved_cb != nullptr) saved_cb();
-      continue;
-    }
-
-    // Read data from the notification FD.
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[] = {0};
-      TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer, 1));
-      continue;
     }
 
-    // Invoke the data ready callbacks if appropriate.
-    {
-      // Hold the mutex to make sure that the callbacks are still valid.
-      std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& it : watched_fds_) {
-        if (FD_ISSET(it.first, &read_fds)) {
-          it.second(it.first);
-        }
-      }
-    }
+    armTimeout();
   }
 }
 
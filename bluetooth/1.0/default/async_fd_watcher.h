@@ -46,6 +46,9 @@ class AsyncFdWatcher {
   int tryStartThread();
   int stopThread();
   int notifyThread();
+  int armTimeout();
+  // Closes the epoll, eventfd and timerfd descriptors; needs internal_mutex_.
+  void closeFdsLocked();
   void ThreadRoutine();
 
   std::atomic_bool running_{false};
@@ -53,11 +56,14 @@ class AsyncFdWatcher {
   std::mutex internal_mutex_;
   std::mutex timeout_mutex_;
 
+  // The watched file descriptors stay registered with the epoll instance
+  // until the thread is stopped.
   std::map<int, ReadCallback> watched_fds_;
-  int notification_listen_fd_;
-  int notification_write_fd_;
+  int epoll_fd_{-1};
+  int notification_fd_{-1};
+  int timer_fd_{-1};
   TimeoutCallback timeout_cb_;
-  std::chrono::milliseconds timeout_ms_;
+  std::chrono::milliseconds timeout_ms_{0};
 };
 
 }  // namespace async
@@ -55,6 +55,11 @@ class H4Protocol : public HciProtocol {
 
   HciPacketType hci_packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   hci::HciPacketizer hci_packetizer_;
+
+  // Everything available on the UART is read at once, and all the packets it
+  // contains are dispatched before waiting for more data.
+  static constexpr size_t kRxBufferSize = 4096;
+  uint8_t rx_buffer_[kRxBufferSize];
 };
 
 }  // namespace hci
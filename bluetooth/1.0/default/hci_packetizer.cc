@@ -24,8 +24,13 @@
 #include <unistd.h>
 #include <utils/Log.h>
 
+#include <algorithm>
+
 namespace {
 
+// Large enough for typical ACL packets, so the buffer rarely needs to grow.
+const size_t HCI_PACKET_BUFFER_SIZE_MIN = 1024 + HCI_PREAMBLE_SIZE_MAX;
+
 const size_t preamble_size_for_type[] = {
     0, HCI_COMMAND_PREAMBLE_SIZE, HCI_ACL_PREAMBLE_SIZE, HCI_SCO_PREAMBLE_SIZE,
     HCI_EVENT_PREAMBLE_SIZE};
@@ -48,6 +53,13 @@ namespace hci {
 
 const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const { return packet_; }
 
+void HciPacketizer::PreparePacket(size_t size) {
+  if (packet_buffer_.size() < size) {
+    packet_buffer_.resize(std::max(size, HCI_PACKET_BUFFER_SIZE_MIN));
+  }
+  packet_.setToExternal(packet_buffer_.data(), size);
+}
+
 void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
   switch (state_) {
     case HCI_PREAMBLE: {
@@ -68,7 +80,7 @@ void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
       if (bytes_read_ == preamble_size_for_type[packet_type]) {
         size_t packet_length =
             HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
+        PreparePacket(preamble_size_for_type[packet_type] + packet_length);
         memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
         bytes_remaining_ = packet_length;
         state_ = HCI_PAYLOAD;
@@ -104,6 +116,37 @@ void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
   }
 }
 
+size_t HciPacketizer::OnDataReady(HciPacketType packet_type,
+                                  const uint8_t* data, size_t length) {
+  size_t preamble_size = preamble_size_for_type[packet_type];
+  size_t consumed = 0;
+  if (state_ == HCI_PREAMBLE) {
+    size_t bytes = std::min(length, preamble_size - bytes_read_);
+    memcpy(preamble_ + bytes_read_, data, bytes);
+    bytes_read_ += bytes;
+    consumed += bytes;
+    if (bytes_read_ < preamble_size) return consumed;
+    size_t packet_length = HciGetPacketLengthForType(packet_type, preamble_);
+    PreparePacket(preamble_size + packet_length);
+    memcpy(packet_.data(), preamble_, preamble_size);
+    bytes_remaining_ = packet_length;
+    state_ = HCI_PAYLOAD;
+    bytes_read_ = 0;
+  }
+
+  size_t bytes = std::min(length - consumed, bytes_remaining_);
+  memcpy(packet_.data() + preamble_size + bytes_read_, data + consumed, bytes);
+  bytes_remaining_ -= bytes;
+  bytes_read_ += bytes;
+  consumed += bytes;
+  if (bytes_remaining_ == 0) {
+    packet_ready_cb_();
+    state_ = HCI_PREAMBLE;
+    bytes_read_ = 0;
+  }
+  return consumed;
+}
+
 }  // namespace hci
 }  // namespace bluetooth
 }  // namespace hardware
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 
@@ -35,13 +36,23 @@ class HciPacketizer {
   HciPacketizer(HciPacketReadyCallback packet_cb)
       : packet_ready_cb_(packet_cb){};
   void OnDataReady(int fd, HciPacketType packet_type);
+  // Consumes bytes of an already read buffer, up to the end of the current
+  // packet. Returns the number of bytes consumed.
+  size_t OnDataReady(HciPacketType packet_type, const uint8_t* data,
+                     size_t length);
   const hidl_vec<uint8_t>& GetPacket() const;
 
  protected:
+  void PreparePacket(size_t size);
+
   enum State { HCI_PREAMBLE, HCI_PAYLOAD };
   State state_{HCI_PREAMBLE};
   uint8_t preamble_[HCI_PREAMBLE_SIZE_MAX];
+  // packet_ refers to packet_buffer_, which is reused for all the packets and
+  // only grows, so a packet does not cost an allocation. Packets are handed to
+  // the callback synchronously, and must be copied to be kept.
   hidl_vec<uint8_t> packet_;
+  std::vector<uint8_t> packet_buffer_;
   size_t bytes_remaining_{0};
   size_t bytes_read_{0};
   HciPacketReadyCallback packet_ready_cb_;
@@ -338,6 +338,43 @@ TEST_F(AsyncFdWatcherSocketTest, ClientServer) {
   CleanUpServer();
 }
 
+// A failed start must leave the watcher stopped and reusable.
+TEST_F(AsyncFdWatcherSocketTest, RecoverFromFailedStart) {
+  int sockfd[2];
+  socketpair(AF_LOCAL, SOCK_STREAM, 0, sockfd);
+  int closed_fd = dup(sockfd[0]);
+  close(closed_fd);
+  bool cb_called = false;
+  bool* cb_called_ptr = &cb_called;
+
+  AsyncFdWatcher watcher;
+  EXPECT_EQ(-1, watcher.WatchFdForNonBlockingReads(closed_fd, [](int) {
+    bool unexpected_callback = true;
+    ASSERT_FALSE(unexpected_callback);
+  }));
+  // Stopping a watcher that never started must not join a missing thread.
+  watcher.StopWatchingFileDescriptors();
+
+  EXPECT_EQ(0, watcher.WatchFdForNonBlockingReads(sockfd[0], [cb_called_ptr](
+                                                                 int fd) {
+    char read_buf[1] = {0};
+    int n = TEMP_FAILURE_RETRY(read(fd, read_buf, sizeof(read_buf)));
+    ASSERT_TRUE(n == sizeof(read_buf));
+    *cb_called_ptr = true;
+  }));
+
+  char one_buf[1] = {'1'};
+  TEMP_FAILURE_RETRY(write(sockfd[1], one_buf, sizeof(one_buf)));
+
+  sleep(1);
+
+  EXPECT_TRUE(cb_called);
+
+  watcher.StopWatchingFileDescriptors();
+  close(sockfd[0]);
+  close(sockfd[1]);
+}
+
 // Use two AsyncFdWatchers to set up a server socket, which times out.
 TEST_F(AsyncFdWatcherSocketTest, TimeOutTest) {
   ConfigureServer();
@@ -213,6 +213,80 @@ class H4ProtocolTest : public ::testing::Test {
     }
   }
 
+  void WriteAndExpectInboundPacketsBatched() {
+    // h4 type[1] + handle[2] + size[2]
+    char acl_preamble[5] = {HCI_PACKET_TYPE_ACL_DATA, 19, 92, 0, 0};
+    acl_preamble[3] = strlen(acl_data) & 0xFF;
+    acl_preamble[4] = (strlen(acl_data) >> 8) & 0xFF;
+    // h4 type[1] + handle[2] + size[1]
+    char sco_preamble[4] = {HCI_PACKET_TYPE_SCO_DATA, 20, 17, 0};
+    sco_preamble[3] = strlen(sco_data) & 0xFF;
+    // h4 type[1] + event_code[1] + size[1]
+    char event_preamble[3] = {HCI_PACKET_TYPE_EVENT, 9, 0};
+    event_preamble[2] = strlen(event_data) & 0xFF;
+
+    std::vector<char> packets;
+    packets.insert(packets.end(), acl_preamble,
+                   acl_preamble + sizeof(acl_preamble));
+    packets.insert(packets.end(), acl_data, acl_data + strlen(acl_data));
+    packets.insert(packets.end(), sco_preamble,
+                   sco_preamble + sizeof(sco_preamble));
+    packets.insert(packets.end(), sco_data, sco_data + strlen(sco_data));
+    packets.insert(packets.end(), event_preamble,
+                   event_preamble + sizeof(event_preamble));
+    packets.insert(packets.end(), event_data, event_data + strlen(event_data));
+
+    std::mutex mutex;
+    std::condition_variable done;
+    EXPECT_CALL(acl_cb_, Call(HidlVecMatches(acl_preamble + 1,
+                                             sizeof(acl_preamble) - 1,
+                                             acl_data)))
+        .Times(1);
+    EXPECT_CALL(sco_cb_, Call(HidlVecMatches(sco_preamble + 1,
+                                             sizeof(sco_preamble) - 1,
+                                             sco_data)))
+        .Times(1);
+    EXPECT_CALL(event_cb_, Call(HidlVecMatches(event_preamble + 1,
+                                               sizeof(event_preamble) - 1,
+                                               event_data)))
+        .WillOnce(Notify(&mutex, &done));
+
+    ALOGD("%s writing", __func__);
+    std::unique_lock<std::mutex> lock(mutex);
+    TEMP_FAILURE_RETRY(write(fake_uart_, packets.data(), packets.size()));
+
+    ALOGD("%s waiting", __func__);
+    // Fail if it takes longer than 100 ms.
+    done.wait_for(lock, std::chrono::milliseconds(100));
+  }
+
+  void WriteAndExpectInboundAclDataFragmented(char* payload) {
+    // h4 type[1] + handle[2] + size[2]
+    char preamble[5] = {HCI_PACKET_TYPE_ACL_DATA, 19, 92, 0, 0};
+    int length = strlen(payload);
+    preamble[3] = length & 0xFF;
+    preamble[4] = (length >> 8) & 0xFF;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    EXPECT_CALL(acl_cb_, Call(HidlVecMatches(preamble + 1, sizeof(preamble) - 1,
+                                             payload)))
+        .WillOnce(Notify(&mutex, &done));
+
+    ALOGD("%s writing", __func__);
+    std::unique_lock<std::mutex> lock(mutex);
+    for (size_t i = 0; i < sizeof(preamble); i++) {
+      TEMP_FAILURE_RETRY(write(fake_uart_, &preamble[i], 1));
+    }
+    for (int i = 0; i < length; i++) {
+      TEMP_FAILURE_RETRY(write(fake_uart_, &payload[i], 1));
+    }
+
+    ALOGD("%s waiting", __func__);
+    // Fail if it takes longer than 100 ms.
+    done.wait_for(lock, std::chrono::milliseconds(100));
+  }
+
   testing::MockFunction<void(const hidl_vec<uint8_t>&)> event_cb_;
   testing::MockFunction<void(const hidl_vec<uint8_t>&)> acl_cb_;
   testing::MockFunction<void(const hidl_vec<uint8_t>&)> sco_cb_;
@@ -238,6 +312,16 @@ TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundIsoData(iso_data);
 }
 
+// Ensure all the packets read from the UART at once are dispatched
+TEST_F(H4ProtocolTest, TestReadsBatched) {
+  WriteAndExpectInboundPacketsBatched();
+}
+
+// Ensure packets split across many reads are reassembled
+TEST_F(H4ProtocolTest, TestReadsFragmented) {
+  WriteAndExpectInboundAclDataFragmented(acl_data);
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
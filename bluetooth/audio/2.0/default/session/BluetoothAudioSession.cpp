@@ -18,6 +18,9 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -43,7 +46,9 @@ AudioConfiguration BluetoothAudioSession::invalidSoftwareAudioConfiguration =
 AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
+static constexpr int kFmqReceiveTimeoutMs = 1000;  // 1000 ms for receiving
 static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+static constexpr int kReadPollMs = 1;           // polled non-blocking interval
 
 static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
   return {.tv_sec = static_cast<long>(TS.tvSec),
@@ -152,6 +157,14 @@ bool BluetoothAudioSession::IsSessionReady() {
 }
 
 bool BluetoothAudioSession::UpdateDataPath(const DataMQ::Descriptor* dataMQ) {
+  if (data_path_stats_.bytes_transferred > 0) {
+    LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+              << ", bytes=" << data_path_stats_.bytes_transferred
+              << ", waits=" << data_path_stats_.wait_count
+              << ", timeouts=" << data_path_stats_.timeout_count
+              << ", max_fill_bytes=" << data_path_stats_.max_fill_bytes;
+  }
+  data_path_stats_ = {};
   if (dataMQ == nullptr) {
     // usecase of reset by nullptr
     mDataMQ = nullptr;
@@ -371,12 +384,16 @@ size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
                                               size_t bytes) {
   if (buffer == nullptr || !bytes) return 0;
   size_t totalWritten = 0;
-  int ms_timeout = kFmqSendTimeoutMs;
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(kFmqSendTimeoutMs);
   do {
     std::unique_lock<std::recursive_mutex> lock(mutex_);
     if (!IsSessionReady()) break;
     size_t availableToWrite = mDataMQ->availableToWrite();
     if (availableToWrite) {
+      data_path_stats_.max_fill_bytes =
+          std::max(data_path_stats_.max_fill_bytes,
+                   mDataMQ->getQuantumCount() - availableToWrite);
       if (availableToWrite > (bytes - totalWritten)) {
         availableToWrite = bytes - totalWritten;
       }
@@ -387,19 +404,65 @@ size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
         return totalWritten;
       }
       totalWritten += availableToWrite;
-    } else if (ms_timeout >= kWritePollMs) {
+      data_path_stats_.bytes_transferred += availableToWrite;
+    } else if (std::chrono::steady_clock::now() < deadline) {
+      data_path_stats_.max_fill_bytes = mDataMQ->getQuantumCount();
+      ++data_path_stats_.wait_count;
       lock.unlock();
       usleep(kWritePollMs * 1000);
-      ms_timeout -= kWritePollMs;
     } else {
+      ++data_path_stats_.timeout_count;
       ALOGD("data %zu/%zu overflow %d ms", totalWritten, bytes,
-            (kFmqSendTimeoutMs - ms_timeout));
+            kFmqSendTimeoutMs);
       return totalWritten;
     }
   } while (totalWritten < bytes);
   return totalWritten;
 }
 
+// The control function reads stream from FMQ
+size_t BluetoothAudioSession::InReadPcmData(void* buffer, size_t bytes) {
+  if (buffer == nullptr || !bytes) return 0;
+  size_t totalRead = 0;
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(kFmqReceiveTimeoutMs);
+  do {
+    std::unique_lock<std::recursive_mutex> lock(mutex_);
+    if (!IsSessionReady()) break;
+    size_t availableToRead = mDataMQ->availableToRead();
+    if (availableToRead) {
+      data_path_stats_.max_fill_bytes =
+          std::max(data_path_stats_.max_fill_bytes, availableToRead);
+      if (availableToRead > (bytes - totalRead)) {
+        availableToRead = bytes - totalRead;
+      }
+
+      if (!mDataMQ->read(static_cast<uint8_t*>(buffer) + totalRead,
+                         availableToRead)) {
+        ALOGE("FMQ datapath reading %zu/%zu failed", totalRead, bytes);
+        return totalRead;
+      }
+      totalRead += availableToRead;
+      data_path_stats_.bytes_transferred += availableToRead;
+    } else if (std::chrono::steady_clock::now() < deadline) {
+      ++data_path_stats_.wait_count;
+      lock.unlock();
+      usleep(kReadPollMs * 1000);
+    } else {
+      ++data_path_stats_.timeout_count;
+      ALOGD("data %zu/%zu underflow %d ms", totalRead, bytes,
+            kFmqReceiveTimeoutMs);
+      return totalRead;
+    }
+  } while (totalRead < bytes);
+  return totalRead;
+}
+
+DataPathStats BluetoothAudioSession::GetDataPathStats() {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  return data_path_stats_;
+}
+
 std::unique_ptr<BluetoothAudioSessionInstance>
     BluetoothAudioSessionInstance::instance_ptr =
         std::unique_ptr<BluetoothAudioSessionInstance>(
@@ -78,6 +78,20 @@ struct PortStatusCallbacks {
   std::function<void(uint16_t cookie)> session_changed_cb_;
 };
 
+// Statistics of the FMQ data path for software encoding, which are reset when
+// the data path is updated
+struct DataPathStats {
+  // bytes transferred through the FMQ
+  uint64_t bytes_transferred = 0;
+  // times that OutWritePcmData found the FMQ full, or InReadPcmData empty
+  uint64_t wait_count = 0;
+  // transfers which reached the deadline before completing (overflow or
+  // underrun)
+  uint64_t timeout_count = 0;
+  // the highest fill level of the FMQ in bytes
+  size_t max_fill_bytes = 0;
+};
+
 class BluetoothAudioSession {
  private:
   // using recursive_mutex to allow hwbinder to re-enter agian.
@@ -88,6 +102,7 @@ class BluetoothAudioSession {
   sp<IBluetoothAudioPort> stack_iface_;
   // audio data path (FMQ) for software encoding
   std::unique_ptr<DataMQ> mDataMQ;
+  DataPathStats data_path_stats_;
   // audio data configuration for both software and offloading
   AudioConfiguration audio_config_;
 
@@ -153,6 +168,10 @@ class BluetoothAudioSession {
 
   // The control function writes stream to FMQ
   size_t OutWritePcmData(const void* buffer, size_t bytes);
+  // The control function reads stream from FMQ
+  size_t InReadPcmData(void* buffer, size_t bytes);
+  // The control function gets the statistics of the FMQ data path
+  DataPathStats GetDataPathStats();
 
   static constexpr PcmParameters kInvalidPcmParameters = {
       .sampleRate = SampleRate::RATE_UNKNOWN,
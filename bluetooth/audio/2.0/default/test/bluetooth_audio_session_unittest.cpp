@@ -0,0 +1,172 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BluetoothAudioSession.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace bluetooth {
+namespace audio {
+
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::audio::common::V5_0::SourceMetadata;
+
+static constexpr size_t kDataMQSize = 256;
+static constexpr auto kPeerDelay = std::chrono::milliseconds(20);
+
+// The Bluetooth stack side of the session, which isn't used by the data path
+class FakeBluetoothAudioPort : public IBluetoothAudioPort {
+ public:
+  Return<void> startStream() override { return Void(); }
+  Return<void> suspendStream() override { return Void(); }
+  Return<void> stopStream() override { return Void(); }
+  Return<void> getPresentationPosition(
+      getPresentationPosition_cb _hidl_cb) override {
+    _hidl_cb(BluetoothAudioStatus::SUCCESS, 0, 0, {});
+    return Void();
+  }
+  Return<void> updateMetadata(const SourceMetadata&) override {
+    return Void();
+  }
+};
+
+class BluetoothAudioSessionTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    session_ = std::make_unique<BluetoothAudioSession>(
+        SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH);
+    data_mq_ = std::make_unique<DataMQ>(kDataMQSize, /* EventFlag */ true);
+    ASSERT_TRUE(data_mq_->isValid());
+    AudioConfiguration audio_config = {};
+    audio_config.pcmConfig({.sampleRate = SampleRate::RATE_44100,
+                            .channelMode = ChannelMode::STEREO,
+                            .bitsPerSample = BitsPerSample::BITS_16});
+    session_->OnSessionStarted(new FakeBluetoothAudioPort(),
+                               data_mq_->getDesc(), audio_config);
+    ASSERT_TRUE(session_->IsSessionReady());
+  }
+
+  void TearDown() override { session_->OnSessionEnded(); }
+
+  static std::vector<uint8_t> MakeData(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) data[i] = static_cast<uint8_t>(i * 7);
+    return data;
+  }
+
+  std::unique_ptr<BluetoothAudioSession> session_;
+  // the peer end of the session's data path
+  std::unique_ptr<DataMQ> data_mq_;
+};
+
+TEST_F(BluetoothAudioSessionTest, InReadPcmDataReadsQueuedData) {
+  std::vector<uint8_t> data = MakeData(100);
+  ASSERT_TRUE(data_mq_->write(data.data(), data.size()));
+
+  std::vector<uint8_t> buffer(data.size());
+  EXPECT_EQ(data.size(), session_->InReadPcmData(buffer.data(), buffer.size()));
+  EXPECT_EQ(data, buffer);
+
+  DataPathStats stats = session_->GetDataPathStats();
+  EXPECT_EQ(data.size(), stats.bytes_transferred);
+  EXPECT_EQ(0u, stats.wait_count);
+  EXPECT_EQ(0u, stats.timeout_count);
+  EXPECT_EQ(data.size(), stats.max_fill_bytes);
+}
+
+TEST_F(BluetoothAudioSessionTest, InReadPcmDataWaitsForThePeer) {
+  // More than the FMQ holds, so the peer has to wait for the reader as well
+  std::vector<uint8_t> data = MakeData(kDataMQSize * 3);
+  std::thread peer([this, &data]() {
+    size_t written = 0;
+    while (written < data.size()) {
+      std::this_thread::sleep_for(kPeerDelay);
+      size_t size =
+          std::min(data_mq_->availableToWrite(), data.size() - written);
+      if (size == 0) continue;
+      ASSERT_TRUE(data_mq_->write(data.data() + written, size));
+      written += size;
+    }
+  });
+
+  std::vector<uint8_t> buffer(data.size());
+  EXPECT_EQ(data.size(), session_->InReadPcmData(buffer.data(), buffer.size()));
+  peer.join();
+  EXPECT_EQ(data, buffer);
+
+  DataPathStats stats = session_->GetDataPathStats();
+  EXPECT_EQ(data.size(), stats.bytes_transferred);
+  EXPECT_GT(stats.wait_count, 0u);
+  EXPECT_EQ(0u, stats.timeout_count);
+  EXPECT_LE(stats.max_fill_bytes, kDataMQSize);
+}
+
+TEST_F(BluetoothAudioSessionTest, InReadPcmDataReturnsPartialDataOnUnderrun) {
+  std::vector<uint8_t> data = MakeData(10);
+  ASSERT_TRUE(data_mq_->write(data.data(), data.size()));
+
+  std::vector<uint8_t> buffer(data.size() * 2);
+  EXPECT_EQ(data.size(), session_->InReadPcmData(buffer.data(), buffer.size()));
+  EXPECT_TRUE(std::equal(data.begin(), data.end(), buffer.begin()));
+
+  DataPathStats stats = session_->GetDataPathStats();
+  EXPECT_EQ(data.size(), stats.bytes_transferred);
+  EXPECT_GT(stats.wait_count, 0u);
+  EXPECT_EQ(1u, stats.timeout_count);
+}
+
+TEST_F(BluetoothAudioSessionTest, OutWritePcmDataReturnsPartialDataOnOverflow) {
+  std::vector<uint8_t> data = MakeData(kDataMQSize + 10);
+  EXPECT_EQ(kDataMQSize, session_->OutWritePcmData(data.data(), data.size()));
+
+  std::vector<uint8_t> buffer(kDataMQSize);
+  ASSERT_TRUE(data_mq_->read(buffer.data(), buffer.size()));
+  EXPECT_TRUE(std::equal(buffer.begin(), buffer.end(), data.begin()));
+
+  DataPathStats stats = session_->GetDataPathStats();
+  EXPECT_EQ(kDataMQSize, stats.bytes_transferred);
+  EXPECT_GT(stats.wait_count, 0u);
+  EXPECT_EQ(1u, stats.timeout_count);
+  EXPECT_EQ(kDataMQSize, stats.max_fill_bytes);
+}
+
+TEST_F(BluetoothAudioSessionTest, SessionEndResetsDataPathStats) {
+  std::vector<uint8_t> data = MakeData(100);
+  EXPECT_EQ(data.size(), session_->OutWritePcmData(data.data(), data.size()));
+  EXPECT_EQ(data.size(), session_->GetDataPathStats().bytes_transferred);
+
+  session_->OnSessionEnded();
+  EXPECT_FALSE(session_->IsSessionReady());
+  DataPathStats stats = session_->GetDataPathStats();
+  EXPECT_EQ(0u, stats.bytes_transferred);
+  EXPECT_EQ(0u, stats.max_fill_bytes);
+
+  std::vector<uint8_t> buffer(data.size());
+  EXPECT_EQ(0u, session_->InReadPcmData(buffer.data(), buffer.size()));
+}
+
+}  // namespace audio
+}  // namespace bluetooth
+}  // namespace android
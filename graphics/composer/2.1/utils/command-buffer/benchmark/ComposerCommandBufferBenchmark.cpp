@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ComposerCommandBufferBenchmark"
+
+#include <benchmark/benchmark.h>
+
+#include <composer-command-buffer/2.1/ComposerCommandBuffer.h>
+
+using android::hardware::hidl_handle;
+using android::hardware::hidl_vec;
+using android::hardware::graphics::composer::V2_1::CommandReaderBase;
+using android::hardware::graphics::composer::V2_1::CommandWriterBase;
+using android::hardware::graphics::composer::V2_1::IComposerClient;
+using android::hardware::graphics::common::V1_0::Transform;
+
+namespace {
+
+// the default size of the command queue used by the composer clients
+constexpr uint32_t kWriterInitialSize = 64;
+
+// commands written per layer by writeFrame
+constexpr int64_t kCommandsPerLayer = 8;
+
+// Writes a frame in which every layer is updated, the way SurfaceFlinger does
+// before validating the display.  Returns the number of commands written.
+int64_t writeFrame(CommandWriterBase* writer, int64_t layerCount) {
+    writer->selectDisplay(1);
+    for (int64_t layer = 0; layer < layerCount; layer++) {
+        writer->selectLayer(layer + 1);
+        writer->setLayerBuffer(0, nullptr, -1);
+        writer->setLayerSurfaceDamage({{0, 0, 64, 64}});
+        writer->setLayerDisplayFrame({0, 0, 1080, 1920});
+        writer->setLayerSourceCrop({0.0f, 0.0f, 1080.0f, 1920.0f});
+        writer->setLayerZOrder(layer);
+        writer->setLayerPlaneAlpha(1.0f);
+        writer->setLayerTransform(Transform::ROT_90);
+    }
+    writer->validateDisplay();
+    return 2 + layerCount * kCommandsPerLayer;
+}
+
+// Measures the commands per second that a client writes, hands over and the
+// composer reads, for frames of state(0) layers.
+void BM_writeQueue(benchmark::State& state) {
+    CommandWriterBase writer(kWriterInitialSize);
+    CommandReaderBase reader;
+    int64_t commands = 0;
+    for (auto _ : state) {
+        commands += writeFrame(&writer, state.range(0));
+
+        bool queueChanged;
+        uint32_t commandLength;
+        hidl_vec<hidl_handle> commandHandles;
+        if (!writer.writeQueue(&queueChanged, &commandLength, &commandHandles) ||
+            (queueChanged && !reader.setMQDescriptor(*writer.getMQDescriptor())) ||
+            !reader.readQueue(commandLength, commandHandles)) {
+            state.SkipWithError("failed to hand over the commands");
+            break;
+        }
+        reader.reset();
+        writer.reset();
+    }
+    state.counters["commands"] =
+            benchmark::Counter(static_cast<double>(commands), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_writeQueue)->Arg(8)->Arg(64);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -52,18 +52,29 @@ using CommandQueueType = MessageQueue<uint32_t, kSynchronizedReadWrite>;
 
 // This class helps build a command queue.  Note that all sizes/lengths are in
 // units of uint32_t's.
+//
+// Commands are encoded directly into the memory of the message queue, which
+// is rewound to the start of the ring before each batch.  The queue is sized
+// to the high-water mark of the data written in a batch and only reallocated
+// when a batch outgrows it.  writeQueue commits the written commands; reset
+// must be called before writing the next batch.
 class CommandWriterBase {
    public:
     CommandWriterBase(uint32_t initialMaxSize) : mDataMaxSize(initialMaxSize) {
-        mData = std::make_unique<uint32_t[]>(mDataMaxSize);
+        mData = nullptr;
         reset();
     }
 
     virtual ~CommandWriterBase() { reset(); }
 
     void reset() {
+        // commands not committed by writeQueue are simply never made visible
+        // to the reader
+        mData = nullptr;
         mDataWritten = 0;
         mCommandEnd = 0;
+        mQueueWriting = false;
+        mQueueCommitted = false;
 
         // handles in mDataHandles are owned by the caller
         mDataHandles.clear();
@@ -91,42 +102,20 @@ class CommandWriterBase {
             return true;
         }
 
-        // After data are written to the queue, it may not be read by the
-        // remote reader when
-        //
-        //  - the writer does not send them (because of other errors)
-        //  - the hwbinder transaction fails
-        //  - the reader does not read them (because of other errors)
-        //
-        // Discard the stale data here.
-        size_t staleDataSize = mQueue ? mQueue->availableToRead() : 0;
-        if (staleDataSize > 0) {
-            ALOGW("discarding stale data from message queue");
-            CommandQueueType::MemTransaction tx;
-            if (mQueue->beginRead(staleDataSize, &tx)) {
-                mQueue->commitRead(staleDataSize);
-            }
-        }
-
-        // write data to queue, optionally resizing it
-        if (mQueue && (mDataMaxSize <= mQueue->getQuantumCount())) {
-            if (!mQueue->write(mData.get(), mDataWritten)) {
-                ALOGE("failed to write commands to message queue");
-                return false;
-            }
-
-            *outQueueChanged = false;
-        } else {
-            auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
-            if (!newQueue->isValid() || !newQueue->write(mData.get(), mDataWritten)) {
-                ALOGE("failed to prepare a new message queue ");
+        if (mQueueWriting) {
+            // the commands are already in the queue memory
+            if (!mQueue->commitWrite(mDataWritten)) {
+                ALOGE("failed to commit commands to message queue");
                 return false;
             }
-
-            mQueue = std::move(newQueue);
-            *outQueueChanged = true;
+            mQueueWriting = false;
+            mQueueCommitted = true;
+        } else if (!mQueueCommitted && !writeFallbackData()) {
+            return false;
         }
 
+        *outQueueChanged = mQueueChanged;
+        mQueueChanged = false;
         *outCommandLength = mDataWritten;
         outCommandHandles->setToExternal(const_cast<hidl_handle*>(mDataHandles.data()),
                                          mDataHandles.size());
@@ -539,7 +528,9 @@ class CommandWriterBase {
 
     static constexpr uint16_t kMaxLength = std::numeric_limits<uint16_t>::max();
 
-    std::unique_ptr<uint32_t[]> mData;
+    // points into the message queue memory, or into mFallbackData when the
+    // queue could not be set up
+    uint32_t* mData;
     uint32_t mDataWritten;
 
    private:
@@ -550,21 +541,196 @@ class CommandWriterBase {
                              mDataWritten, grow);
         }
 
+        if (mData && !mQueueCommitted && newWritten <= mDataMaxSize) {
+            return;
+        }
+
+        growDataSlow(newWritten);
+    }
+
+    // Kept out of line so that growData, which runs for every command, stays
+    // small enough to be inlined into the command writers.
+    __attribute__((noinline)) void growDataSlow(uint32_t newWritten) {
+        if (mQueueCommitted) {
+            LOG_ALWAYS_FATAL("reset was not called after writeQueue");
+        }
+
+        if (!mData && !beginQueueWrite(newWritten)) {
+            useFallbackData(std::max(mDataMaxSize, newWritten));
+        }
+
         if (newWritten <= mDataMaxSize) {
             return;
         }
 
+        if (mQueueWriting && newWritten <= mQueue->getQuantumCount()) {
+            // the free space of the queue wraps around; finish the batch in
+            // mFallbackData and let writeQueue copy it
+            useFallbackData(mQueue->getQuantumCount());
+            return;
+        }
+
         uint32_t newMaxSize = mDataMaxSize << 1;
         if (newMaxSize < newWritten) {
             newMaxSize = newWritten;
         }
 
-        auto newData = std::make_unique<uint32_t[]>(newMaxSize);
-        std::copy_n(mData.get(), mDataWritten, newData.get());
-        mDataMaxSize = newMaxSize;
-        mData = std::move(newData);
+        if (!mQueueWriting || !createQueue(newMaxSize)) {
+            useFallbackData(newMaxSize);
+        }
+    }
+
+    // Switch to a private buffer when the queue memory cannot be written
+    // directly.  writeQueue then copies the data to the queue.
+    void useFallbackData(uint32_t size) {
+        if (mData != mFallbackData.get() || mFallbackDataSize < size) {
+            auto newData = std::make_unique<uint32_t[]>(size);
+            if (mData) {
+                std::copy_n(mData, mDataWritten, newData.get());
+            }
+            mFallbackData = std::move(newData);
+            mFallbackDataSize = size;
+        }
+
+        mData = mFallbackData.get();
+        mDataMaxSize = size;
+        mQueueWriting = false;
+    }
+
+    // Discard the data that the remote reader never read.
+    //
+    // After data are written to the queue, it may not be read by the
+    // remote reader when
+    //
+    //  - the writer does not send them (because of other errors)
+    //  - the hwbinder transaction fails
+    //  - the reader does not read them (because of other errors)
+    void discardStaleData() {
+        size_t staleDataSize = mQueue->availableToRead();
+        if (staleDataSize > 0) {
+            ALOGW("discarding stale data from message queue");
+            CommandQueueType::MemTransaction tx;
+            if (mQueue->beginRead(staleDataSize, &tx)) {
+                mQueue->commitRead(staleDataSize);
+            }
+        }
+    }
+
+    // Start a batch of commands by pointing mData at the queue memory.  The
+    // queue is empty at this point, so it is rewound first and the whole
+    // queue is one contiguous region.  growData switches to mFallbackData
+    // when a batch outgrows it anyway.
+    bool beginQueueWrite(uint32_t minSize) {
+        uint32_t size = std::max(mDataMaxSize, minSize);
+        if (!mQueue || mQueue->getQuantumCount() < size) {
+            return createQueue(size);
+        }
+
+        discardStaleData();
+        if (!rewindQueue()) {
+            return false;
+        }
+
+        size_t available = mQueue->availableToWrite();
+        CommandQueueType::MemTransaction tx;
+        if (!mQueue->beginWrite(available, &tx)) {
+            ALOGE("failed to begin writing to message queue");
+            return false;
+        }
+
+        if (tx.getFirstRegion().getLength() < minSize) {
+            return false;
+        }
+
+        mData = tx.getFirstRegion().getAddress();
+        mDataMaxSize = tx.getFirstRegion().getLength();
+        mQueueWriting = true;
+        return true;
+    }
+
+    // Move the read and write positions of an empty queue back to the start
+    // of the ring, by committing the free space up to the end of the ring and
+    // reading it back right away.  This is only safe while the queue is
+    // empty: the remote reader reads a batch only after writeQueue hands it
+    // over, so it never sees the skipped words.  On failure, the caller
+    // falls back to writeFallbackData, whose discardStaleData drops them.
+    bool rewindQueue() {
+        if (mQueue->availableToRead() != 0) {
+            return true;
+        }
+
+        CommandQueueType::MemTransaction tx;
+        if (!mQueue->beginWrite(mQueue->availableToWrite(), &tx)) {
+            ALOGE("failed to begin writing to message queue");
+            return false;
+        }
+
+        size_t tail = tx.getFirstRegion().getLength();
+        if (tail == mQueue->getQuantumCount()) {
+            return true;
+        }
+
+        CommandQueueType::MemTransaction readTx;
+        if (!mQueue->commitWrite(tail) || !mQueue->beginRead(tail, &readTx) ||
+            !mQueue->commitRead(tail)) {
+            ALOGE("failed to rewind message queue");
+            return false;
+        }
+
+        return true;
+    }
+
+    // Replace the queue by a bigger one and start writing to it.  The data
+    // written so far in this batch are moved over.
+    bool createQueue(uint32_t size) {
+        auto newQueue = std::make_unique<CommandQueueType>(size);
+        CommandQueueType::MemTransaction tx;
+        if (!newQueue->isValid() || !newQueue->beginWrite(size, &tx) ||
+            tx.getFirstRegion().getLength() < size) {
+            ALOGE("failed to prepare a new message queue");
+            return false;
+        }
+
+        uint32_t* newData = tx.getFirstRegion().getAddress();
+        if (mData) {
+            std::copy_n(mData, mDataWritten, newData);
+        }
+
+        mQueue = std::move(newQueue);
+        mQueueChanged = true;
+        mData = newData;
+        mDataMaxSize = size;
+        mQueueWriting = true;
+        return true;
+    }
+
+    // Write the data of mFallbackData to the queue, optionally resizing it.
+    bool writeFallbackData() {
+        if (mQueue) {
+            discardStaleData();
+        }
+
+        if (mQueue && (mDataMaxSize <= mQueue->getQuantumCount())) {
+            if (!mQueue->write(mData, mDataWritten)) {
+                ALOGE("failed to write commands to message queue");
+                return false;
+            }
+        } else {
+            auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
+            if (!newQueue->isValid() || !newQueue->write(mData, mDataWritten)) {
+                ALOGE("failed to prepare a new message queue ");
+                return false;
+            }
+
+            mQueue = std::move(newQueue);
+            mQueueChanged = true;
+        }
+
+        mQueueCommitted = true;
+        return true;
     }
 
+    // capacity of mData, which is also the high-water mark of the queue size
     uint32_t mDataMaxSize;
     // end offset of the current command
     uint32_t mCommandEnd;
@@ -573,6 +739,14 @@ class CommandWriterBase {
     std::vector<native_handle_t*> mTemporaryHandles;
 
     std::unique_ptr<CommandQueueType> mQueue;
+    // whether mData points into an uncommitted write transaction of mQueue
+    bool mQueueWriting;
+    // whether the current batch has been handed over by writeQueue
+    bool mQueueCommitted;
+    // whether mQueue was replaced since the last writeQueue
+    bool mQueueChanged = false;
+    std::unique_ptr<uint32_t[]> mFallbackData;
+    uint32_t mFallbackDataSize = 0;
 };
 
 // This class helps parse a command queue.  Note that all sizes/lengths are in
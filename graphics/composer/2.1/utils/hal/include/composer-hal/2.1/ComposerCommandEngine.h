@@ -153,10 +153,12 @@ class ComposerCommandEngine : protected CommandReaderBase {
         std::vector<Layer> requestedLayers;
         std::vector<uint32_t> requestMasks;
 
+        updateDirtyLayerSummary();
         auto err = mHal->validateDisplay(mCurrentDisplay, &changedLayers, &compositionTypes,
                                          &displayRequestMask, &requestedLayers, &requestMasks);
         mResources->setDisplayMustValidateState(mCurrentDisplay, false);
         if (err == Error::NONE) {
+            invalidateCompositionTypes(changedLayers);
             mWriter->setChangedCompositionTypes(changedLayers, compositionTypes);
             mWriter->setDisplayRequests(displayRequestMask, requestedLayers, requestMasks);
         } else {
@@ -165,6 +167,47 @@ class ComposerCommandEngine : protected CommandReaderBase {
         return err;
     }
 
+    // Fetch the layers of the current display that changed since its last
+    // validation, and the number of unchanged layer state commands skipped.
+    void updateDirtyLayerSummary() {
+        mDirtyLayers.clear();
+        mSkippedLayerCalls = 0;
+        if (mResources->takeDirtyLayerSummary(mCurrentDisplay, &mDirtyLayers,
+                                              &mSkippedLayerCalls) == Error::NONE) {
+            ALOGV("validating display %" PRIu64 ": %zu dirty layers, %" PRIu32
+                  " layer calls skipped",
+                  mCurrentDisplay, mDirtyLayers.size(), mSkippedLayerCalls);
+        }
+    }
+
+    // The composition types changed by validation are applied by the HAL on
+    // acceptDisplayChanges, so their shadow copies are no longer accurate.
+    void invalidateCompositionTypes(const std::vector<Layer>& changedLayers) {
+        for (auto layer : changedLayers) {
+            mResources->clearLayerState(mCurrentDisplay, layer,
+                                        IComposerClient::Command::SET_LAYER_COMPOSITION_TYPE);
+        }
+    }
+
+    // Return true and consume the payload when a layer state command sets the
+    // same state as the one last set through the HAL.
+    bool skipUnchangedLayerState(IComposerClient::Command command, uint16_t length) {
+        bool changed = true;
+        mResources->updateLayerState(mCurrentDisplay, mCurrentLayer, command, &mData[mDataRead],
+                                     length, &changed);
+        if (changed) {
+            return false;
+        }
+
+        mDataRead += length;
+        return true;
+    }
+
+    // must be called when the HAL call for a layer state command fails
+    void clearLayerState(IComposerClient::Command command) {
+        mResources->clearLayerState(mCurrentDisplay, mCurrentLayer, command);
+    }
+
     bool executeSelectDisplay(uint16_t length) {
         if (length != CommandWriterBase::kSelectDisplayLength) {
             return false;
@@ -404,9 +447,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerBlendModeLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_BLEND_MODE, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerBlendMode(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_BLEND_MODE);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -417,9 +464,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerColorLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_COLOR, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerColor(mCurrentDisplay, mCurrentLayer, readColor());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_COLOR);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -430,9 +481,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerCompositionTypeLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_COMPOSITION_TYPE, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerCompositionType(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_COMPOSITION_TYPE);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -443,9 +498,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerDataspaceLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_DATASPACE, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerDataspace(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_DATASPACE);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -456,9 +515,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerDisplayFrameLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_DISPLAY_FRAME, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerDisplayFrame(mCurrentDisplay, mCurrentLayer, readRect());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_DISPLAY_FRAME);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -469,9 +532,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerPlaneAlphaLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_PLANE_ALPHA, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerPlaneAlpha(mCurrentDisplay, mCurrentLayer, readFloat());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_PLANE_ALPHA);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -503,9 +570,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerSourceCropLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_SOURCE_CROP, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerSourceCrop(mCurrentDisplay, mCurrentLayer, readFRect());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_SOURCE_CROP);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -516,9 +587,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerTransformLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_TRANSFORM, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerTransform(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_TRANSFORM);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -530,10 +605,14 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length % 4 != 0) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_VISIBLE_REGION, length)) {
+            return true;
+        }
 
         auto region = readRegion(length / 4);
         auto err = mHal->setLayerVisibleRegion(mCurrentDisplay, mCurrentLayer, region);
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_VISIBLE_REGION);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -544,9 +623,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
         if (length != CommandWriterBase::kSetLayerZOrderLength) {
             return false;
         }
+        if (skipUnchangedLayerState(IComposerClient::Command::SET_LAYER_Z_ORDER, length)) {
+            return true;
+        }
 
         auto err = mHal->setLayerZOrder(mCurrentDisplay, mCurrentLayer, read());
         if (err != Error::NONE) {
+            clearLayerState(IComposerClient::Command::SET_LAYER_Z_ORDER);
             mWriter->setError(getCommandLoc(), err);
         }
 
@@ -585,6 +668,10 @@ class ComposerCommandEngine : protected CommandReaderBase {
 
     Display mCurrentDisplay = 0;
     Layer mCurrentLayer = 0;
+
+    // summary of the current display, updated when it is validated
+    std::vector<Layer> mDirtyLayers;
+    uint32_t mSkippedLayerCalls = 0;
 };
 
 }  // namespace hal
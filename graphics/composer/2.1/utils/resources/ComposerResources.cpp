@@ -18,6 +18,8 @@
 
 #include "composer-resources/2.1/ComposerResources.h"
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace graphics {
@@ -209,6 +211,21 @@ Error ComposerLayerResource::getSidebandStream(uint32_t slot, bool fromCache,
     return mSidebandStreamCache.getHandle(slot, fromCache, inHandle, outHandle, outReplacedHandle);
 }
 
+bool ComposerLayerResource::updateState(IComposerClient::Command command, const uint32_t* data,
+                                        uint16_t length) {
+    std::vector<uint32_t>& state = mStates[command];
+    if (state.size() == length && std::equal(data, data + length, state.begin())) {
+        return false;
+    }
+
+    state.assign(data, data + length);
+    return true;
+}
+
+void ComposerLayerResource::clearState(IComposerClient::Command command) {
+    mStates.erase(command);
+}
+
 ComposerDisplayResource::ComposerDisplayResource(DisplayType type, ComposerHandleImporter& importer,
                                                  uint32_t outputBufferCacheSize)
     : mType(type),
@@ -274,6 +291,22 @@ bool ComposerDisplayResource::mustValidate() const {
     return mMustValidate;
 }
 
+void ComposerDisplayResource::markLayerDirty(Layer layer) {
+    mDirtyLayers.insert(layer);
+}
+
+void ComposerDisplayResource::countSkippedLayerCall() {
+    mSkippedLayerCalls++;
+}
+
+void ComposerDisplayResource::takeDirtyLayerSummary(std::vector<Layer>* outDirtyLayers,
+                                                    uint32_t* outSkippedCalls) {
+    outDirtyLayers->assign(mDirtyLayers.begin(), mDirtyLayers.end());
+    *outSkippedCalls = mSkippedLayerCalls;
+    mDirtyLayers.clear();
+    mSkippedLayerCalls = 0;
+}
+
 std::unique_ptr<ComposerResources> ComposerResources::create() {
     auto resources = std::make_unique<ComposerResources>();
     return resources->init() ? std::move(resources) : nullptr;
@@ -399,6 +432,53 @@ bool ComposerResources::mustValidateDisplay(Display display) {
     return false;
 }
 
+Error ComposerResources::updateLayerState(Display display, Layer layer,
+                                          IComposerClient::Command command, const uint32_t* data,
+                                          uint16_t length, bool* outChanged) {
+    *outChanged = true;
+
+    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+    if (!displayResource) {
+        return Error::BAD_DISPLAY;
+    }
+    ComposerLayerResource* layerResource = displayResource->findLayerResource(layer);
+    if (!layerResource) {
+        return Error::BAD_LAYER;
+    }
+
+    *outChanged = layerResource->updateState(command, data, length);
+    if (*outChanged) {
+        displayResource->markLayerDirty(layer);
+    } else {
+        displayResource->countSkippedLayerCall();
+    }
+    return Error::NONE;
+}
+
+void ComposerResources::clearLayerState(Display display, Layer layer,
+                                        IComposerClient::Command command) {
+    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+    ComposerLayerResource* layerResource =
+            displayResource ? displayResource->findLayerResource(layer) : nullptr;
+    if (layerResource) {
+        layerResource->clearState(command);
+    }
+}
+
+Error ComposerResources::takeDirtyLayerSummary(Display display, std::vector<Layer>* outDirtyLayers,
+                                               uint32_t* outSkippedCalls) {
+    std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+    ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+    if (!displayResource) {
+        return Error::BAD_DISPLAY;
+    }
+
+    displayResource->takeDirtyLayerSummary(outDirtyLayers, outSkippedCalls);
+    return Error::NONE;
+}
+
 std::unique_ptr<ComposerDisplayResource> ComposerResources::createDisplayResource(
         ComposerDisplayResource::DisplayType type, uint32_t outputBufferCacheSize) {
     return std::make_unique<ComposerDisplayResource>(type, mImporter, outputBufferCacheSize);
@@ -491,6 +571,9 @@ Error ComposerResources::getHandle(Display display, Layer layer, uint32_t slot,
     }
 
     outReplacedHandle->reset(&mImporter, replacedHandle);
+    if (needLayerResource) {
+        displayResource->markLayerDirty(layer);
+    }
 
     return Error::NONE;
 }
@@ -23,8 +23,10 @@
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include <android/hardware/graphics/composer/2.1/IComposerClient.h>
 #include <android/hardware/graphics/composer/2.1/types.h>
 
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
@@ -101,9 +103,16 @@ class ComposerLayerResource {
                             const native_handle_t** outHandle,
                             const native_handle** outReplacedHandle);
 
+    // Shadow copy of the layer state set through the HAL.  The state of a
+    // command is its raw payload.  updateState returns false when the payload
+    // is identical to the recorded one, and records it otherwise.
+    bool updateState(IComposerClient::Command command, const uint32_t* data, uint16_t length);
+    void clearState(IComposerClient::Command command);
+
   protected:
     ComposerHandleCache mBufferCache;
     ComposerHandleCache mSidebandStreamCache;
+    std::unordered_map<IComposerClient::Command, std::vector<uint32_t>> mStates;
 };
 
 // display resource
@@ -140,11 +149,18 @@ class ComposerDisplayResource {
 
     bool mustValidate() const;
 
+    // dirty layer tracking between two calls to takeDirtyLayerSummary
+    void markLayerDirty(Layer layer);
+    void countSkippedLayerCall();
+    void takeDirtyLayerSummary(std::vector<Layer>* outDirtyLayers, uint32_t* outSkippedCalls);
+
   protected:
     const DisplayType mType;
     ComposerHandleCache mClientTargetCache;
     ComposerHandleCache mOutputBufferCache;
     bool mMustValidate;
+    std::unordered_set<Layer> mDirtyLayers;
+    uint32_t mSkippedLayerCalls = 0;
 
     std::unordered_map<Layer, std::unique_ptr<ComposerLayerResource>> mLayerResources;
 };
@@ -176,6 +192,18 @@ class ComposerResources {
 
     bool mustValidateDisplay(Display display);
 
+    // Compare the payload of a layer state command with the one last set
+    // through the HAL.  outChanged is set to false when the HAL call can be
+    // skipped.  The state must be cleared when the HAL call fails.
+    Error updateLayerState(Display display, Layer layer, IComposerClient::Command command,
+                           const uint32_t* data, uint16_t length, bool* outChanged);
+    void clearLayerState(Display display, Layer layer, IComposerClient::Command command);
+
+    // Return the layers changed and the number of layer state commands
+    // skipped since the last call, and start over.
+    Error takeDirtyLayerSummary(Display display, std::vector<Layer>* outDirtyLayers,
+                                uint32_t* outSkippedCalls);
+
     // When a buffer in the cache is replaced by a new one, we must keep it
     // alive until it has been replaced in ComposerHal.
     class ReplacedHandle {
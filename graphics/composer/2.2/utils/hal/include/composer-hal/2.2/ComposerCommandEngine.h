@@ -81,6 +81,8 @@ class ComposerCommandEngine : public V2_1::hal::ComposerCommandEngine {
             return false;
         }
 
+        // the float color replaces the color tracked by SET_LAYER_COLOR
+        clearLayerState(V2_1::IComposerClient::Command::SET_LAYER_COLOR);
         auto err = mHal->setLayerFloatColor(mCurrentDisplay, mCurrentLayer, readFloatColor());
         if (err != Error::NONE) {
             mWriter->setError(getCommandLoc(), err);
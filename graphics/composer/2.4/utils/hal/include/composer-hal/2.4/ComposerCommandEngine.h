@@ -58,11 +58,13 @@ class ComposerCommandEngine : public V2_3::hal::ComposerCommandEngine {
         IComposerClient::ClientTargetProperty clientTargetProperty{PixelFormat::RGBA_8888,
                                                                    Dataspace::UNKNOWN};
 
+        updateDirtyLayerSummary();
         auto err = mHal->validateDisplay_2_4(mCurrentDisplay, &changedLayers, &compositionTypes,
                                              &displayRequestMask, &requestedLayers, &requestMasks,
                                              &clientTargetProperty);
         mResources->setDisplayMustValidateState(mCurrentDisplay, false);
         if (err == Error::NONE) {
+            invalidateCompositionTypes(changedLayers);
             mWriter->setChangedCompositionTypes(changedLayers, compositionTypes);
             mWriter->setDisplayRequests(displayRequestMask, requestedLayers, requestMasks);
             getWriter()->setClientTargetProperty(clientTargetProperty);
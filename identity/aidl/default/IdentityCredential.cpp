@@ -172,8 +172,9 @@ ndk::ScopedAStatus IdentityCredential::createAuthChallenge(int64_t* outChallenge
     return ndk::ScopedAStatus::ok();
 }
 
-// TODO: this could be a lot faster if we did all the splitting and pubkey extraction
-// ahead of time.
+// This is called for every access control profile, with the same reader certificate
+// chain. The support library caches parsed certificates, so the chain is only actually
+// parsed the first time around.
 bool checkReaderAuthentication(const SecureAccessControlProfile& profile,
                                const vector<uint8_t>& readerCertificateChain) {
     optional<vector<uint8_t>> acpPubKey = support::certificateChainGetTopMostKey(
@@ -490,11 +491,9 @@ ndk::ScopedAStatus IdentityCredential::startRetrieval(
         profileIdToAccessCheckResult_[profile.id] = accessControlCheck;
     }
 
-    deviceNameSpacesMap_ = cppbor::Map();
-    currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
-
     requestCountsRemaining_ = requestCounts;
     currentNameSpace_ = "";
+    entryRemainingBytes_ = 0;
 
     itemsRequest_ = itemsRequest;
     signingKeyBlob_ = byteStringToUnsigned(signingKeyBlobS);
@@ -502,6 +501,26 @@ ndk::ScopedAStatus IdentityCredential::startRetrieval(
     // Finally, calculate the size of DeviceNameSpaces. We need to know it ahead of time.
     expectedDeviceNameSpacesSize_ = calcDeviceNameSpacesSize();
 
+    // Since the size of DeviceNameSpaces and the number of entries in each of
+    // its namespaces are known, it can be encoded and MACed as entries are
+    // retrieved instead of being held as a parsed map and re-encoded at the end.
+    encodedDeviceNameSpaces_.clear();
+    encodedDeviceNameSpaces_.reserve(expectedDeviceNameSpacesSize_);
+    deviceNameSpacesValid_ = true;
+    deviceNameSpacesCurrentNameSpace_ = "";
+    deviceNameSpacesNumNameSpaces_ = 0;
+    deviceNameSpacesNumEntries_ = 0;
+    deviceAuthenticationMacStarted_ = false;
+    if (signingKeyBlob_.size() > 0 && sessionTranscript_.size() > 0 &&
+        readerPublicKey_.size() > 0) {
+        // If this fails finishRetrieval() will try again, and report the error.
+        deviceAuthenticationMacStarted_ = startDeviceAuthenticationMac().isOk();
+    }
+    vector<uint8_t> mapHeader;
+    cppbor::encodeHeader(cppbor::MAP, expectedNumEntriesInNameSpace_.size(),
+                         std::back_inserter(mapHeader));
+    appendToDeviceNameSpaces(mapHeader);
+
     numStartRetrievalCalls_ += 1;
     return ndk::ScopedAStatus::ok();
 }
@@ -539,10 +558,12 @@ size_t IdentityCredential::calcDeviceNameSpacesSize() {
      *        DataItemValue = any
      *
      * This function will calculate its length using knowledge of how CBOR is
-     * encoded.
+     * encoded. It also records how many entries each namespace will contain in
+     * expectedNumEntriesInNameSpace_.
      */
     size_t ret = 0;
     size_t numNamespacesWithValues = 0;
+    expectedNumEntriesInNameSpace_.clear();
     for (const RequestNamespace& rns : requestNamespaces_) {
         vector<RequestDataItem> itemsToInclude;
 
@@ -601,6 +622,7 @@ size_t IdentityCredential::calcDeviceNameSpacesSize() {
             ret += item.size;
         }
 
+        expectedNumEntriesInNameSpace_[rns.namespaceName] = itemsToInclude.size();
         numNamespacesWithValues++;
     }
 
@@ -650,12 +672,6 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
                     "Moved to new name space but one or more entries need to be retrieved "
                     "in current name space"));
         }
-        if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-            deviceNameSpacesMap_.add(currentNameSpace_,
-                                     std::move(currentNameSpaceDeviceNameSpacesMap_));
-        }
-        currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
-
         requestCountsRemaining_.erase(requestCountsRemaining_.begin());
         currentNameSpace_ = nameSpace;
     }
@@ -705,9 +721,30 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
 
     entryAdditionalData_ = entryCreateAdditionalData(nameSpace, name, accessControlProfileIds);
 
+    // All of the previous entry must have been retrieved before it's followed by
+    // another one in DeviceNameSpaces.
+    if (entryRemainingBytes_ > 0) {
+        LOG(ERROR) << "Starting new entry before " << entryRemainingBytes_
+                   << " remaining bytes of previous entry were retrieved";
+        deviceNameSpacesValid_ = false;
+    }
+    vector<uint8_t> keys;
+    if (deviceNameSpacesNumNameSpaces_ == 0 || nameSpace != deviceNameSpacesCurrentNameSpace_) {
+        endDeviceNameSpacesNameSpace();
+        const auto& it = expectedNumEntriesInNameSpace_.find(nameSpace);
+        size_t numEntries = (it != expectedNumEntriesInNameSpace_.end()) ? it->second : 0;
+        cppbor::Tstr(nameSpace).encodeAppend(&keys);
+        cppbor::encodeHeader(cppbor::MAP, numEntries, std::back_inserter(keys));
+        deviceNameSpacesCurrentNameSpace_ = nameSpace;
+        deviceNameSpacesNumNameSpaces_ += 1;
+    }
+    cppbor::Tstr(name).encodeAppend(&keys);
+    appendToDeviceNameSpaces(keys);
+    deviceNameSpacesNumEntries_ += 1;
+
     currentName_ = name;
     entryRemainingBytes_ = entrySize;
-    entryValue_.resize(0);
+    entryValueOffset_ = encodedDeviceNameSpaces_.size();
 
     return ndk::ScopedAStatus::ok();
 }
@@ -741,38 +778,172 @@ ndk::ScopedAStatus IdentityCredential::retrieveEntryValue(const vector<int8_t>&
         }
     }
 
-    entryValue_.insert(entryValue_.end(), content.value().begin(), content.value().end());
+    appendToDeviceNameSpaces(content.value());
 
     if (entryRemainingBytes_ == 0) {
-        auto [entryValueItem, _, message] = cppbor::parse(entryValue_);
-        if (entryValueItem == nullptr) {
+        // The value goes into DeviceNameSpaces as-is, so check that it's exactly
+        // one CBOR data item. Parsing with views avoids copying any strings in it.
+        const uint8_t* entryValueBegin = encodedDeviceNameSpaces_.data() + entryValueOffset_;
+        const uint8_t* entryValueEnd =
+                encodedDeviceNameSpaces_.data() + encodedDeviceNameSpaces_.size();
+        auto [entryValueItem, entryValuePos, message] =
+                cppbor::parseWithViews(entryValueBegin, entryValueEnd);
+        if (entryValueItem == nullptr || entryValuePos != entryValueEnd) {
+            deviceNameSpacesValid_ = false;
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_INVALID_DATA,
                     "Retrieved data which is invalid CBOR"));
         }
-        currentNameSpaceDeviceNameSpacesMap_.add(currentName_, std::move(entryValueItem));
     }
 
     *outContent = byteStringToSigned(content.value());
     return ndk::ScopedAStatus::ok();
 }
 
+void IdentityCredential::appendToDeviceNameSpaces(const uint8_t* data, size_t size) {
+    encodedDeviceNameSpaces_.insert(encodedDeviceNameSpaces_.end(), data, data + size);
+    if (deviceAuthenticationMacStarted_ && !deviceAuthenticationMac_.update(data, size)) {
+        // finishRetrieval() will MAC all of DeviceNameSpaces in one go instead.
+        deviceAuthenticationMacStarted_ = false;
+    }
+}
+
+void IdentityCredential::endDeviceNameSpacesNameSpace() {
+    if (deviceNameSpacesNumNameSpaces_ == 0) {
+        return;
+    }
+    const auto& it = expectedNumEntriesInNameSpace_.find(deviceNameSpacesCurrentNameSpace_);
+    size_t expectedNumEntries = (it != expectedNumEntriesInNameSpace_.end()) ? it->second : 0;
+    if (deviceNameSpacesNumEntries_ != expectedNumEntries) {
+        LOG(ERROR) << "Retrieved " << deviceNameSpacesNumEntries_ << " entries in name space "
+                   << deviceNameSpacesCurrentNameSpace_ << ", was expecting "
+                   << expectedNumEntries;
+        deviceNameSpacesValid_ = false;
+    }
+    deviceNameSpacesNumEntries_ = 0;
+}
+
+// Derives the key for MACing DeviceAuthentication from the signing key, the
+// reader's ephemeral public key and SessionTranscript. The result is kept in
+// deviceAuthenticationMacKey_ so that calling startRetrieval() again in the
+// same session doesn't redo the ECDH and HKDF.
+ndk::ScopedAStatus IdentityCredential::deriveDeviceAuthenticationMacKey() {
+    if (deviceAuthenticationMacKey_.size() > 0 &&
+        deviceAuthenticationMacKeySigningKeyBlob_ == signingKeyBlob_ &&
+        deviceAuthenticationMacKeyReaderPublicKey_ == readerPublicKey_) {
+        return ndk::ScopedAStatus::ok();
+    }
+    deviceAuthenticationMacKey_.clear();
+
+    vector<uint8_t> docTypeAsBlob(docType_.begin(), docType_.end());
+    optional<vector<uint8_t>> signingKey =
+            support::decryptAes128Gcm(storageKey_, signingKeyBlob_, docTypeAsBlob);
+    if (!signingKey) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA, "Error decrypting signingKeyBlob"));
+    }
+
+    optional<vector<uint8_t>> sharedSecret = support::ecdh(readerPublicKey_, signingKey.value());
+    if (!sharedSecret) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_FAILED, "Error doing ECDH"));
+    }
+
+    // Mix-in SessionTranscriptBytes
+    vector<uint8_t> sessionTranscriptBytes = cppbor::Semantic(24, sessionTranscript_).encode();
+    vector<uint8_t> sharedSecretWithSessionTranscriptBytes = sharedSecret.value();
+    std::copy(sessionTranscriptBytes.begin(), sessionTranscriptBytes.end(),
+              std::back_inserter(sharedSecretWithSessionTranscriptBytes));
+
+    vector<uint8_t> salt = {0x00};
+    vector<uint8_t> info = {};
+    optional<vector<uint8_t>> derivedKey =
+            support::hkdf(sharedSecretWithSessionTranscriptBytes, salt, info, 32);
+    if (!derivedKey) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_FAILED, "Error deriving key from shared secret"));
+    }
+
+    deviceAuthenticationMacKey_ = std::move(derivedKey.value());
+    deviceAuthenticationMacKeySigningKeyBlob_ = signingKeyBlob_;
+    deviceAuthenticationMacKeyReaderPublicKey_ = readerPublicKey_;
+    return ndk::ScopedAStatus::ok();
+}
+
+// Starts the HMAC of the ToBeMaced structure for a COSE_Mac0 whose detached
+// content is DeviceAuthenticationBytes:
+//
+//   DeviceAuthentication = [
+//     "DeviceAuthentication",
+//     SessionTranscript,
+//     DocType,
+//     DeviceNameSpacesBytes
+//   ]
+//   DeviceNameSpacesBytes = #6.24(bstr .cbor DeviceNameSpaces)
+//   DeviceAuthenticationBytes = #6.24(bstr .cbor DeviceAuthentication)
+//
+// Everything up to DeviceNameSpaces is MACed here, which is possible because
+// the size of DeviceNameSpaces is known. The rest is fed in by
+// appendToDeviceNameSpaces().
+ndk::ScopedAStatus IdentityCredential::startDeviceAuthenticationMac() {
+    ndk::ScopedAStatus status = deriveDeviceAuthenticationMacKey();
+    if (!status.isOk()) {
+        return status;
+    }
+
+    // DeviceAuthentication, up to the content of DeviceNameSpacesBytes.
+    vector<uint8_t> deviceAuthenticationPrefix;
+    cppbor::encodeHeader(cppbor::ARRAY, 4, std::back_inserter(deviceAuthenticationPrefix));
+    cppbor::Tstr("DeviceAuthentication").encodeAppend(&deviceAuthenticationPrefix);
+    sessionTranscriptItem_->encodeAppend(&deviceAuthenticationPrefix);
+    cppbor::Tstr(docType_).encodeAppend(&deviceAuthenticationPrefix);
+    cppbor::encodeHeader(cppbor::SEMANTIC, 24, std::back_inserter(deviceAuthenticationPrefix));
+    cppbor::encodeHeader(cppbor::BSTR, expectedDeviceNameSpacesSize_,
+                         std::back_inserter(deviceAuthenticationPrefix));
+    size_t deviceAuthenticationSize =
+            deviceAuthenticationPrefix.size() + expectedDeviceNameSpacesSize_;
+
+    // DeviceAuthenticationBytes, up to the content of DeviceAuthentication.
+    vector<uint8_t> deviceAuthenticationBytesPrefix;
+    cppbor::encodeHeader(cppbor::SEMANTIC, 24,
+                         std::back_inserter(deviceAuthenticationBytesPrefix));
+    cppbor::encodeHeader(cppbor::BSTR, deviceAuthenticationSize,
+                         std::back_inserter(deviceAuthenticationBytesPrefix));
+    size_t deviceAuthenticationBytesSize =
+            deviceAuthenticationBytesPrefix.size() + deviceAuthenticationSize;
+
+    if (!deviceAuthenticationMac_.init(deviceAuthenticationMacKey_) ||
+        !deviceAuthenticationMac_.update(
+                support::coseBuildToBeMACedPrefix(deviceAuthenticationBytesSize)) ||
+        !deviceAuthenticationMac_.update(deviceAuthenticationBytesPrefix) ||
+        !deviceAuthenticationMac_.update(deviceAuthenticationPrefix)) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
 ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<int8_t>* outMac,
                                                        vector<int8_t>* outDeviceNameSpaces) {
-    if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-        deviceNameSpacesMap_.add(currentNameSpace_,
-                                 std::move(currentNameSpaceDeviceNameSpacesMap_));
+    endDeviceNameSpacesNameSpace();
+    if (entryRemainingBytes_ > 0 ||
+        deviceNameSpacesNumNameSpaces_ != expectedNumEntriesInNameSpace_.size()) {
+        deviceNameSpacesValid_ = false;
+    }
+    if (!deviceNameSpacesValid_) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA,
+                "Retrieved entries don't match the requested entries"));
     }
-    vector<uint8_t> encodedDeviceNameSpaces = deviceNameSpacesMap_.encode();
 
-    if (encodedDeviceNameSpaces.size() != expectedDeviceNameSpacesSize_) {
-        LOG(ERROR) << "encodedDeviceNameSpaces is " << encodedDeviceNameSpaces.size() << " bytes, "
-                   << "was expecting " << expectedDeviceNameSpacesSize_;
+    if (encodedDeviceNameSpaces_.size() != expectedDeviceNameSpacesSize_) {
+        LOG(ERROR) << "encodedDeviceNameSpaces is " << encodedDeviceNameSpaces_.size()
+                   << " bytes, was expecting " << expectedDeviceNameSpacesSize_;
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_INVALID_DATA,
                 StringPrintf(
                         "Unexpected CBOR size %zd for encodedDeviceNameSpaces, was expecting %zd",
-                        encodedDeviceNameSpaces.size(), expectedDeviceNameSpacesSize_)
+                        encodedDeviceNameSpaces_.size(), expectedDeviceNameSpacesSize_)
                         .c_str()));
     }
 
@@ -781,47 +952,24 @@ ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<int8_t>* outMac,
     optional<vector<uint8_t>> mac;
     if (signingKeyBlob_.size() > 0 && sessionTranscript_.size() > 0 &&
         readerPublicKey_.size() > 0) {
-        cppbor::Array array;
-        array.add("DeviceAuthentication");
-        array.add(sessionTranscriptItem_->clone());
-        array.add(docType_);
-        array.add(cppbor::Semantic(24, encodedDeviceNameSpaces));
-        vector<uint8_t> deviceAuthenticationBytes = cppbor::Semantic(24, array.encode()).encode();
-
-        vector<uint8_t> docTypeAsBlob(docType_.begin(), docType_.end());
-        optional<vector<uint8_t>> signingKey =
-                support::decryptAes128Gcm(storageKey_, signingKeyBlob_, docTypeAsBlob);
-        if (!signingKey) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_INVALID_DATA,
-                    "Error decrypting signingKeyBlob"));
-        }
-
-        optional<vector<uint8_t>> sharedSecret =
-                support::ecdh(readerPublicKey_, signingKey.value());
-        if (!sharedSecret) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_FAILED, "Error doing ECDH"));
+        if (!deviceAuthenticationMacStarted_) {
+            // Either the reader key was set after startRetrieval() or MACing
+            // failed along the way. Start over with all of DeviceNameSpaces.
+            ndk::ScopedAStatus status = startDeviceAuthenticationMac();
+            if (!status.isOk()) {
+                return status;
+            }
+            if (!deviceAuthenticationMac_.update(encodedDeviceNameSpaces_)) {
+                return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                        IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
+            }
         }
+        deviceAuthenticationMacStarted_ = false;
 
-        // Mix-in SessionTranscriptBytes
-        vector<uint8_t> sessionTranscriptBytes = cppbor::Semantic(24, sessionTranscript_).encode();
-        vector<uint8_t> sharedSecretWithSessionTranscriptBytes = sharedSecret.value();
-        std::copy(sessionTranscriptBytes.begin(), sessionTranscriptBytes.end(),
-                  std::back_inserter(sharedSecretWithSessionTranscriptBytes));
-
-        vector<uint8_t> salt = {0x00};
-        vector<uint8_t> info = {};
-        optional<vector<uint8_t>> derivedKey =
-                support::hkdf(sharedSecretWithSessionTranscriptBytes, salt, info, 32);
-        if (!derivedKey) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_FAILED,
-                    "Error deriving key from shared secret"));
+        optional<vector<uint8_t>> digest = deviceAuthenticationMac_.finish();
+        if (digest) {
+            mac = support::coseMacWithDigest(digest.value(), {} /* data */);
         }
-
-        mac = support::coseMac0(derivedKey.value(), {},      // payload
-                                deviceAuthenticationBytes);  // detached content
         if (!mac) {
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
@@ -829,7 +977,7 @@ ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<int8_t>* outMac,
     }
 
     *outMac = byteStringToSigned(mac.value_or(vector<uint8_t>({})));
-    *outDeviceNameSpaces = byteStringToSigned(encodedDeviceNameSpaces);
+    *outDeviceNameSpaces = byteStringToSigned(encodedDeviceNameSpaces_);
     return ndk::ScopedAStatus::ok();
 }
 
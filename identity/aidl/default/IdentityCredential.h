@@ -44,7 +44,13 @@ class IdentityCredential : public BnIdentityCredential {
         : credentialData_(credentialData),
           numStartRetrievalCalls_(0),
           authChallenge_(0),
-          expectedDeviceNameSpacesSize_(0) {}
+          expectedDeviceNameSpacesSize_(0),
+          deviceNameSpacesValid_(false),
+          deviceNameSpacesNumNameSpaces_(0),
+          deviceNameSpacesNumEntries_(0),
+          deviceAuthenticationMacStarted_(false),
+          entryRemainingBytes_(0),
+          entryValueOffset_(0) {}
 
     // Parses and decrypts credentialData_, return a status code from
     // IIdentityCredentialStore. Must be called right after construction.
@@ -107,20 +113,44 @@ class IdentityCredential : public BnIdentityCredential {
     vector<uint8_t> itemsRequest_;
     vector<int32_t> requestCountsRemaining_;
     map<string, set<string>> requestedNameSpacesAndNames_;
-    cppbor::Map deviceNameSpacesMap_;
-    cppbor::Map currentNameSpaceDeviceNameSpacesMap_;
 
     // Calculated at startRetrieval() time.
     size_t expectedDeviceNameSpacesSize_;
+    map<string, size_t> expectedNumEntriesInNameSpace_;
+
+    // DeviceNameSpaces is encoded, and MACed if needed, as entries are
+    // retrieved rather than at finishRetrieval() time.
+    vector<uint8_t> encodedDeviceNameSpaces_;
+    bool deviceNameSpacesValid_;
+    string deviceNameSpacesCurrentNameSpace_;
+    size_t deviceNameSpacesNumNameSpaces_;
+    size_t deviceNameSpacesNumEntries_;
+    ::android::hardware::identity::support::HmacSha256Stream deviceAuthenticationMac_;
+    bool deviceAuthenticationMacStarted_;
+
+    // The key derived for MACing DeviceAuthentication, and the signing key blob
+    // and reader key it was derived from. SessionTranscript can't change once
+    // retrieval has started, so this is reused for as long as the other two
+    // stay the same.
+    vector<uint8_t> deviceAuthenticationMacKey_;
+    vector<uint8_t> deviceAuthenticationMacKeySigningKeyBlob_;
+    vector<uint8_t> deviceAuthenticationMacKeyReaderPublicKey_;
 
     // Set at startRetrieveEntryValue() time.
     string currentNameSpace_;
     string currentName_;
     size_t entryRemainingBytes_;
-    vector<uint8_t> entryValue_;
+    size_t entryValueOffset_;
     vector<uint8_t> entryAdditionalData_;
 
     size_t calcDeviceNameSpacesSize();
+    ndk::ScopedAStatus deriveDeviceAuthenticationMacKey();
+    ndk::ScopedAStatus startDeviceAuthenticationMac();
+    void appendToDeviceNameSpaces(const uint8_t* data, size_t size);
+    void appendToDeviceNameSpaces(const vector<uint8_t>& data) {
+        appendToDeviceNameSpaces(data.data(), data.size());
+    }
+    void endDeviceNameSpacesNameSpace();
 };
 
 }  // namespace aidl::android::hardware::identity
@@ -18,6 +18,7 @@
 #define IDENTITY_SUPPORT_INCLUDE_IDENTITY_CREDENTIAL_UTILS_H_
 
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <tuple>
@@ -173,6 +174,34 @@ optional<vector<uint8_t>> signEcDsaDigest(const vector<uint8_t>& key,
 //
 optional<vector<uint8_t>> hmacSha256(const vector<uint8_t>& key, const vector<uint8_t>& data);
 
+// Calculates the HMAC with SHA-256 of data supplied in pieces, for when the
+// data is produced incrementally and shouldn't be buffered in full. Feeding
+// the same bytes to update() as would be passed to hmacSha256() gives the same
+// result.
+//
+class HmacSha256Stream {
+  public:
+    HmacSha256Stream();
+    ~HmacSha256Stream();
+
+    // Starts a new calculation using |key|, discarding any calculation in
+    // progress. Returns false on error.
+    bool init(const vector<uint8_t>& key);
+
+    // Adds |size| bytes at |data| to the calculation. Returns false on error or
+    // if init() hasn't been called.
+    bool update(const uint8_t* data, size_t size);
+    bool update(const vector<uint8_t>& data) { return update(data.data(), data.size()); }
+
+    // Finishes the calculation and returns the 32-byte HMAC. A new calculation
+    // must be started with init() afterwards.
+    optional<vector<uint8_t>> finish();
+
+  private:
+    struct Context;
+    std::unique_ptr<Context> context_;
+};
+
 // Checks that |signature| (in DER format) is a valid signature of |digest|,
 // made with |publicKey| (which must be in the format returned by
 // ecKeyPairGetPublicKey()).
@@ -337,6 +366,15 @@ optional<vector<uint8_t>> coseSignGetX5Chain(const vector<uint8_t>& signatureCos
 optional<vector<uint8_t>> coseMac0(const vector<uint8_t>& key, const vector<uint8_t>& data,
                                    const vector<uint8_t>& detachedContent);
 
+// Returns the beginning of the ToBeMaced CBOR used by coseMac0() when |data| is
+// empty and the detached content is |detachedContentSize| bytes long, i.e.
+// everything except the detached content itself. The HMAC-SHA256 of this
+// followed by the detached content can be passed to coseMacWithDigest() to get
+// the same result as coseMac0(), without having the detached content in memory
+// all at once.
+//
+vector<uint8_t> coseBuildToBeMACedPrefix(size_t detachedContentSize);
+
 // Creates a COSE_Mac0 where |digestToBeMaced| is the HMAC-SHA256
 // of the ToBeMaced CBOR from RFC 8051 "6.3. How to Compute and Verify a MAC".
 //
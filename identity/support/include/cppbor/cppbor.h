@@ -22,6 +22,7 @@
 #include <memory>
 #include <numeric>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace cppbor {
@@ -58,6 +59,8 @@ class Nint;
 class Int;
 class Tstr;
 class Bstr;
+class ViewTstr;
+class ViewBstr;
 class Simple;
 class Bool;
 class Array;
@@ -116,6 +119,8 @@ class Item {
     virtual const Nint* asNint() const { return nullptr; }
     virtual const Tstr* asTstr() const { return nullptr; }
     virtual const Bstr* asBstr() const { return nullptr; }
+    virtual const ViewTstr* asViewTstr() const { return nullptr; }
+    virtual const ViewBstr* asViewBstr() const { return nullptr; }
     virtual const Simple* asSimple() const { return nullptr; }
     virtual const Map* asMap() const { return nullptr; }
     virtual const Array* asArray() const { return nullptr; }
@@ -161,22 +166,43 @@ class Item {
     }
 
     /**
-     * Encodes the Item into a new std::vector<uint8_t>.
+     * Encodes the Item into a new std::vector<uint8_t>.  The exact size is computed first, so the
+     * vector is allocated once and the Item is written directly into it.  Returns an empty vector
+     * if the Item could not be encoded.
      */
     std::vector<uint8_t> encode() const {
-        std::vector<uint8_t> retval;
-        retval.reserve(encodedSize());
-        encode(std::back_inserter(retval));
+        std::vector<uint8_t> retval(encodedSize());
+        if (encode(retval.data(), retval.data() + retval.size()) != retval.data() + retval.size()) {
+            return {};
+        }
         return retval;
     }
 
     /**
-     * Encodes the Item into a new std::string.
+     * Encodes the Item, appending it to the provided vector.  Like encode(), this makes at most one
+     * allocation.  Returns false, leaving the vector unchanged, if the Item could not be encoded.
+     */
+    bool encodeAppend(std::vector<uint8_t>* out) const {
+        size_t offset = out->size();
+        out->resize(offset + encodedSize());
+        if (encode(out->data() + offset, out->data() + out->size()) !=
+            out->data() + out->size()) {
+            out->resize(offset);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Encodes the Item into a new std::string.  Returns an empty string if the Item could not be
+     * encoded.
      */
     std::string toString() const {
-        std::string retval;
-        retval.reserve(encodedSize());
-        encode([&](uint8_t v) { retval.push_back(v); });
+        std::string retval(encodedSize(), '\0');
+        uint8_t* begin = reinterpret_cast<uint8_t*>(retval.data());
+        if (encode(begin, begin + retval.size()) != begin + retval.size()) {
+            return {};
+        }
         return retval;
     }
 
@@ -333,7 +359,7 @@ class Bstr : public Item {
 };
 
 /**
- * Bstr is a concrete Item that implements major type 3.
+ * Tstr is a concrete Item that implements major type 3.
  */
 class Tstr : public Item {
   public:
@@ -382,6 +408,89 @@ class Tstr : public Item {
     std::string mValue;
 };
 
+/**
+ * ViewBstr is a read-only version of Bstr backed by std::basic_string_view<uint8_t>.  It does not
+ * copy the content, so the buffer it refers to must outlive the ViewBstr.  ViewBstr items are
+ * produced by parseWithViews().
+ */
+class ViewBstr : public Item {
+  public:
+    static constexpr MajorType kMajorType = BSTR;
+
+    // Construct from a basic_string_view<uint8_t>
+    explicit ViewBstr(std::basic_string_view<uint8_t> v) : mView(v) {}
+
+    // Construct from a pointer/size pair
+    explicit ViewBstr(const std::pair<const uint8_t*, size_t>& buf)
+        : mView(buf.first, buf.second) {}
+
+    // Construct from a pointer range
+    ViewBstr(const uint8_t* begin, const uint8_t* end) : mView(begin, end - begin) {}
+
+    bool operator==(const ViewBstr& other) const& { return mView == other.mView; }
+
+    MajorType type() const override { return kMajorType; }
+    const ViewBstr* asViewBstr() const override { return this; }
+    size_t encodedSize() const override { return headerSize(mView.size()) + mView.size(); }
+    using Item::encode;
+    uint8_t* encode(uint8_t* pos, const uint8_t* end) const override;
+    void encode(EncodeCallback encodeCallback) const override {
+        encodeHeader(mView.size(), encodeCallback);
+        encodeValue(encodeCallback);
+    }
+
+    std::basic_string_view<uint8_t> view() const { return mView; }
+
+    virtual std::unique_ptr<Item> clone() const override {
+        return std::make_unique<ViewBstr>(mView);
+    }
+
+  private:
+    void encodeValue(EncodeCallback encodeCallback) const;
+
+    std::basic_string_view<uint8_t> mView;
+};
+
+/**
+ * ViewTstr is a read-only version of Tstr backed by std::string_view.  It does not copy the
+ * content, so the buffer it refers to must outlive the ViewTstr.  ViewTstr items are produced by
+ * parseWithViews().
+ */
+class ViewTstr : public Item {
+  public:
+    static constexpr MajorType kMajorType = TSTR;
+
+    // Construct from a string_view
+    explicit ViewTstr(std::string_view v) : mView(v) {}
+
+    // Construct from a pointer range
+    ViewTstr(const uint8_t* begin, const uint8_t* end)
+        : mView(reinterpret_cast<const char*>(begin), end - begin) {}
+
+    bool operator==(const ViewTstr& other) const& { return mView == other.mView; }
+
+    MajorType type() const override { return kMajorType; }
+    const ViewTstr* asViewTstr() const override { return this; }
+    size_t encodedSize() const override { return headerSize(mView.size()) + mView.size(); }
+    using Item::encode;
+    uint8_t* encode(uint8_t* pos, const uint8_t* end) const override;
+    void encode(EncodeCallback encodeCallback) const override {
+        encodeHeader(mView.size(), encodeCallback);
+        encodeValue(encodeCallback);
+    }
+
+    std::string_view view() const { return mView; }
+
+    virtual std::unique_ptr<Item> clone() const override {
+        return std::make_unique<ViewTstr>(mView);
+    }
+
+  private:
+    void encodeValue(EncodeCallback encodeCallback) const;
+
+    std::string_view mView;
+};
+
 /**
  * CompoundItem is an abstract Item that provides common functionality for Items that contain other
  * items, i.e. Arrays (CBOR type 4) and Maps (CBOR type 5).
@@ -659,6 +768,16 @@ std::unique_ptr<T> downcastItem(std::unique_ptr<Item>&& v) {
                 return nullptr;
             }
         }
+        // Owned and view strings share a major type, so check the concrete class as well.
+        if constexpr (std::is_same_v<Bstr, T>) {
+            if (!v->asBstr()) return nullptr;
+        } else if constexpr (std::is_same_v<ViewBstr, T>) {
+            if (!v->asViewBstr()) return nullptr;
+        } else if constexpr (std::is_same_v<Tstr, T>) {
+            if (!v->asTstr()) return nullptr;
+        } else if constexpr (std::is_same_v<ViewTstr, T>) {
+            if (!v->asViewTstr()) return nullptr;
+        }
         return std::unique_ptr<T>(static_cast<T*>(v.release()));
     } else {
         return nullptr;
@@ -66,6 +66,36 @@ inline ParseResult parse(const uint8_t* begin, size_t size) {
     return parse(begin, begin + size);
 }
 
+/**
+ * Parse the first CBOR data item (possibly compound) from the range [begin, end).  Unlike parse(),
+ * byte and text strings are returned as ViewBstr and ViewTstr items that refer into the input
+ * rather than copying it, so the input buffer must outlive the returned Item.
+ *
+ * The return value is the same as for parse().
+ */
+ParseResult parseWithViews(const uint8_t* begin, const uint8_t* end);
+
+/**
+ * Parse the first CBOR data item (possibly compound) from the byte vector, returning strings as
+ * views into it.  The vector must outlive the returned Item, and must not be modified while the
+ * Item is in use.
+ *
+ * The return value is the same as for parse().
+ */
+inline ParseResult parseWithViews(const std::vector<uint8_t>& encoding) {
+    return parseWithViews(encoding.data(), encoding.data() + encoding.size());
+}
+
+/**
+ * Parse the first CBOR data item (possibly compound) from the range [begin, begin + size),
+ * returning strings as views into it.  The buffer must outlive the returned Item.
+ *
+ * The return value is the same as for parse().
+ */
+inline ParseResult parseWithViews(const uint8_t* begin, size_t size) {
+    return parseWithViews(begin, begin + size);
+}
+
 class ParseClient;
 
 /**
@@ -82,6 +112,13 @@ inline void parse(const std::vector<uint8_t>& encoding, ParseClient* parseClient
     return parse(encoding.data(), encoding.data() + encoding.size(), parseClient);
 }
 
+/**
+ * Parse the CBOR data in the range [begin, end) in streaming fashion, calling methods on the
+ * provided ParseClient when elements are found.  Byte and text strings are passed to the client as
+ * ViewBstr and ViewTstr items that refer into [begin, end).
+ */
+void parseWithViews(const uint8_t* begin, const uint8_t* end, ParseClient* parseClient);
+
 /**
  * A pure interface that callers of the streaming parse functions must implement.
  */
@@ -26,6 +26,9 @@
 #include <time.h>
 #include <chrono>
 #include <iomanip>
+#include <list>
+#include <map>
+#include <mutex>
 
 #include <openssl/aes.h>
 #include <openssl/bn.h>
@@ -61,6 +64,7 @@ namespace identity {
 namespace support {
 
 using ::std::pair;
+using ::std::shared_ptr;
 using ::std::unique_ptr;
 
 // ---------------------------------------------------------------------------
@@ -641,6 +645,192 @@ struct X509_NAME_Deleter {
 };
 using X509_NAME_Ptr = unique_ptr<X509_NAME, X509_NAME_Deleter>;
 
+// ---------------------------------------------------------------------------
+// Certificate cache.
+//
+// The same reader certificate chains are split, validated and have their
+// public keys extracted on every presentation. To avoid parsing them over and
+// over again, parsed certificates and chain validation results are cached,
+// keyed by the SHA-256 of their DER encoding.
+// ---------------------------------------------------------------------------
+
+constexpr size_t kCertificateCacheSize = 32;
+constexpr size_t kCertificateChainCacheSize = 16;
+
+// A thread-safe map which, once it holds |capacity| entries, evicts the least
+// recently used one to make room for a new one.
+template <typename Value>
+class LruCache {
+  public:
+    explicit LruCache(size_t capacity) : capacity_(capacity) {}
+
+    optional<Value> get(const vector<uint8_t>& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return {};
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    void put(const vector<uint8_t>& key, Value value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            it->second->second = std::move(value);
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        entries_.emplace_front(key, std::move(value));
+        index_[key] = entries_.begin();
+        if (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+  private:
+    using Entries = std::list<pair<vector<uint8_t>, Value>>;
+
+    std::mutex mutex_;
+    size_t capacity_;
+    Entries entries_;
+    std::map<vector<uint8_t>, typename Entries::iterator> index_;
+};
+
+struct ParsedCertificate {
+    X509_Ptr x509;
+
+    // The NID of the public key algorithm and, for EC keys, the public key in
+    // uncompressed form.
+    int publicKeyAlgorithm;
+    optional<vector<uint8_t>> ecPublicKey;
+};
+
+static LruCache<shared_ptr<const ParsedCertificate>>& certificateCache() {
+    static auto* cache = new LruCache<shared_ptr<const ParsedCertificate>>(kCertificateCacheSize);
+    return *cache;
+}
+
+static LruCache<bool>& certificateChainValidationCache() {
+    static auto* cache = new LruCache<bool>(kCertificateChainCacheSize);
+    return *cache;
+}
+
+static vector<uint8_t> certificateCacheKey(const unsigned char* data, size_t size) {
+    vector<uint8_t> ret;
+    ret.resize(SHA256_DIGEST_LENGTH);
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, data, size);
+    SHA256_Final((unsigned char*)ret.data(), &ctx);
+    return ret;
+}
+
+// Returns the size of the DER-encoded element, including its header, at the
+// beginning of [p, pEnd), or nothing if it's malformed or runs past pEnd.
+static optional<size_t> derElementSize(const unsigned char* p, const unsigned char* pEnd) {
+    if (pEnd - p < 2) {
+        return {};
+    }
+    size_t headerSize = 2;
+    size_t length = p[1];
+    if (length & 0x80) {
+        size_t numLengthBytes = length & 0x7f;
+        if (numLengthBytes == 0 || numLengthBytes > 4 ||
+            static_cast<size_t>(pEnd - p) < 2 + numLengthBytes) {
+            return {};
+        }
+        length = 0;
+        for (size_t n = 0; n < numLengthBytes; n++) {
+            length = (length << 8) | p[2 + n];
+        }
+        headerSize += numLengthBytes;
+    }
+    if (static_cast<size_t>(pEnd - p) - headerSize < length) {
+        return {};
+    }
+    return headerSize + length;
+}
+
+// Returns the public key of |x509| in uncompressed form, for EC keys.
+static optional<vector<uint8_t>> x509GetEcPublicKey(X509* x509) {
+    auto pkey = EVP_PKEY_Ptr(X509_get_pubkey(x509));
+    if (pkey.get() == nullptr) {
+        LOG(ERROR) << "No public key";
+        return {};
+    }
+
+    auto ecKey = EC_KEY_Ptr(EVP_PKEY_get1_EC_KEY(pkey.get()));
+    if (ecKey.get() == nullptr) {
+        LOG(ERROR) << "Failed getting EC key";
+        return {};
+    }
+
+    auto ecGroup = EC_KEY_get0_group(ecKey.get());
+    auto ecPoint = EC_KEY_get0_public_key(ecKey.get());
+    int size = EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, nullptr, 0,
+                                  nullptr);
+    if (size == 0) {
+        LOG(ERROR) << "Error generating public key encoding";
+        return {};
+    }
+    vector<uint8_t> publicKey;
+    publicKey.resize(size);
+    EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, publicKey.data(),
+                       publicKey.size(), nullptr);
+    return publicKey;
+}
+
+// Parses the certificate at *p, advancing *p past it. The result is shared with
+// the certificate cache, so the X509 object must not be modified.
+static shared_ptr<const ParsedCertificate> parseX509CertificateCached(const unsigned char** p,
+                                                                     const unsigned char* pEnd) {
+    optional<size_t> size = derElementSize(*p, pEnd);
+    if (!size) {
+        LOG(ERROR) << "Error parsing X509 certificate";
+        return nullptr;
+    }
+    vector<uint8_t> key = certificateCacheKey(*p, size.value());
+
+    optional<shared_ptr<const ParsedCertificate>> cached = certificateCache().get(key);
+    if (cached) {
+        *p += size.value();
+        return cached.value();
+    }
+
+    const unsigned char* certificateEnd = *p + size.value();
+    auto x509 = X509_Ptr(d2i_X509(nullptr, p, size.value()));
+    if (x509 == nullptr || *p != certificateEnd) {
+        LOG(ERROR) << "Error parsing X509 certificate";
+        return nullptr;
+    }
+    auto parsed = std::make_shared<ParsedCertificate>();
+    parsed->publicKeyAlgorithm = OBJ_obj2nid(x509->cert_info->key->algor->algorithm);
+    if (parsed->publicKeyAlgorithm == NID_X9_62_id_ecPublicKey) {
+        parsed->ecPublicKey = x509GetEcPublicKey(x509.get());
+    }
+    parsed->x509 = std::move(x509);
+    certificateCache().put(key, parsed);
+    return parsed;
+}
+
+static bool parseX509CertificatesCached(const vector<uint8_t>& certificateChain,
+                                        vector<shared_ptr<const ParsedCertificate>>& certs) {
+    const unsigned char* p = certificateChain.data();
+    const unsigned char* pEnd = p + certificateChain.size();
+    certs.resize(0);
+    while (p < pEnd) {
+        shared_ptr<const ParsedCertificate> parsed = parseX509CertificateCached(&p, pEnd);
+        if (parsed == nullptr) {
+            return false;
+        }
+        certs.push_back(std::move(parsed));
+    }
+    return true;
+}
+
 vector<uint8_t> certificateChainJoin(const vector<vector<uint8_t>>& certificateChain) {
     vector<uint8_t> ret;
     for (const vector<uint8_t>& certificate : certificateChain) {
@@ -656,10 +846,9 @@ optional<vector<vector<uint8_t>>> certificateChainSplit(const vector<uint8_t>& c
     vector<vector<uint8_t>> certificates;
     while (p < pEnd) {
         size_t begin = p - pStart;
-        auto x509 = X509_Ptr(d2i_X509(nullptr, &p, pEnd - p));
+        shared_ptr<const ParsedCertificate> parsed = parseX509CertificateCached(&p, pEnd);
         size_t next = p - pStart;
-        if (x509 == nullptr) {
-            LOG(ERROR) << "Error parsing X509 certificate";
+        if (parsed == nullptr) {
             return {};
         }
         vector<uint8_t> cert =
@@ -688,9 +877,9 @@ static bool parseX509Certificates(const vector<uint8_t>& certificateChain,
 bool certificateSignedByPublicKey(const vector<uint8_t>& certificate,
                                   const vector<uint8_t>& publicKey) {
     const unsigned char* p = certificate.data();
-    auto x509 = X509_Ptr(d2i_X509(nullptr, &p, certificate.size()));
-    if (x509 == nullptr) {
-        LOG(ERROR) << "Error parsing X509 certificate";
+    shared_ptr<const ParsedCertificate> parsed =
+            parseX509CertificateCached(&p, certificate.data() + certificate.size());
+    if (parsed == nullptr) {
         return false;
     }
 
@@ -720,7 +909,7 @@ bool certificateSignedByPublicKey(const vector<uint8_t>& certificate,
         return false;
     }
 
-    if (X509_verify(x509.get(), pkey.get()) != 1) {
+    if (X509_verify(parsed->x509.get(), pkey.get()) != 1) {
         return false;
     }
 
@@ -733,10 +922,10 @@ bool certificateSignedByPublicKey(const vector<uint8_t>& certificate,
 //
 //       It would be nice to use X509_verify_cert() instead of doing our own thing.
 //
-bool certificateChainValidate(const vector<uint8_t>& certificateChain) {
-    vector<X509_Ptr> certs;
+static bool certificateChainValidateUncached(const vector<uint8_t>& certificateChain) {
+    vector<shared_ptr<const ParsedCertificate>> certs;
 
-    if (!parseX509Certificates(certificateChain, certs)) {
+    if (!parseX509CertificatesCached(certificateChain, certs)) {
         LOG(ERROR) << "Error parsing X509 certificates";
         return false;
     }
@@ -746,10 +935,10 @@ bool certificateChainValidate(const vector<uint8_t>& certificateChain) {
     }
 
     for (size_t n = 1; n < certs.size(); n++) {
-        const X509_Ptr& keyCert = certs[n - 1];
-        const X509_Ptr& signingCert = certs[n];
-        EVP_PKEY_Ptr signingPubkey(X509_get_pubkey(signingCert.get()));
-        if (X509_verify(keyCert.get(), signingPubkey.get()) != 1) {
+        X509* keyCert = certs[n - 1]->x509.get();
+        X509* signingCert = certs[n]->x509.get();
+        EVP_PKEY_Ptr signingPubkey(X509_get_pubkey(signingCert));
+        if (X509_verify(keyCert, signingPubkey.get()) != 1) {
             LOG(ERROR) << "Error validating cert at index " << n - 1
                        << " is signed by its successor";
             return false;
@@ -759,6 +948,23 @@ bool certificateChainValidate(const vector<uint8_t>& certificateChain) {
     return true;
 }
 
+bool certificateChainValidate(const vector<uint8_t>& certificateChain) {
+    // The checks only depend on the bytes of the chain, so the result can be
+    // reused when the same chain is presented again.
+    vector<uint8_t> key = certificateCacheKey(certificateChain.data(), certificateChain.size());
+    optional<bool> cached = certificateChainValidationCache().get(key);
+    if (cached) {
+        if (!cached.value()) {
+            LOG(ERROR) << "Certificate chain previously failed validation";
+        }
+        return cached.value();
+    }
+
+    bool valid = certificateChainValidateUncached(certificateChain);
+    certificateChainValidationCache().put(key, valid);
+    return valid;
+}
+
 bool checkEcDsaSignature(const vector<uint8_t>& digest, const vector<uint8_t>& signature,
                          const vector<uint8_t>& publicKey) {
     const unsigned char* p = (unsigned char*)signature.data();
@@ -870,6 +1076,60 @@ optional<vector<uint8_t>> hmacSha256(const vector<uint8_t>& key, const vector<ui
     return hmac;
 }
 
+struct HmacSha256Stream::Context {
+    Context() { HMAC_CTX_init(&ctx); }
+    ~Context() { HMAC_CTX_cleanup(&ctx); }
+
+    HMAC_CTX ctx;
+};
+
+HmacSha256Stream::HmacSha256Stream() {}
+
+HmacSha256Stream::~HmacSha256Stream() {}
+
+bool HmacSha256Stream::init(const vector<uint8_t>& key) {
+    context_ = std::make_unique<Context>();
+    if (HMAC_Init_ex(&context_->ctx, key.data(), key.size(), EVP_sha256(), nullptr /* impl */) !=
+        1) {
+        LOG(ERROR) << "Error initializing HMAC_CTX";
+        context_.reset();
+        return false;
+    }
+    return true;
+}
+
+bool HmacSha256Stream::update(const uint8_t* data, size_t size) {
+    if (!context_) {
+        LOG(ERROR) << "HMAC calculation not started";
+        return false;
+    }
+    if (HMAC_Update(&context_->ctx, data, size) != 1) {
+        LOG(ERROR) << "Error updating HMAC_CTX";
+        return false;
+    }
+    return true;
+}
+
+optional<vector<uint8_t>> HmacSha256Stream::finish() {
+    if (!context_) {
+        LOG(ERROR) << "HMAC calculation not started";
+        return {};
+    }
+    std::unique_ptr<Context> context = std::move(context_);
+    vector<uint8_t> hmac;
+    hmac.resize(32);
+    unsigned int size = 0;
+    if (HMAC_Final(&context->ctx, hmac.data(), &size) != 1) {
+        LOG(ERROR) << "Error finalizing HMAC_CTX";
+        return {};
+    }
+    if (size != 32) {
+        LOG(ERROR) << "Expected 32 bytes from HMAC_Final, got " << size;
+        return {};
+    }
+    return hmac;
+}
+
 // Generates the attestation certificate with the parameters passed in.  Note
 // that the passed in |activeTimeMilliSeconds| |expireTimeMilliSeconds| are in
 // milli seconds since epoch.  We are setting them to milliseconds due to
@@ -1527,8 +1787,8 @@ tuple<bool, vector<uint8_t>, vector<uint8_t>> ecPublicKeyGetXandY(
 }
 
 optional<vector<uint8_t>> certificateChainGetTopMostKey(const vector<uint8_t>& certificateChain) {
-    vector<X509_Ptr> certs;
-    if (!parseX509Certificates(certificateChain, certs)) {
+    vector<shared_ptr<const ParsedCertificate>> certs;
+    if (!parseX509CertificatesCached(certificateChain, certs)) {
         return {};
     }
     if (certs.size() < 1) {
@@ -1536,42 +1796,17 @@ optional<vector<uint8_t>> certificateChainGetTopMostKey(const vector<uint8_t>& c
         return {};
     }
 
-    int algoId = OBJ_obj2nid(certs[0]->cert_info->key->algor->algorithm);
+    int algoId = certs[0]->publicKeyAlgorithm;
     if (algoId != NID_X9_62_id_ecPublicKey) {
         LOG(ERROR) << "Expected NID_X9_62_id_ecPublicKey, got " << OBJ_nid2ln(algoId);
         return {};
     }
-
-    auto pkey = EVP_PKEY_Ptr(X509_get_pubkey(certs[0].get()));
-    if (pkey.get() == nullptr) {
-        LOG(ERROR) << "No public key";
-        return {};
-    }
-
-    auto ecKey = EC_KEY_Ptr(EVP_PKEY_get1_EC_KEY(pkey.get()));
-    if (ecKey.get() == nullptr) {
-        LOG(ERROR) << "Failed getting EC key";
-        return {};
-    }
-
-    auto ecGroup = EC_KEY_get0_group(ecKey.get());
-    auto ecPoint = EC_KEY_get0_public_key(ecKey.get());
-    int size = EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, nullptr, 0,
-                                  nullptr);
-    if (size == 0) {
-        LOG(ERROR) << "Error generating public key encoding";
-        return {};
-    }
-    vector<uint8_t> publicKey;
-    publicKey.resize(size);
-    EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, publicKey.data(),
-                       publicKey.size(), nullptr);
-    return publicKey;
+    return certs[0]->ecPublicKey;
 }
 
 optional<pair<size_t, size_t>> certificateFindPublicKey(const vector<uint8_t>& x509Certificate) {
-    vector<X509_Ptr> certs;
-    if (!parseX509Certificates(x509Certificate, certs)) {
+    vector<shared_ptr<const ParsedCertificate>> certs;
+    if (!parseX509CertificatesCached(x509Certificate, certs)) {
         return {};
     }
     if (certs.size() < 1) {
@@ -1579,35 +1814,18 @@ optional<pair<size_t, size_t>> certificateFindPublicKey(const vector<uint8_t>& x
         return {};
     }
 
-    auto pkey = EVP_PKEY_Ptr(X509_get_pubkey(certs[0].get()));
-    if (pkey.get() == nullptr) {
-        LOG(ERROR) << "No public key";
-        return {};
-    }
-
-    auto ecKey = EC_KEY_Ptr(EVP_PKEY_get1_EC_KEY(pkey.get()));
-    if (ecKey.get() == nullptr) {
-        LOG(ERROR) << "Failed getting EC key";
-        return {};
-    }
-
-    auto ecGroup = EC_KEY_get0_group(ecKey.get());
-    auto ecPoint = EC_KEY_get0_public_key(ecKey.get());
-    int size = EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, nullptr, 0,
-                                  nullptr);
-    if (size == 0) {
-        LOG(ERROR) << "Error generating public key encoding";
-        return {};
+    optional<vector<uint8_t>> publicKey = certs[0]->ecPublicKey;
+    if (!publicKey) {
+        publicKey = x509GetEcPublicKey(certs[0]->x509.get());
+        if (!publicKey) {
+            return {};
+        }
     }
-    vector<uint8_t> publicKey;
-    publicKey.resize(size);
-    EC_POINT_point2oct(ecGroup, ecPoint, POINT_CONVERSION_UNCOMPRESSED, publicKey.data(),
-                       publicKey.size(), nullptr);
 
     size_t publicKeyOffset = 0;
-    size_t publicKeySize = (size_t)size;
+    size_t publicKeySize = publicKey.value().size();
     void* location = memmem((const void*)x509Certificate.data(), x509Certificate.size(),
-                            (const void*)publicKey.data(), publicKey.size());
+                            (const void*)publicKey.value().data(), publicKey.value().size());
 
     if (location == NULL) {
         LOG(ERROR) << "Error finding publicKey from x509Certificate";
@@ -1687,27 +1905,43 @@ optional<pair<size_t, size_t>> certificateFindSignature(const vector<uint8_t>& x
 // COSE Utility Functions
 // ---------------------------------------------------------------------------
 
-vector<uint8_t> coseBuildToBeSigned(const vector<uint8_t>& encodedProtectedHeaders,
-                                    const vector<uint8_t>& data,
-                                    const vector<uint8_t>& detachedContent) {
-    cppbor::Array sigStructure;
-    sigStructure.add("Signature1");
-    sigStructure.add(encodedProtectedHeaders);
+// Returns a ViewBstr referring to |bytes|, so that adding it to an Array or Map doesn't copy the
+// bytes.  The vector must outlive the item.
+static cppbor::ViewBstr bstrView(const vector<uint8_t>& bytes) {
+    return cppbor::ViewBstr(bytes.data(), bytes.data() + bytes.size());
+}
+
+// Builds the Sig_structure (RFC 8152 section 4.4) or MAC_structure (RFC 8152 section 6.3) for the
+// given context.  All byte strings are referenced rather than copied, so the payload is copied
+// exactly once, into the single allocation made for the result.
+static vector<uint8_t> coseBuildToBeAuthenticated(const char* context,
+                                                  const vector<uint8_t>& encodedProtectedHeaders,
+                                                  const vector<uint8_t>& data,
+                                                  const vector<uint8_t>& detachedContent) {
+    cppbor::Array structure;
+    structure.add(cppbor::ViewTstr(context));
+    structure.add(bstrView(encodedProtectedHeaders));
 
     // We currently don't support Externally Supplied Data (RFC 8152 section 4.3)
     // so external_aad is the empty bstr
-    vector<uint8_t> emptyExternalAad;
-    sigStructure.add(emptyExternalAad);
+    structure.add(cppbor::ViewBstr(std::basic_string_view<uint8_t>()));
 
     // Next field is the payload, independently of how it's transported (RFC
     // 8152 section 4.4). Since our API specifies only one of |data| and
     // |detachedContent| can be non-empty, it's simply just the non-empty one.
     if (data.size() > 0) {
-        sigStructure.add(data);
+        structure.add(bstrView(data));
     } else {
-        sigStructure.add(detachedContent);
+        structure.add(bstrView(detachedContent));
     }
-    return sigStructure.encode();
+    return structure.encode();
+}
+
+vector<uint8_t> coseBuildToBeSigned(const vector<uint8_t>& encodedProtectedHeaders,
+                                    const vector<uint8_t>& data,
+                                    const vector<uint8_t>& detachedContent) {
+    return coseBuildToBeAuthenticated("Signature1", encodedProtectedHeaders, data,
+                                      detachedContent);
 }
 
 vector<uint8_t> coseEncodeHeaders(const cppbor::Map& protectedHeaders) {
@@ -1814,15 +2048,15 @@ optional<vector<uint8_t>> coseSignEcDsaWithSignature(const vector<uint8_t>& sign
     vector<uint8_t> encodedProtectedHeaders = coseEncodeHeaders(protectedHeaders);
 
     cppbor::Array coseSign1;
-    coseSign1.add(encodedProtectedHeaders);
+    coseSign1.add(bstrView(encodedProtectedHeaders));
     coseSign1.add(std::move(unprotectedHeaders));
     if (data.size() == 0) {
         cppbor::Null nullValue;
         coseSign1.add(std::move(nullValue));
     } else {
-        coseSign1.add(data);
+        coseSign1.add(bstrView(data));
     }
-    coseSign1.add(signatureToBeSigned);
+    coseSign1.add(bstrView(signatureToBeSigned));
     vector<uint8_t> signatureCoseSign1;
     signatureCoseSign1 = coseSign1.encode();
 
@@ -1875,15 +2109,15 @@ optional<vector<uint8_t>> coseSignEcDsa(const vector<uint8_t>& key, const vector
     }
 
     cppbor::Array coseSign1;
-    coseSign1.add(encodedProtectedHeaders);
+    coseSign1.add(bstrView(encodedProtectedHeaders));
     coseSign1.add(std::move(unprotectedHeaders));
     if (data.size() == 0) {
         cppbor::Null nullValue;
         coseSign1.add(std::move(nullValue));
     } else {
-        coseSign1.add(data);
+        coseSign1.add(bstrView(data));
     }
-    coseSign1.add(coseSignature);
+    coseSign1.add(bstrView(coseSignature));
     vector<uint8_t> signatureCoseSign1;
     signatureCoseSign1 = coseSign1.encode();
     return signatureCoseSign1;
@@ -2143,25 +2377,22 @@ optional<vector<uint8_t>> coseSignGetX5Chain(const vector<uint8_t>& signatureCos
 vector<uint8_t> coseBuildToBeMACed(const vector<uint8_t>& encodedProtectedHeaders,
                                    const vector<uint8_t>& data,
                                    const vector<uint8_t>& detachedContent) {
-    cppbor::Array macStructure;
-    macStructure.add("MAC0");
-    macStructure.add(encodedProtectedHeaders);
-
-    // We currently don't support Externally Supplied Data (RFC 8152 section 4.3)
-    // so external_aad is the empty bstr
-    vector<uint8_t> emptyExternalAad;
-    macStructure.add(emptyExternalAad);
+    return coseBuildToBeAuthenticated("MAC0", encodedProtectedHeaders, data, detachedContent);
+}
 
-    // Next field is the payload, independently of how it's transported (RFC
-    // 8152 section 4.4). Since our API specifies only one of |data| and
-    // |detachedContent| can be non-empty, it's simply just the non-empty one.
-    if (data.size() > 0) {
-        macStructure.add(data);
-    } else {
-        macStructure.add(detachedContent);
-    }
+vector<uint8_t> coseBuildToBeMACedPrefix(size_t detachedContentSize) {
+    cppbor::Map protectedHeaders;
+    protectedHeaders.add(COSE_LABEL_ALG, COSE_ALG_HMAC_256_256);
+    vector<uint8_t> encodedProtectedHeaders = coseEncodeHeaders(protectedHeaders);
 
-    return macStructure.encode();
+    // This must match coseBuildToBeMACed() up to the start of the payload.
+    vector<uint8_t> prefix;
+    cppbor::encodeHeader(cppbor::ARRAY, 4, std::back_inserter(prefix));
+    cppbor::Tstr("MAC0").encodeAppend(&prefix);
+    bstrView(encodedProtectedHeaders).encodeAppend(&prefix);
+    cppbor::encodeHeader(cppbor::BSTR, 0, std::back_inserter(prefix));  // external_aad
+    cppbor::encodeHeader(cppbor::BSTR, detachedContentSize, std::back_inserter(prefix));
+    return prefix;
 }
 
 optional<vector<uint8_t>> coseMac0(const vector<uint8_t>& key, const vector<uint8_t>& data,
@@ -2186,15 +2417,15 @@ optional<vector<uint8_t>> coseMac0(const vector<uint8_t>& key, const vector<uint
     }
 
     cppbor::Array array;
-    array.add(encodedProtectedHeaders);
+    array.add(bstrView(encodedProtectedHeaders));
     array.add(std::move(unprotectedHeaders));
     if (data.size() == 0) {
         cppbor::Null nullValue;
         array.add(std::move(nullValue));
     } else {
-        array.add(data);
+        array.add(bstrView(data));
     }
-    array.add(mac.value());
+    array.add(bstrView(mac.value()));
     return array.encode();
 }
 
@@ -2208,15 +2439,15 @@ optional<vector<uint8_t>> coseMacWithDigest(const vector<uint8_t>& digestToBeMac
     vector<uint8_t> encodedProtectedHeaders = coseEncodeHeaders(protectedHeaders);
 
     cppbor::Array array;
-    array.add(encodedProtectedHeaders);
+    array.add(bstrView(encodedProtectedHeaders));
     array.add(std::move(unprotectedHeaders));
     if (data.size() == 0) {
         cppbor::Null nullValue;
         array.add(std::move(nullValue));
     } else {
-        array.add(data);
+        array.add(bstrView(data));
     }
-    array.add(digestToBeMaced);
+    array.add(bstrView(digestToBeMaced));
     return array.encode();
 }
 
@@ -41,6 +41,24 @@ void writeBigEndian(T value, std::function<void(uint8_t)>& cb) {
     }
 }
 
+// Returns the content of a Bstr or ViewBstr, so that owned and view strings compare equal.
+std::basic_string_view<uint8_t> bstrView(const Item& item) {
+    if (auto bstr = item.asBstr(); bstr) {
+        return {bstr->value().data(), bstr->value().size()};
+    }
+    CHECK(item.asViewBstr());
+    return item.asViewBstr()->view();
+}
+
+// Returns the content of a Tstr or ViewTstr, so that owned and view strings compare equal.
+std::string_view tstrView(const Item& item) {
+    if (auto tstr = item.asTstr(); tstr) {
+        return tstr->value();
+    }
+    CHECK(item.asViewTstr());
+    return item.asViewTstr()->view();
+}
+
 }  // namespace
 
 size_t headerSize(uint64_t addlInfo) {
@@ -112,9 +130,9 @@ bool Item::operator==(const Item& other) const& {
         case NINT:
             return *asNint() == *(other.asNint());
         case BSTR:
-            return *asBstr() == *(other.asBstr());
+            return bstrView(*this) == bstrView(other);
         case TSTR:
-            return *asTstr() == *(other.asTstr());
+            return tstrView(*this) == tstrView(other);
         case ARRAY:
             return *asArray() == *(other.asArray());
         case MAP:
@@ -171,6 +189,30 @@ void Tstr::encodeValue(EncodeCallback encodeCallback) const {
     }
 }
 
+uint8_t* ViewBstr::encode(uint8_t* pos, const uint8_t* end) const {
+    pos = encodeHeader(mView.size(), pos, end);
+    if (!pos || end - pos < static_cast<ptrdiff_t>(mView.size())) return nullptr;
+    return std::copy(mView.begin(), mView.end(), pos);
+}
+
+void ViewBstr::encodeValue(EncodeCallback encodeCallback) const {
+    for (auto c : mView) {
+        encodeCallback(c);
+    }
+}
+
+uint8_t* ViewTstr::encode(uint8_t* pos, const uint8_t* end) const {
+    pos = encodeHeader(mView.size(), pos, end);
+    if (!pos || end - pos < static_cast<ptrdiff_t>(mView.size())) return nullptr;
+    return std::copy(mView.begin(), mView.end(), pos);
+}
+
+void ViewTstr::encodeValue(EncodeCallback encodeCallback) const {
+    for (auto c : mView) {
+        encodeCallback(static_cast<uint8_t>(c));
+    }
+}
+
 bool CompoundItem::operator==(const CompoundItem& other) const& {
     return type() == other.type()             //
            && addlInfo() == other.addlInfo()  //
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <android/hardware/identity/support/IdentityCredentialSupport.h>
+
+using std::optional;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace hardware {
+namespace identity {
+namespace {
+
+// Number of access control profiles checked against the reader on each presentation.
+constexpr size_t kNumProfiles = 4;
+
+struct Reader {
+    // Leaf, intermediate and root certificate, in that order.
+    vector<uint8_t> certificateChain;
+    // The reader certificate an access control profile would hold.
+    vector<uint8_t> profileCertificate;
+};
+
+optional<Reader> makeReader(size_t id) {
+    vector<vector<uint8_t>> privateKeys;
+    vector<vector<uint8_t>> publicKeys;
+    for (int n = 0; n < 3; n++) {
+        optional<vector<uint8_t>> keyPair = support::createEcKeyPair();
+        if (!keyPair) {
+            return {};
+        }
+        optional<vector<uint8_t>> privateKey = support::ecKeyPairGetPrivateKey(keyPair.value());
+        optional<vector<uint8_t>> publicKey = support::ecKeyPairGetPublicKey(keyPair.value());
+        if (!privateKey || !publicKey) {
+            return {};
+        }
+        privateKeys.push_back(privateKey.value());
+        publicKeys.push_back(publicKey.value());
+    }
+
+    const string prefix = "reader" + std::to_string(id);
+    const vector<string> names = {prefix + "Leaf", prefix + "Intermediate", prefix + "Root"};
+    vector<vector<uint8_t>> certificates;
+    for (size_t n = 0; n < 3; n++) {
+        // Each certificate is signed by its successor, the root by itself.
+        size_t issuer = std::min(n + 1, size_t(2));
+        optional<vector<uint8_t>> certificate = support::ecPublicKeyGenerateCertificate(
+                publicKeys[n], privateKeys[issuer], "0001", names[issuer], names[n], 0, 0);
+        if (!certificate) {
+            return {};
+        }
+        certificates.push_back(certificate.value());
+    }
+    return Reader{support::certificateChainJoin(certificates), certificates[0]};
+}
+
+// Does the certificate work of a presentation by |reader|: the chain from the reader signature is
+// validated and its top-most key extracted, then IdentityCredential's checkReaderAuthentication()
+// matches it against each access control profile.
+bool presentation(const Reader& reader) {
+    if (!support::certificateChainValidate(reader.certificateChain) ||
+        !support::certificateChainGetTopMostKey(reader.certificateChain)) {
+        return false;
+    }
+    for (size_t n = 0; n < kNumProfiles; n++) {
+        optional<vector<uint8_t>> profileKey =
+                support::certificateChainGetTopMostKey(reader.profileCertificate);
+        optional<vector<vector<uint8_t>>> certificates =
+                support::certificateChainSplit(reader.certificateChain);
+        if (!profileKey || !certificates) {
+            return false;
+        }
+        bool found = false;
+        for (const vector<uint8_t>& certificate : certificates.value()) {
+            optional<vector<uint8_t>> key = support::certificateChainGetTopMostKey(certificate);
+            if (!key) {
+                return false;
+            }
+            if (key.value() == profileKey.value()) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Presentations cycling through state.range(0) readers. With a single reader every presentation
+// after the first is served from the certificate caches. With more readers than the caches hold,
+// each presentation parses and verifies its chain again, and the caches only help across the
+// profile checks within the presentation.
+void BM_Presentation(benchmark::State& state) {
+    vector<Reader> readers;
+    for (int64_t n = 0; n < state.range(0); n++) {
+        optional<Reader> reader = makeReader(n);
+        if (!reader) {
+            state.SkipWithError("failed to create reader certificates");
+            return;
+        }
+        readers.push_back(std::move(reader.value()));
+    }
+
+    size_t next = 0;
+    for (auto _ : state) {
+        if (!presentation(readers[next])) {
+            state.SkipWithError("presentation failed");
+            return;
+        }
+        next = (next + 1) % readers.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Presentation)->Arg(1)->Arg(64);
+
+}  // namespace
+}  // namespace identity
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -370,6 +371,64 @@ TEST(IdentityCredentialSupport, CertificateChain) {
     ASSERT_EQ(certs2, splitCerts2.value());
 }
 
+TEST(IdentityCredentialSupport, CertificateChainRepeatedLookups) {
+    optional<vector<uint8_t>> keyPair = support::createEcKeyPair();
+    ASSERT_TRUE(keyPair);
+    optional<vector<uint8_t>> privKey = support::ecKeyPairGetPrivateKey(keyPair.value());
+    ASSERT_TRUE(privKey);
+    optional<vector<uint8_t>> pubKey = support::ecKeyPairGetPublicKey(keyPair.value());
+    ASSERT_TRUE(pubKey);
+    optional<vector<uint8_t>> rootKeyPair = support::createEcKeyPair();
+    ASSERT_TRUE(rootKeyPair);
+    optional<vector<uint8_t>> rootPrivKey = support::ecKeyPairGetPrivateKey(rootKeyPair.value());
+    ASSERT_TRUE(rootPrivKey);
+    optional<vector<uint8_t>> rootPubKey = support::ecKeyPairGetPublicKey(rootKeyPair.value());
+    ASSERT_TRUE(rootPubKey);
+
+    optional<vector<uint8_t>> cert = support::ecPublicKeyGenerateCertificate(
+            pubKey.value(), rootPrivKey.value(), "0001", "someIssuer", "someSubject", 0, 0);
+    ASSERT_TRUE(cert);
+    optional<vector<uint8_t>> rootCert = support::ecPublicKeyGenerateCertificate(
+            rootPubKey.value(), rootPrivKey.value(), "0001", "someIssuer", "someIssuer", 0, 0);
+    ASSERT_TRUE(rootCert);
+    vector<uint8_t> certChain = support::certificateChainJoin({cert.value(), rootCert.value()});
+
+    // Parsed certificates and validation results are cached, so do everything
+    // twice and check that the second round gives the same answers.
+    for (int n = 0; n < 2; n++) {
+        EXPECT_TRUE(support::certificateChainValidate(certChain));
+        optional<vector<uint8_t>> extractedPubKey =
+                support::certificateChainGetTopMostKey(certChain);
+        ASSERT_TRUE(extractedPubKey);
+        EXPECT_EQ(pubKey.value(), extractedPubKey.value());
+        optional<vector<vector<uint8_t>>> splitCerts = support::certificateChainSplit(certChain);
+        ASSERT_TRUE(splitCerts);
+        EXPECT_EQ(vector<vector<uint8_t>>({cert.value(), rootCert.value()}), splitCerts.value());
+        optional<std::pair<size_t, size_t>> pubKeyLocation =
+                support::certificateFindPublicKey(cert.value());
+        ASSERT_TRUE(pubKeyLocation);
+        EXPECT_EQ(pubKey.value().size(), pubKeyLocation.value().second);
+        EXPECT_TRUE(support::certificateSignedByPublicKey(cert.value(), rootPubKey.value()));
+        EXPECT_FALSE(support::certificateSignedByPublicKey(cert.value(), pubKey.value()));
+    }
+
+    // A chain in the wrong order shares its certificates with the one above
+    // but must not share its validation result.
+    vector<uint8_t> reversedChain = support::certificateChainJoin({rootCert.value(), cert.value()});
+    for (int n = 0; n < 2; n++) {
+        EXPECT_FALSE(support::certificateChainValidate(reversedChain));
+        optional<vector<uint8_t>> extractedPubKey =
+                support::certificateChainGetTopMostKey(reversedChain);
+        ASSERT_TRUE(extractedPubKey);
+        EXPECT_EQ(rootPubKey.value(), extractedPubKey.value());
+    }
+
+    // A truncated chain must not be split or validated.
+    vector<uint8_t> truncatedChain(certChain.begin(), certChain.end() - 1);
+    EXPECT_FALSE(support::certificateChainSplit(truncatedChain));
+    EXPECT_FALSE(support::certificateChainValidate(truncatedChain));
+}
+
 vector<uint8_t> strToVec(const string& str) {
     vector<uint8_t> ret;
     size_t size = str.size();
@@ -436,6 +495,40 @@ TEST(IdentityCredentialSupport, CoseMac0DetachedContent) {
             support::cborPrettyPrint(mac.value()));
 }
 
+// Streaming the detached content through HmacSha256Stream after the prefix from
+// coseBuildToBeMACedPrefix() must give exactly what coseMac0() gives. The sizes
+// cover every length encoding of the bstr header.
+TEST(IdentityCredentialSupport, CoseMacWithDigestMatchesCoseMac0) {
+    vector<uint8_t> key = strToVec("0123456789abcdef0123456789abcdef");
+    for (size_t size : {0, 4, 23, 24, 255, 256, 1000, 65535, 65536, 300000}) {
+        vector<uint8_t> detachedContent(size);
+        for (size_t n = 0; n < size; n++) {
+            detachedContent[n] = static_cast<uint8_t>(n * 7 + (n >> 8));
+        }
+
+        optional<vector<uint8_t>> expected = support::coseMac0(key, {}, detachedContent);
+        ASSERT_TRUE(expected);
+
+        // Feed the content in uneven chunks, as retrieved entries would be.
+        for (size_t chunkSize : {1, 17, 4096}) {
+            support::HmacSha256Stream stream;
+            ASSERT_TRUE(stream.init(key));
+            ASSERT_TRUE(stream.update(support::coseBuildToBeMACedPrefix(size)));
+            for (size_t offset = 0; offset < size; offset += chunkSize) {
+                ASSERT_TRUE(stream.update(detachedContent.data() + offset,
+                                          std::min(chunkSize, size - offset)));
+            }
+            optional<vector<uint8_t>> digest = stream.finish();
+            ASSERT_TRUE(digest);
+
+            optional<vector<uint8_t>> mac = support::coseMacWithDigest(digest.value(), {});
+            ASSERT_TRUE(mac);
+            EXPECT_EQ(expected.value(), mac.value())
+                    << "content size " << size << ", chunk size " << chunkSize;
+        }
+    }
+}
+
 }  // namespace identity
 }  // namespace hardware
 }  // namespace android
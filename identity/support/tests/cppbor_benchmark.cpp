@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "cppbor.h"
+#include "cppbor_parse.h"
+
+using namespace cppbor;
+
+namespace {
+
+// Returns the encoding of a credential laid out like the issuer-signed data elements of a driving
+// license: small data elements, each with its digest id and random salt, \p privileges nested
+// driving privileges and a portrait of \p portraitSize bytes, which makes up most of the size.
+std::vector<uint8_t> makeCredential(size_t privileges, size_t portraitSize) {
+    Array elements;
+    auto addElement = [&elements](const std::string& identifier, auto&& value) {
+        elements.add(Map("digestID", elements.size(), "random",
+                         Bstr(std::vector<uint8_t>(16, elements.size())), "elementIdentifier",
+                         identifier, "elementValue", std::move(value)));
+    };
+    addElement("family_name", "Mustermann");
+    addElement("given_name", "Erika");
+    addElement("birth_date", "1971-09-01");
+    addElement("issue_date", "2018-08-09");
+    addElement("expiry_date", "2024-10-20");
+    addElement("issuing_country", "US");
+    addElement("issuing_authority", "Google");
+    addElement("document_number", "987654321");
+    addElement("portrait", Bstr(std::vector<uint8_t>(portraitSize, 0x5a)));
+    for (size_t i = 0; i < privileges; ++i) {
+        addElement("driving_privilege_" + std::to_string(i),
+                   Map("vehicle_category_code", std::string(1, 'A' + i % 26), "issue_date",
+                       "2018-08-09", "expiry_date", "2024-10-20"));
+    }
+    return Map("docType", "org.iso.18013.5.1.mDL", "nameSpaces",
+               Map("org.iso.18013.5.1", std::move(elements)))
+            .encode();
+}
+
+// Visits every item and adds up the sizes of the strings, which is what a reader does when it
+// looks for the requested data elements.
+size_t traverse(const Item& item) {
+    if (auto bstr = item.asBstr()) return bstr->value().size();
+    if (auto bstr = item.asViewBstr()) return bstr->view().size();
+    if (auto tstr = item.asTstr()) return tstr->value().size();
+    if (auto tstr = item.asViewTstr()) return tstr->view().size();
+    size_t size = 0;
+    if (auto array = item.asArray()) {
+        for (size_t i = 0; i < array->size(); ++i) size += traverse(*(*array)[i]);
+    } else if (auto map = item.asMap()) {
+        for (size_t i = 0; i < map->size(); ++i) {
+            size += traverse(*(*map)[i].first) + traverse(*(*map)[i].second);
+        }
+    } else if (auto semantic = item.asSemantic()) {
+        size += traverse(*semantic->child());
+    }
+    return size;
+}
+
+// Credentials are passed as (driving privileges, portrait size in KB) arguments: one of about 100 KB
+// with many small items, and one that is mostly a large portrait.
+void credentialSizes(benchmark::internal::Benchmark* benchmark) {
+    benchmark->Args({24, 96})->Args({0, 512});
+}
+
+template <typename Parse>
+void parseAndTraverse(benchmark::State& state, Parse parseFn) {
+    std::vector<uint8_t> encoding = makeCredential(state.range(0), state.range(1) * 1024);
+    for (auto _ : state) {
+        auto [item, pos, message] = parseFn(encoding.data(), encoding.data() + encoding.size());
+        if (!item) {
+            state.SkipWithError(message.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(traverse(*item));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * encoding.size());
+}
+
+void BM_Parse(benchmark::State& state) {
+    parseAndTraverse(state, [](const uint8_t* begin, const uint8_t* end) {
+        return parse(begin, end);
+    });
+}
+BENCHMARK(BM_Parse)->Apply(credentialSizes);
+
+void BM_ParseWithViews(benchmark::State& state) {
+    parseAndTraverse(state, [](const uint8_t* begin, const uint8_t* end) {
+        return parseWithViews(begin, end);
+    });
+}
+BENCHMARK(BM_ParseWithViews)->Apply(credentialSizes);
+
+}  // namespace
+
+BENCHMARK_MAIN();
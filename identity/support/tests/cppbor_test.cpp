@@ -408,6 +408,33 @@ TEST(EncodingMethodsTest, AllVariants) {
     map.encode([&](uint8_t c) { EXPECT_EQ(c, *iter++); });
 }
 
+TEST(EncodingMethodsTest, EncodeAppend) {
+    Array val("a", 5, -100);
+
+    vector<uint8_t> buf = {0xAA, 0xBB};
+    EXPECT_TRUE(val.encodeAppend(&buf));
+    ASSERT_EQ(2 + val.encodedSize(), buf.size());
+    EXPECT_EQ(0xAA, buf[0]);
+    EXPECT_EQ(0xBB, buf[1]);
+    EXPECT_EQ(val.encode(), vector<uint8_t>(buf.begin() + 2, buf.end()));
+    EXPECT_EQ(val.toString(), string(buf.begin() + 2, buf.end()));
+}
+
+TEST(EncodingMethodsTest, EncodeFailureIsReported) {
+    // An item whose encodedSize() is larger than what it actually encodes.
+    class ShortItem : public Uint {
+      public:
+        ShortItem() : Uint(1) {}
+        size_t encodedSize() const override { return Uint::encodedSize() + 1; }
+    };
+    ShortItem item;
+    EXPECT_TRUE(item.encode().empty());
+    EXPECT_TRUE(item.toString().empty());
+    vector<uint8_t> buf = {0xAA};
+    EXPECT_FALSE(item.encodeAppend(&buf));
+    EXPECT_EQ(vector<uint8_t>{0xAA}, buf);
+}
+
 TEST(EncodingMethodsTest, UintWithTooShortBuf) {
     Uint val(100000);
     vector<uint8_t> buf(val.encodedSize() - 1);
@@ -505,6 +532,24 @@ TEST(EqualityTest, Bstr) {
     EXPECT_NE(val, Map(99, 1));
 }
 
+TEST(EqualityTest, ViewStrings) {
+    // Owned and view strings with the same content are equal when compared as Items.
+    const Item& tstr = Tstr("hello");
+    const Item& viewTstr = ViewTstr("hello"sv);
+    EXPECT_EQ(tstr, viewTstr);
+    EXPECT_EQ(viewTstr, tstr);
+    EXPECT_NE(viewTstr, ViewTstr("hellO"sv));
+    EXPECT_NE(viewTstr, Bstr("hello"));
+
+    vector<uint8_t> bytes = {0x00, 0x01, 0x02};
+    const Item& bstr = Bstr(bytes);
+    const Item& viewBstr = ViewBstr(bytes.data(), bytes.data() + bytes.size());
+    EXPECT_EQ(bstr, viewBstr);
+    EXPECT_EQ(viewBstr, bstr);
+    EXPECT_NE(viewBstr, ViewBstr(bytes.data(), bytes.data() + 2));
+    EXPECT_NE(viewBstr, Tstr("\x00\x01\x02"s));
+}
+
 TEST(EqualityTest, Bool) {
     Bool val(false);
     EXPECT_EQ(val, Bool(false));
@@ -1007,6 +1052,79 @@ TEST(FullParserTest, MapWithTruncatedEntry) {
     EXPECT_EQ(encoding.data() + 3, pos);
     EXPECT_EQ("Need 4 byte(s) for length field, have 3.", message);
 }
+
+TEST(FullParserTest, ViewTstr) {
+    auto encoding = Tstr("Hello").encode();
+
+    auto [item, pos, message] = parseWithViews(encoding);
+    ASSERT_THAT(item, NotNull());
+    EXPECT_EQ(nullptr, item->asTstr());
+    ASSERT_NE(nullptr, item->asViewTstr());
+    EXPECT_EQ("Hello"sv, item->asViewTstr()->view());
+    // The view refers into the encoding rather than to a copy of it.
+    EXPECT_EQ(reinterpret_cast<const char*>(encoding.data() + 1),
+              item->asViewTstr()->view().data());
+    EXPECT_EQ(encoding, item->encode());
+}
+
+TEST(FullParserTest, ViewBstr) {
+    auto encoding = Bstr("\x00\x01\x02"s).encode();
+
+    auto [item, pos, message] = parseWithViews(encoding);
+    ASSERT_THAT(item, NotNull());
+    EXPECT_EQ(nullptr, item->asBstr());
+    ASSERT_NE(nullptr, item->asViewBstr());
+    EXPECT_EQ(3U, item->asViewBstr()->view().size());
+    EXPECT_EQ(encoding.data() + 1, item->asViewBstr()->view().data());
+    EXPECT_EQ(encoding, item->encode());
+}
+
+TEST(FullParserTest, ComplexWithViews) {
+    vector<uint8_t> vec = {0x01, 0x02, 0x08, 0x03};
+    Map val("Outer1",
+            Array(Map("Inner1", 99,  //
+                      "Inner2", vec),
+                  "foo"),
+            "Outer2", 10);
+
+    auto encoding = val.encode();
+    auto [item, pos, message] = parseWithViews(encoding);
+    EXPECT_THAT(item, MatchesItem(ByRef(val)));
+    EXPECT_EQ(encoding.data() + encoding.size(), pos);
+    EXPECT_EQ("", message);
+
+    // Lookups by key work against view keys.
+    ASSERT_NE(nullptr, item->asMap());
+    unique_ptr<Item> copy = item->clone();
+    auto [outer2, found] = static_cast<Map*>(copy.get())->get("Outer2");
+    ASSERT_TRUE(found);
+    EXPECT_EQ(10, outer2->asInt()->value());
+}
+
+TEST(FullParserTest, IncompleteStringWithViews) {
+    Tstr val("hello");
+
+    auto encoding = val.encode();
+    auto [item, pos, message] = parseWithViews(encoding.data(), encoding.size() - 2);
+    EXPECT_EQ(nullptr, item.get());
+    EXPECT_EQ(encoding.data(), pos);
+    EXPECT_EQ("Need 5 byte(s) for text string, have 3.", message);
+}
+
+TEST(DowncastTest, ViewStrings) {
+    auto encoding = Array("hello", Bstr("hi")).encode();
+
+    auto [item, pos, message] = parseWithViews(encoding);
+    ASSERT_THAT(item, NotNull());
+    auto array = downcastItem<Array>(std::move(item));
+    ASSERT_THAT(array, NotNull());
+
+    EXPECT_THAT(downcastItem<Tstr>((*array)[0]->clone()), IsNull());
+    EXPECT_THAT(downcastItem<ViewTstr>((*array)[0]->clone()), NotNull());
+    EXPECT_THAT(downcastItem<Bstr>((*array)[1]->clone()), IsNull());
+    EXPECT_THAT(downcastItem<ViewBstr>((*array)[1]->clone()), NotNull());
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -85,6 +85,7 @@ bool keyParamEqual(const KeyParameter& a, const KeyParameter& b) {
 
 void AuthorizationSet::Sort() {
     std::sort(data_.begin(), data_.end(), keyParamLess);
+    InvalidateIndex();
 }
 
 void AuthorizationSet::Deduplicate() {
@@ -105,6 +106,7 @@ void AuthorizationSet::Deduplicate() {
     result.push_back(std::move(*prev));
 
     std::swap(data_, result);
+    InvalidateIndex();
 }
 
 void AuthorizationSet::Union(const AuthorizationSet& other) {
@@ -113,20 +115,32 @@ void AuthorizationSet::Union(const AuthorizationSet& other) {
 }
 
 void AuthorizationSet::Subtract(const AuthorizationSet& other) {
+    if (&other == this) {
+        Clear();
+        return;
+    }
+
     Deduplicate();
 
-    auto i = other.begin();
-    while (i != other.end()) {
-        int pos = -1;
-        do {
-            pos = find(i->tag, pos);
-            if (pos != -1 && keyParamEqual(*i, data_[pos])) {
-                data_.erase(data_.begin() + pos);
-                break;
-            }
-        } while (pos != -1);
-        ++i;
+    // After deduplication data_ is sorted and holds each value at most once, so sorting other the
+    // same way lets a single merge pass find the entries to drop.
+    std::vector<const KeyParameter*> sortedOther;
+    sortedOther.reserve(other.size());
+    for (const auto& param : other) {
+        sortedOther.push_back(&param);
+    }
+    std::sort(sortedOther.begin(), sortedOther.end(),
+              [](const KeyParameter* a, const KeyParameter* b) { return keyParamLess(*a, *b); });
+
+    std::vector<KeyParameter> result;
+    auto i = sortedOther.begin();
+    for (auto& param : data_) {
+        while (i != sortedOther.end() && keyParamLess(**i, param)) ++i;
+        if (i != sortedOther.end() && !keyParamLess(param, **i)) continue;
+        result.push_back(std::move(param));
     }
+    std::swap(data_, result);
+    InvalidateIndex();
 }
 
 void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
@@ -137,9 +151,12 @@ void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
         }
     }
     std::swap(data_, result);
+    InvalidateIndex();
 }
 
 KeyParameter& AuthorizationSet::operator[](int at) {
+    // The caller may change the tag through the returned reference.
+    InvalidateIndex();
     return data_[at];
 }
 
@@ -149,15 +166,48 @@ const KeyParameter& AuthorizationSet::operator[](int at) const {
 
 void AuthorizationSet::Clear() {
     data_.clear();
+    InvalidateIndex();
+}
+
+// Below this size a linear scan is as fast as the index and doesn't need building.
+static constexpr size_t kMinIndexedSize = 16;
+
+void AuthorizationSet::BuildIndex() const {
+    if (indexValid_.load(std::memory_order_acquire)) return;
+
+    std::lock_guard<std::mutex> lock(indexLock_);
+    if (indexValid_.load(std::memory_order_relaxed)) return;
+    index_.clear();
+    index_.reserve(data_.size());
+    for (size_t i = 0; i < data_.size(); ++i) {
+        index_.emplace_back(data_[i].tag, i);
+    }
+    std::sort(index_.begin(), index_.end());
+    indexValid_.store(true, std::memory_order_release);
 }
 
 size_t AuthorizationSet::GetTagCount(Tag tag) const {
+    if (data_.size() >= kMinIndexedSize) {
+        BuildIndex();
+        auto first = std::lower_bound(index_.begin(), index_.end(), std::make_pair(tag, -1));
+        auto last = std::lower_bound(first, index_.end(),
+                                     std::make_pair(tag, std::numeric_limits<int>::max()));
+        return last - first;
+    }
+
     size_t count = 0;
     for (int pos = -1; (pos = find(tag, pos)) != -1;) ++count;
     return count;
 }
 
 int AuthorizationSet::find(Tag tag, int begin) const {
+    if (data_.size() >= kMinIndexedSize) {
+        BuildIndex();
+        auto iter = std::upper_bound(index_.begin(), index_.end(), std::make_pair(tag, begin));
+        if (iter != index_.end() && iter->first == tag) return iter->second;
+        return -1;
+    }
+
     auto iter = data_.begin() + (1 + begin);
 
     while (iter != data_.end() && iter->tag != tag) ++iter;
@@ -170,6 +220,7 @@ bool AuthorizationSet::erase(int index) {
     auto pos = data_.begin() + index;
     if (pos != data_.end()) {
         data_.erase(pos);
+        InvalidateIndex();
         return true;
     }
     return false;
@@ -200,54 +251,76 @@ NullOr<const KeyParameter&> AuthorizationSet::GetEntry(Tag tag) const {
  * | 32 bit indirect_offset |
  */
 
-struct OutStreams {
-    std::ostream& indirect;
-    std::ostream& elements;
+static constexpr size_t kHeaderSize = 3 * sizeof(uint32_t);
+
+/**
+ * Serialization is done in two passes over the same code. The first pass runs with null buffers
+ * and only adds up the sizes of the indirect and element sections, so that the second pass can
+ * write both straight into one buffer of exactly the right size.
+ */
+struct OutBuffer {
+    uint8_t* indirect;
+    uint8_t* elements;
+    size_t indirect_size;
+    size_t elements_size;
     size_t skipped;
+    bool bad;
+
+    bool sizing() const { return elements == nullptr; }
+
+    void writeIndirect(const void* data, size_t size) {
+        if (!sizing()) memcpy(indirect + indirect_size, data, size);
+        indirect_size += size;
+    }
+
+    void writeElements(const void* data, size_t size) {
+        if (!sizing()) memcpy(elements + elements_size, data, size);
+        elements_size += size;
+    }
 };
 
-OutStreams& serializeParamValue(OutStreams& out, const hidl_vec<uint8_t>& blob) {
+OutBuffer& serializeParamValue(OutBuffer& out, const hidl_vec<uint8_t>& blob) {
     uint32_t buffer;
 
     // write blob_length
     auto blob_length = blob.size();
     if (blob_length > std::numeric_limits<uint32_t>::max()) {
-        out.elements.setstate(std::ios_base::badbit);
+        out.bad = true;
         return out;
     }
     buffer = blob_length;
-    out.elements.write(reinterpret_cast<const char*>(&buffer), sizeof(uint32_t));
+    out.writeElements(&buffer, sizeof(uint32_t));
 
     // write indirect_offset
-    auto offset = out.indirect.tellp();
-    if (offset < 0 || offset > std::numeric_limits<uint32_t>::max() ||
+    auto offset = out.indirect_size;
+    if (offset > std::numeric_limits<uint32_t>::max() ||
         uint32_t(offset) + uint32_t(blob_length) < uint32_t(offset)) {  // overflow check
-        out.elements.setstate(std::ios_base::badbit);
+        out.bad = true;
         return out;
     }
     buffer = offset;
-    out.elements.write(reinterpret_cast<const char*>(&buffer), sizeof(uint32_t));
+    out.writeElements(&buffer, sizeof(uint32_t));
 
-    // write blob to indirect stream
-    if (blob_length) out.indirect.write(reinterpret_cast<const char*>(&blob[0]), blob_length);
+    // write blob to indirect section
+    if (blob_length) out.writeIndirect(&blob[0], blob_length);
 
     return out;
 }
 
 template <typename T>
-OutStreams& serializeParamValue(OutStreams& out, const T& value) {
-    out.elements.write(reinterpret_cast<const char*>(&value), sizeof(T));
+OutBuffer& serializeParamValue(OutBuffer& out, const T& value) {
+    out.writeElements(&value, sizeof(T));
     return out;
 }
 
-OutStreams& serialize(TAG_INVALID_t&&, OutStreams& out, const KeyParameter&) {
+OutBuffer& serialize(TAG_INVALID_t&&, OutBuffer& out, const KeyParameter&) {
     // skip invalid entries.
     ++out.skipped;
     return out;
 }
 template <typename T>
-OutStreams& serialize(T ttag, OutStreams& out, const KeyParameter& param) {
-    out.elements.write(reinterpret_cast<const char*>(&param.tag), sizeof(int32_t));
+OutBuffer& serialize(T ttag, OutBuffer& out, const KeyParameter& param) {
+    out.writeElements(&param.tag, sizeof(int32_t));
     return serializeParamValue(out, accessTagValue(ttag, param));
 }
 
@@ -255,16 +328,19 @@ template <typename... T>
 struct choose_serializer;
 template <typename... Tags>
 struct choose_serializer<MetaList<Tags...>> {
-    static OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
+    static OutBuffer& serialize(OutBuffer& out, const KeyParameter& param) {
         return choose_serializer<Tags...>::serialize(out, param);
     }
 };
 
 template <>
 struct choose_serializer<> {
-    static OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
-        LOG(WARNING) << "Trying to serialize unknown tag " << unsigned(param.tag)
-                     << ". Did you forget to add it to all_tags_t?";
+    static OutBuffer& serialize(OutBuffer& out, const KeyParameter& param) {
+        // Only warn once, not again when writing.
+        if (out.sizing()) {
+            LOG(WARNING) << "Trying to serialize unknown tag " << unsigned(param.tag)
+                         << ". Did you forget to add it to all_tags_t?";
+        }
         ++out.skipped;
         return out;
     }
@@ -272,7 +348,7 @@ struct choose_serializer<> {
 
 template <TagType tag_type, Tag tag, typename... Tail>
 struct choose_serializer<TypedTag<tag_type, tag>, Tail...> {
-    static OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
+    static OutBuffer& serialize(OutBuffer& out, const KeyParameter& param) {
         if (param.tag == tag) {
             return V4_0::serialize(TypedTag<tag_type, tag>(), out, param);
         } else {
@@ -281,82 +357,111 @@ struct choose_serializer<TypedTag<tag_type, tag>, Tail...> {
     }
 };
 
-OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
+OutBuffer& serialize(OutBuffer& out, const KeyParameter& param) {
     return choose_serializer<all_tags_t>::serialize(out, param);
 }
 
-std::ostream& serialize(std::ostream& out, const std::vector<KeyParameter>& params) {
-    std::stringstream indirect;
-    std::stringstream elements;
-    OutStreams streams = {indirect, elements, 0};
+/**
+ * Runs the sizing pass over params, leaving the section sizes in layout. Returns the total
+ * serialized size, or 0 if params can't be serialized.
+ */
+size_t serializedSize(const std::vector<KeyParameter>& params, OutBuffer* layout) {
+    *layout = {nullptr, nullptr, 0, 0, 0, false};
     for (const auto& param : params) {
-        serialize(streams, param);
-    }
-    if (indirect.bad() || elements.bad()) {
-        out.setstate(std::ios_base::badbit);
-        return out;
-    }
-    auto pos = indirect.tellp();
-    if (pos < 0 || pos > std::numeric_limits<uint32_t>::max()) {
-        out.setstate(std::ios_base::badbit);
-        return out;
+        serialize(*layout, param);
     }
-    uint32_t indirect_size = pos;
-    pos = elements.tellp();
-    if (pos < 0 || pos > std::numeric_limits<uint32_t>::max()) {
-        out.setstate(std::ios_base::badbit);
-        return out;
+    if (layout->bad || layout->indirect_size > std::numeric_limits<uint32_t>::max() ||
+        layout->elements_size > std::numeric_limits<uint32_t>::max()) {
+        return 0;
     }
-    uint32_t elements_size = pos;
-    uint32_t element_count = params.size() - streams.skipped;
-
-    out.write(reinterpret_cast<const char*>(&indirect_size), sizeof(uint32_t));
-
-    pos = out.tellp();
-    if (indirect_size) out << indirect.rdbuf();
-    assert(out.tellp() - pos == indirect_size);
+    return kHeaderSize + layout->indirect_size + layout->elements_size;
+}
 
-    out.write(reinterpret_cast<const char*>(&element_count), sizeof(uint32_t));
-    out.write(reinterpret_cast<const char*>(&elements_size), sizeof(uint32_t));
+/**
+ * Writes params to buffer, which must be large enough for the layout computed by
+ * serializedSize(). Returns the number of bytes written.
+ */
+size_t serialize(const std::vector<KeyParameter>& params, const OutBuffer& layout,
+                 uint8_t* buffer) {
+    uint32_t indirect_size = layout.indirect_size;
+    uint32_t element_count = params.size() - layout.skipped;
+    uint32_t elements_size = layout.elements_size;
+
+    uint8_t* pos = buffer;
+    memcpy(pos, &indirect_size, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    OutBuffer out = {pos, pos + indirect_size + 2 * sizeof(uint32_t), 0, 0, 0, false};
+    pos += indirect_size;
+    memcpy(pos, &element_count, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    memcpy(pos, &elements_size, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
 
-    pos = out.tellp();
-    if (elements_size) out << elements.rdbuf();
-    assert(out.tellp() - pos == elements_size);
+    for (const auto& param : params) {
+        serialize(out, param);
+    }
+    assert(out.indirect_size == indirect_size && out.elements_size == elements_size);
 
-    return out;
+    return pos + elements_size - buffer;
 }
 
-struct InStreams {
-    std::istream& indirect;
-    std::istream& elements;
+struct InBuffer {
+    const uint8_t* indirect;
+    size_t indirect_size;
+    const uint8_t* elements;
+    size_t elements_size;
+    size_t pos;
     size_t invalids;
+    // If set, blobs point into the indirect section instead of owning a copy.
+    bool view;
+    bool bad;
+
+    bool readElements(void* data, size_t size) {
+        if (bad || elements_size - pos < size) {
+            bad = true;
+            return false;
+        }
+        memcpy(data, elements + pos, size);
+        pos += size;
+        return true;
+    }
 };
 
-InStreams& deserializeParamValue(InStreams& in, hidl_vec<uint8_t>* blob) {
+InBuffer& deserializeParamValue(InBuffer& in, hidl_vec<uint8_t>* blob) {
     uint32_t blob_length = 0;
     uint32_t offset = 0;
-    in.elements.read(reinterpret_cast<char*>(&blob_length), sizeof(uint32_t));
-    blob->resize(blob_length);
-    in.elements.read(reinterpret_cast<char*>(&offset), sizeof(uint32_t));
-    in.indirect.seekg(offset);
-    in.indirect.read(reinterpret_cast<char*>(&(*blob)[0]), blob->size());
+    if (!in.readElements(&blob_length, sizeof(uint32_t)) ||
+        !in.readElements(&offset, sizeof(uint32_t))) {
+        return in;
+    }
+    if (offset > in.indirect_size || in.indirect_size - offset < blob_length) {
+        in.bad = true;
+        return in;
+    }
+    const uint8_t* data = in.indirect + offset;
+    if (in.view) {
+        blob->setToExternal(const_cast<uint8_t*>(data), blob_length);
+    } else {
+        blob->resize(blob_length);
+        if (blob_length) memcpy(&(*blob)[0], data, blob_length);
+    }
     return in;
 }
 
 template <typename T>
-InStreams& deserializeParamValue(InStreams& in, T* value) {
-    in.elements.read(reinterpret_cast<char*>(value), sizeof(T));
+InBuffer& deserializeParamValue(InBuffer& in, T* value) {
+    in.readElements(value, sizeof(T));
     return in;
 }
 
-InStreams& deserialize(TAG_INVALID_t&&, InStreams& in, KeyParameter*) {
+InBuffer& deserialize(TAG_INVALID_t&&, InBuffer& in, KeyParameter*) {
     // there should be no invalid KeyParamaters but if handle them as zero sized.
     ++in.invalids;
     return in;
 }
 
 template <typename T>
-InStreams& deserialize(T&& ttag, InStreams& in, KeyParameter* param) {
+InBuffer& deserialize(T&& ttag, InBuffer& in, KeyParameter* param) {
     return deserializeParamValue(in, &accessTagValue(ttag, *param));
 }
 
@@ -364,21 +469,21 @@ template <typename... T>
 struct choose_deserializer;
 template <typename... Tags>
 struct choose_deserializer<MetaList<Tags...>> {
-    static InStreams& deserialize(InStreams& in, KeyParameter* param) {
+    static InBuffer& deserialize(InBuffer& in, KeyParameter* param) {
         return choose_deserializer<Tags...>::deserialize(in, param);
     }
 };
 template <>
 struct choose_deserializer<> {
-    static InStreams& deserialize(InStreams& in, KeyParameter*) {
+    static InBuffer& deserialize(InBuffer& in, KeyParameter*) {
         // encountered an unknown tag -> fail parsing
-        in.elements.setstate(std::ios_base::badbit);
+        in.bad = true;
         return in;
     }
 };
 template <TagType tag_type, Tag tag, typename... Tail>
 struct choose_deserializer<TypedTag<tag_type, tag>, Tail...> {
-    static InStreams& deserialize(InStreams& in, KeyParameter* param) {
+    static InBuffer& deserialize(InBuffer& in, KeyParameter* param) {
         if (param->tag == tag) {
             return V4_0::deserialize(TypedTag<tag_type, tag>(), in, param);
         } else {
@@ -387,52 +492,33 @@ struct choose_deserializer<TypedTag<tag_type, tag>, Tail...> {
     }
 };
 
-InStreams& deserialize(InStreams& in, KeyParameter* param) {
-    in.elements.read(reinterpret_cast<char*>(&param->tag), sizeof(Tag));
+InBuffer& deserialize(InBuffer& in, KeyParameter* param) {
+    if (!in.readElements(&param->tag, sizeof(Tag))) return in;
     return choose_deserializer<all_tags_t>::deserialize(in, param);
 }
 
-std::istream& deserialize(std::istream& in, std::vector<KeyParameter>* params) {
-    uint32_t indirect_size = 0;
-    in.read(reinterpret_cast<char*>(&indirect_size), sizeof(uint32_t));
-    std::string indirect_buffer(indirect_size, '\0');
-    if (indirect_buffer.size() != indirect_size) {
-        in.setstate(std::ios_base::badbit);
-        return in;
-    }
-    in.read(&indirect_buffer[0], indirect_buffer.size());
-
-    uint32_t element_count = 0;
-    in.read(reinterpret_cast<char*>(&element_count), sizeof(uint32_t));
-    uint32_t elements_size = 0;
-    in.read(reinterpret_cast<char*>(&elements_size), sizeof(uint32_t));
-
-    std::string elements_buffer(elements_size, '\0');
-    if (elements_buffer.size() != elements_size) {
-        in.setstate(std::ios_base::badbit);
-        return in;
-    }
-    in.read(&elements_buffer[0], elements_buffer.size());
-
-    if (in.bad()) return in;
-
-    // TODO write one-shot stream buffer to avoid copying here
-    std::stringstream indirect(indirect_buffer);
-    std::stringstream elements(elements_buffer);
-    InStreams streams = {indirect, elements, 0};
+bool deserialize(InBuffer& in, uint32_t element_count, std::vector<KeyParameter>* params) {
+    params->clear();
 
+    // Every element starts with its tag, so a larger count can't be right. Checking this keeps a
+    // corrupted count from causing a huge allocation.
+    if (element_count > in.elements_size / sizeof(uint32_t)) return false;
     params->resize(element_count);
 
-    for (uint32_t i = 0; i < element_count; ++i) {
-        deserialize(streams, &(*params)[i]);
+    for (uint32_t i = 0; i < element_count && !in.bad; ++i) {
+        deserialize(in, &(*params)[i]);
+    }
+    if (in.bad) {
+        params->clear();
+        return false;
     }
 
     /*
      * There are legacy blobs which have invalid tags in them due to a bug during serialization.
      * This makes sure that invalid tags are filtered from the result before it is returned.
      */
-    if (streams.invalids > 0) {
-        std::vector<KeyParameter> filtered(element_count - streams.invalids);
+    if (in.invalids > 0) {
+        std::vector<KeyParameter> filtered(element_count - in.invalids);
         auto ifiltered = filtered.begin();
         for (auto& p : *params) {
             if (p.tag != Tag::INVALID) {
@@ -441,15 +527,95 @@ std::istream& deserialize(std::istream& in, std::vector<KeyParameter>* params) {
         }
         *params = std::move(filtered);
     }
-    return in;
+    return true;
+}
+
+bool deserialize(const uint8_t* data, size_t size, bool view, std::vector<KeyParameter>* params) {
+    params->clear();
+
+    uint32_t indirect_size = 0;
+    if (size < sizeof(uint32_t)) return false;
+    memcpy(&indirect_size, data, sizeof(uint32_t));
+    size_t pos = sizeof(uint32_t);
+    if (size - pos < indirect_size) return false;
+    const uint8_t* indirect = data + pos;
+    pos += indirect_size;
+
+    uint32_t element_count = 0;
+    uint32_t elements_size = 0;
+    if (size - pos < 2 * sizeof(uint32_t)) return false;
+    memcpy(&element_count, data + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    memcpy(&elements_size, data + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    if (size - pos < elements_size) return false;
+
+    InBuffer in = {indirect, indirect_size, data + pos, elements_size, 0, 0, view, false};
+    return deserialize(in, element_count, params);
+}
+
+size_t AuthorizationSet::SerializedSize() const {
+    OutBuffer layout;
+    return serializedSize(data_, &layout);
+}
+
+size_t AuthorizationSet::Serialize(uint8_t* buffer, size_t size) const {
+    OutBuffer layout;
+    size_t serialized_size = serializedSize(data_, &layout);
+    if (serialized_size == 0 || serialized_size > size) return 0;
+    return serialize(data_, layout, buffer);
+}
+
+std::vector<uint8_t> AuthorizationSet::Serialize() const {
+    OutBuffer layout;
+    std::vector<uint8_t> result(serializedSize(data_, &layout));
+    if (!result.empty()) serialize(data_, layout, result.data());
+    return result;
 }
 
 void AuthorizationSet::Serialize(std::ostream* out) const {
-    serialize(*out, data_);
+    std::vector<uint8_t> buffer = Serialize();
+    if (buffer.empty()) {
+        out->setstate(std::ios_base::badbit);
+        return;
+    }
+    out->write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+}
+
+bool AuthorizationSet::Deserialize(const uint8_t* data, size_t size) {
+    InvalidateIndex();
+    return deserialize(data, size, false /* view */, &data_);
+}
+
+bool AuthorizationSet::DeserializeView(const uint8_t* data, size_t size) {
+    InvalidateIndex();
+    return deserialize(data, size, true /* view */, &data_);
 }
 
 void AuthorizationSet::Deserialize(std::istream* in) {
-    deserialize(*in, &data_);
+    InvalidateIndex();
+    uint32_t indirect_size = 0;
+    in->read(reinterpret_cast<char*>(&indirect_size), sizeof(uint32_t));
+    std::vector<uint8_t> indirect_buffer(indirect_size);
+    in->read(reinterpret_cast<char*>(indirect_buffer.data()), indirect_buffer.size());
+
+    uint32_t element_count = 0;
+    in->read(reinterpret_cast<char*>(&element_count), sizeof(uint32_t));
+    uint32_t elements_size = 0;
+    in->read(reinterpret_cast<char*>(&elements_size), sizeof(uint32_t));
+    std::vector<uint8_t> elements_buffer(elements_size);
+    in->read(reinterpret_cast<char*>(elements_buffer.data()), elements_buffer.size());
+
+    if (!*in) {
+        in->setstate(std::ios_base::badbit);
+        return;
+    }
+
+    InBuffer buffers = {indirect_buffer.data(), indirect_buffer.size(), elements_buffer.data(),
+                        elements_buffer.size(), 0, 0, false /* view */, false};
+    if (!deserialize(buffers, element_count, &data_)) {
+        in->setstate(std::ios_base::badbit);
+    }
 }
 
 AuthorizationSetBuilder& AuthorizationSetBuilder::RsaKey(uint32_t key_size,
@@ -17,6 +17,9 @@
 #ifndef SYSTEM_SECURITY_KEYSTORE_KM4_AUTHORIZATION_SET_H_
 #define SYSTEM_SECURITY_KEYSTORE_KM4_AUTHORIZATION_SET_H_
 
+#include <atomic>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 #include <keymasterV4_0/keymaster_tags.h>
@@ -46,7 +49,9 @@ class AuthorizationSet {
     AuthorizationSet(const AuthorizationSet& other) : data_(other.data_) {}
 
     // Move constructor.
-    AuthorizationSet(AuthorizationSet&& other) noexcept : data_(std::move(other.data_)) {}
+    AuthorizationSet(AuthorizationSet&& other) noexcept : data_(std::move(other.data_)) {
+        other.InvalidateIndex();
+    }
 
     // Constructor from hidl_vec<KeyParameter>
     AuthorizationSet(const hidl_vec<KeyParameter>& other) { *this = other; }
@@ -54,12 +59,15 @@ class AuthorizationSet {
     // Copy assignment.
     AuthorizationSet& operator=(const AuthorizationSet& other) {
         data_ = other.data_;
+        InvalidateIndex();
         return *this;
     }
 
     // Move assignment.
     AuthorizationSet& operator=(AuthorizationSet&& other) noexcept {
         data_ = std::move(other.data_);
+        InvalidateIndex();
+        other.InvalidateIndex();
         return *this;
     }
 
@@ -72,6 +80,7 @@ class AuthorizationSet {
                 data_[i] = other[i];
             }
         }
+        InvalidateIndex();
         return *this;
     }
 
@@ -121,7 +130,8 @@ class AuthorizationSet {
 
     /**
      * Returns the offset of the next entry that matches \p tag, starting from the element after \p
-     * begin.  If not found, returns -1.
+     * begin.  If not found, returns -1.  On larger sets this uses an index of the tags which is
+     * built on first use and dropped whenever the set is modified.
      */
     int find(Tag tag, int begin = -1) const;
 
@@ -185,8 +195,14 @@ class AuthorizationSet {
         return {};
     }
 
-    void push_back(const KeyParameter& param) { data_.push_back(param); }
-    void push_back(KeyParameter&& param) { data_.push_back(std::move(param)); }
+    void push_back(const KeyParameter& param) {
+        data_.push_back(param);
+        InvalidateIndex();
+    }
+    void push_back(KeyParameter&& param) {
+        data_.push_back(std::move(param));
+        InvalidateIndex();
+    }
     void push_back(const AuthorizationSet& set) {
         for (auto& entry : set) {
             push_back(entry);
@@ -222,10 +238,49 @@ class AuthorizationSet {
     void Serialize(std::ostream* out) const;
     void Deserialize(std::istream* in);
 
+    /**
+     * Returns the number of bytes needed to serialize the set, or 0 if it can't be serialized.
+     */
+    size_t SerializedSize() const;
+
+    /**
+     * Serializes the set into \p buffer, in the same format as Serialize(std::ostream*). Returns
+     * the number of bytes written, or 0 if the set can't be serialized or \p size is smaller
+     * than SerializedSize().
+     */
+    size_t Serialize(uint8_t* buffer, size_t size) const;
+
+    /**
+     * Returns the serialized set, or an empty vector if it can't be serialized.
+     */
+    std::vector<uint8_t> Serialize() const;
+
+    /**
+     * Replaces the contents of the set with the entries serialized in \p data. Returns false,
+     * leaving the set empty, if \p data is malformed.
+     */
+    bool Deserialize(const uint8_t* data, size_t size);
+
+    /**
+     * Like Deserialize(const uint8_t*, size_t), but BYTES and BIGNUM entries refer to \p data
+     * instead of owning a copy, so \p data must outlive the set. Copies of the set own their
+     * blobs as usual.
+     */
+    bool DeserializeView(const uint8_t* data, size_t size);
+
    private:
     NullOr<const KeyParameter&> GetEntry(Tag tag) const;
 
+    void InvalidateIndex() { indexValid_.store(false, std::memory_order_relaxed); }
+    void BuildIndex() const;
+
     std::vector<KeyParameter> data_;
+
+    // (tag, position) pairs for data_, sorted, so that find() and GetTagCount() can binary search
+    // instead of scanning.  Built lazily by const lookups, hence the lock.
+    mutable std::vector<std::pair<Tag, int>> index_;
+    mutable std::atomic<bool> indexValid_{false};
+    mutable std::mutex indexLock_;
 };
 
 class AuthorizationSetBuilder : public AuthorizationSet {
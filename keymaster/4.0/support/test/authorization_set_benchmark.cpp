@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/authorization_set.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+using namespace android::hardware::keymaster::V4_0;
+
+namespace {
+
+// The characteristics of a typical keystore key, with an application id and a certificate sized
+// attestation challenge.
+AuthorizationSet makeKeyCharacteristics() {
+    std::string applicationId(64, 'a');
+    std::string challenge(1024, 'c');
+    return AuthorizationSetBuilder()
+            .RsaSigningKey(2048, 65537)
+            .Digest(Digest::SHA_2_256)
+            .Digest(Digest::SHA_2_512)
+            .Padding(PaddingMode::RSA_PSS)
+            .Padding(PaddingMode::RSA_PKCS1_1_5_SIGN)
+            .Authorization(TAG_USER_SECURE_ID, 1u)
+            .Authorization(TAG_USER_AUTH_TYPE, HardwareAuthenticatorType::PASSWORD)
+            .Authorization(TAG_AUTH_TIMEOUT, 300u)
+            .Authorization(TAG_ACTIVE_DATETIME, 1500000000000u)
+            .Authorization(TAG_CREATION_DATETIME, 1500000000000u)
+            .Authorization(TAG_ORIGIN, KeyOrigin::GENERATED)
+            .Authorization(TAG_OS_VERSION, 100000u)
+            .Authorization(TAG_OS_PATCHLEVEL, 202001u)
+            .Authorization(TAG_APPLICATION_ID, applicationId.data(), applicationId.size())
+            .Authorization(TAG_ATTESTATION_CHALLENGE, challenge.data(), challenge.size());
+}
+
+void setBytesProcessed(benchmark::State& state, size_t size) {
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * size);
+}
+
+void BM_Serialize(benchmark::State& state) {
+    AuthorizationSet set = makeKeyCharacteristics();
+    size_t size = set.SerializedSize();
+    for (auto _ : state) {
+        std::vector<uint8_t> data = set.Serialize();
+        benchmark::DoNotOptimize(data.data());
+    }
+    setBytesProcessed(state, size);
+}
+BENCHMARK(BM_Serialize);
+
+void BM_SerializeStream(benchmark::State& state) {
+    AuthorizationSet set = makeKeyCharacteristics();
+    size_t size = set.SerializedSize();
+    for (auto _ : state) {
+        std::stringstream stream;
+        set.Serialize(&stream);
+        benchmark::DoNotOptimize(stream);
+    }
+    setBytesProcessed(state, size);
+}
+BENCHMARK(BM_SerializeStream);
+
+void BM_Deserialize(benchmark::State& state) {
+    std::vector<uint8_t> data = makeKeyCharacteristics().Serialize();
+    for (auto _ : state) {
+        AuthorizationSet set;
+        set.Deserialize(data.data(), data.size());
+        benchmark::DoNotOptimize(set.data());
+    }
+    setBytesProcessed(state, data.size());
+}
+BENCHMARK(BM_Deserialize);
+
+void BM_DeserializeView(benchmark::State& state) {
+    std::vector<uint8_t> data = makeKeyCharacteristics().Serialize();
+    for (auto _ : state) {
+        AuthorizationSet set;
+        set.DeserializeView(data.data(), data.size());
+        benchmark::DoNotOptimize(set.data());
+    }
+    setBytesProcessed(state, data.size());
+}
+BENCHMARK(BM_DeserializeView);
+
+void BM_DeserializeStream(benchmark::State& state) {
+    std::vector<uint8_t> data = makeKeyCharacteristics().Serialize();
+    std::string encoded(data.begin(), data.end());
+    for (auto _ : state) {
+        std::stringstream stream(encoded);
+        AuthorizationSet set;
+        set.Deserialize(&stream);
+        benchmark::DoNotOptimize(set.data());
+    }
+    setBytesProcessed(state, data.size());
+}
+BENCHMARK(BM_DeserializeStream);
+
+// Key characteristics grown to 50 entries with the repeatable tags that accumulate on real keys.
+AuthorizationSet makeLargeKeyCharacteristics() {
+    AuthorizationSet set = makeKeyCharacteristics();
+    for (uint64_t id = 2; set.size() < 50; ++id) {
+        set.push_back(TAG_USER_SECURE_ID, id);
+    }
+    return set;
+}
+
+// The lookups keystore makes when it starts an operation on a key.
+void lookUpOperationTags(const AuthorizationSet& set) {
+    benchmark::DoNotOptimize(set.GetTagValue(TAG_ALGORITHM));
+    benchmark::DoNotOptimize(set.GetTagValue(TAG_KEY_SIZE));
+    benchmark::DoNotOptimize(set.GetTagValue(TAG_AUTH_TIMEOUT));
+    benchmark::DoNotOptimize(set.GetTagValue(TAG_ACTIVE_DATETIME));
+    benchmark::DoNotOptimize(set.GetTagValue(TAG_USAGE_EXPIRE_DATETIME));
+    benchmark::DoNotOptimize(set.GetTagCount(Tag::PURPOSE));
+    benchmark::DoNotOptimize(set.GetTagCount(Tag::USER_SECURE_ID));
+    benchmark::DoNotOptimize(set.Contains(Tag::NO_AUTH_REQUIRED));
+}
+
+void BM_Lookup(benchmark::State& state) {
+    AuthorizationSet set = makeLargeKeyCharacteristics();
+    for (auto _ : state) {
+        lookUpOperationTags(set);
+    }
+}
+BENCHMARK(BM_Lookup);
+
+// As BM_Lookup, on a fresh copy each time, so that the cost of building the index is included.
+void BM_LookupOnCopy(benchmark::State& state) {
+    AuthorizationSet set = makeLargeKeyCharacteristics();
+    for (auto _ : state) {
+        AuthorizationSet copy(set);
+        lookUpOperationTags(copy);
+    }
+}
+BENCHMARK(BM_LookupOnCopy);
+
+void BM_Subtract(benchmark::State& state) {
+    AuthorizationSet set = makeLargeKeyCharacteristics();
+    AuthorizationSet other = makeKeyCharacteristics();
+    for (auto _ : state) {
+        AuthorizationSet copy(set);
+        copy.Subtract(other);
+        benchmark::DoNotOptimize(copy.data());
+    }
+}
+BENCHMARK(BM_Subtract);
+
+}  // namespace
+
+BENCHMARK_MAIN();
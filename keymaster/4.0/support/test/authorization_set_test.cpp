@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/authorization_set.h>
+
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+
+namespace {
+
+// Serialized form of makeKnownSet(), as written by the stream based serializer.
+const std::vector<uint8_t> kKnownEncoding = {
+        // indirect_size, then the blobs "ab" and "xyz"
+        0x05, 0x00, 0x00, 0x00, 0x61, 0x62, 0x78, 0x79, 0x7a,
+        // element_count, elements_size
+        0x05, 0x00, 0x00, 0x00, 0x31, 0x00, 0x00, 0x00,
+        // ALGORITHM = EC
+        0x02, 0x00, 0x00, 0x10, 0x03, 0x00, 0x00, 0x00,
+        // APPLICATION_ID, blob_length 2 at indirect offset 0
+        0x59, 0x02, 0x00, 0x90, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        // NO_AUTH_REQUIRED
+        0xf7, 0x01, 0x00, 0x70, 0x01,
+        // USER_SECURE_ID
+        0xf6, 0x01, 0x00, 0xa0, 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01,
+        // APPLICATION_DATA, blob_length 3 at indirect offset 2
+        0xbc, 0x02, 0x00, 0x90, 0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+};
+
+// Positions of fields in kKnownEncoding.
+constexpr size_t kElementCountPos = 9;
+constexpr size_t kApplicationIdLengthPos = 29;
+constexpr size_t kApplicationIdOffsetPos = 33;
+
+AuthorizationSet makeKnownSet() {
+    return AuthorizationSetBuilder()
+            .Authorization(TAG_ALGORITHM, Algorithm::EC)
+            .Authorization(TAG_APPLICATION_ID, "ab", size_t(2))
+            .Authorization(TAG_NO_AUTH_REQUIRED)
+            .Authorization(TAG_USER_SECURE_ID, 0x0102030405060708u)
+            .Authorization(TAG_APPLICATION_DATA, "xyz", size_t(3));
+}
+
+// A set with an entry of every serializable tag type, including empty and large blobs.
+AuthorizationSet makeMixedSet() {
+    std::string large(4096, 'k');
+    return AuthorizationSetBuilder()
+            .RsaSigningKey(2048, 65537)
+            .Digest(Digest::SHA_2_256)
+            .Padding(PaddingMode::RSA_PSS)
+            .Authorization(TAG_USER_SECURE_ID, 1u)
+            .Authorization(TAG_USER_SECURE_ID, 2u)
+            .Authorization(TAG_ACTIVE_DATETIME, 1500000000000u)
+            .Authorization(TAG_NO_AUTH_REQUIRED)
+            .Authorization(TAG_APPLICATION_ID, "", size_t(0))
+            .Authorization(TAG_APPLICATION_DATA, large.data(), large.size())
+            .Authorization(TAG_ATTESTATION_CHALLENGE, "challenge", size_t(9));
+}
+
+void putUint32(std::vector<uint8_t>* data, size_t pos, uint32_t value) {
+    memcpy(data->data() + pos, &value, sizeof(value));
+}
+
+bool isInside(const hidl_vec<uint8_t>& blob, const std::vector<uint8_t>& data) {
+    return blob.data() >= data.data() && blob.data() + blob.size() <= data.data() + data.size();
+}
+
+// Tags used by makeSetOfSize(), plus one that it never uses.
+const std::vector<Tag> kLookupTags = {Tag::PURPOSE,        Tag::DIGEST,  Tag::KEY_SIZE,
+                                      Tag::USER_SECURE_ID, Tag::ALGORITHM, Tag::NO_AUTH_REQUIRED};
+
+// Returns a set of \p size entries in which most tags repeat, in no particular order.
+AuthorizationSet makeSetOfSize(size_t size) {
+    AuthorizationSet set;
+    for (uint32_t i = 0; i < size; ++i) {
+        switch (i % 5) {
+            case 0:
+                set.push_back(TAG_PURPOSE, static_cast<KeyPurpose>(i % 4));
+                break;
+            case 1:
+                set.push_back(TAG_DIGEST, static_cast<Digest>(i % 7));
+                break;
+            case 2:
+                set.push_back(TAG_USER_SECURE_ID, uint64_t(i % 3));
+                break;
+            case 3:
+                set.push_back(TAG_KEY_SIZE, i);
+                break;
+            case 4:
+                set.push_back(TAG_ALGORITHM, i % 2 ? Algorithm::RSA : Algorithm::EC);
+                break;
+        }
+    }
+    return set;
+}
+
+// Checks find(), GetTagCount() and GetTagValue() against a scan of the entries.
+void expectLookupsMatchScan(const AuthorizationSet& set) {
+    for (Tag tag : kLookupTags) {
+        std::vector<int> positions;
+        for (auto iter = set.begin(); iter != set.end(); ++iter) {
+            if (iter->tag == tag) positions.push_back(iter - set.begin());
+        }
+
+        std::vector<int> found;
+        for (int pos = -1; (pos = set.find(tag, pos)) != -1;) found.push_back(pos);
+        EXPECT_EQ(positions, found) << toString(tag) << " in " << set.size() << " entries";
+        EXPECT_EQ(positions.size(), set.GetTagCount(tag)) << toString(tag);
+        EXPECT_EQ(!positions.empty(), set.Contains(tag)) << toString(tag);
+    }
+
+    auto keySize = set.GetTagValue(TAG_KEY_SIZE);
+    int keySizePos = set.find(Tag::KEY_SIZE);
+    ASSERT_EQ(keySizePos != -1, keySize.isOk());
+    if (keySize.isOk()) {
+        EXPECT_EQ(set[keySizePos].f.integer, keySize.value());
+    }
+}
+
+// Removes the entries of \p other from a deduplicated \p set one at a time, without the index.
+AuthorizationSet referenceSubtract(AuthorizationSet set, const AuthorizationSet& other) {
+    set.Deduplicate();
+    for (const auto& param : other) {
+        for (size_t i = 0; i < set.size(); ++i) {
+            if (*(set.begin() + i) == param) {
+                set.erase(i);
+                break;
+            }
+        }
+    }
+    return set;
+}
+
+}  // namespace
+
+TEST(AuthorizationSetTest, SerializeMatchesKnownEncoding) {
+    AuthorizationSet set = makeKnownSet();
+    EXPECT_EQ(kKnownEncoding.size(), set.SerializedSize());
+    EXPECT_EQ(kKnownEncoding, set.Serialize());
+
+    std::vector<uint8_t> buffer(kKnownEncoding.size());
+    EXPECT_EQ(kKnownEncoding.size(), set.Serialize(buffer.data(), buffer.size()));
+    EXPECT_EQ(kKnownEncoding, buffer);
+    EXPECT_EQ(0u, set.Serialize(buffer.data(), buffer.size() - 1));
+
+    std::stringstream stream;
+    set.Serialize(&stream);
+    std::string streamed = stream.str();
+    EXPECT_EQ(kKnownEncoding, std::vector<uint8_t>(streamed.begin(), streamed.end()));
+}
+
+TEST(AuthorizationSetTest, DeserializeKnownEncoding) {
+    AuthorizationSet set;
+    ASSERT_TRUE(set.Deserialize(kKnownEncoding.data(), kKnownEncoding.size()));
+    EXPECT_EQ(makeKnownSet().hidl_data(), set.hidl_data());
+}
+
+TEST(AuthorizationSetTest, RoundTrip) {
+    AuthorizationSet set = makeMixedSet();
+    std::vector<uint8_t> data = set.Serialize();
+    ASSERT_FALSE(data.empty());
+
+    AuthorizationSet deserialized;
+    ASSERT_TRUE(deserialized.Deserialize(data.data(), data.size()));
+    EXPECT_EQ(set.hidl_data(), deserialized.hidl_data());
+
+    std::stringstream stream(std::string(data.begin(), data.end()));
+    AuthorizationSet streamed;
+    streamed.Deserialize(&stream);
+    ASSERT_TRUE(stream);
+    EXPECT_EQ(set.hidl_data(), streamed.hidl_data());
+}
+
+TEST(AuthorizationSetTest, DeserializeRejectsTruncatedData) {
+    for (size_t size = 0; size < kKnownEncoding.size(); ++size) {
+        AuthorizationSet set = makeKnownSet();
+        EXPECT_FALSE(set.Deserialize(kKnownEncoding.data(), size)) << "size " << size;
+        EXPECT_TRUE(set.empty()) << "size " << size;
+    }
+}
+
+TEST(AuthorizationSetTest, DeserializeRejectsBlobOutsideIndirectData) {
+    std::vector<uint8_t> data = kKnownEncoding;
+    putUint32(&data, kApplicationIdOffsetPos, 4);
+    AuthorizationSet set;
+    EXPECT_FALSE(set.Deserialize(data.data(), data.size()));
+    EXPECT_TRUE(set.empty());
+
+    data = kKnownEncoding;
+    putUint32(&data, kApplicationIdOffsetPos, 0xffffffff);
+    EXPECT_FALSE(set.Deserialize(data.data(), data.size()));
+
+    data = kKnownEncoding;
+    putUint32(&data, kApplicationIdLengthPos, 6);
+    EXPECT_FALSE(set.Deserialize(data.data(), data.size()));
+
+    data = kKnownEncoding;
+    putUint32(&data, kApplicationIdLengthPos, 0xffffffff);
+    EXPECT_FALSE(set.DeserializeView(data.data(), data.size()));
+    EXPECT_TRUE(set.empty());
+}
+
+TEST(AuthorizationSetTest, DeserializeRejectsOversizedElementCount) {
+    std::vector<uint8_t> data = kKnownEncoding;
+    putUint32(&data, kElementCountPos, 6);
+    AuthorizationSet set;
+    EXPECT_FALSE(set.Deserialize(data.data(), data.size()));
+
+    // Far more elements than elements_size can hold, which must fail before allocating them.
+    putUint32(&data, kElementCountPos, 0xffffffff);
+    EXPECT_FALSE(set.Deserialize(data.data(), data.size()));
+    EXPECT_TRUE(set.empty());
+}
+
+TEST(AuthorizationSetTest, DeserializeViewReferencesInput) {
+    AuthorizationSet expected = makeMixedSet();
+    std::vector<uint8_t> data = expected.Serialize();
+
+    AuthorizationSet view;
+    ASSERT_TRUE(view.DeserializeView(data.data(), data.size()));
+    EXPECT_EQ(expected.hidl_data(), view.hidl_data());
+
+    size_t blobs = 0;
+    for (const auto& param : view) {
+        if (param.blob.size() == 0) continue;
+        EXPECT_TRUE(isInside(param.blob, data)) << toString(param.tag);
+        ++blobs;
+    }
+    EXPECT_EQ(2u, blobs);
+
+    // A copy owns its blobs, so it stays valid after the input is gone.
+    AuthorizationSet copy(view);
+    for (const auto& param : copy) {
+        if (param.blob.size() == 0) continue;
+        EXPECT_FALSE(isInside(param.blob, data)) << toString(param.tag);
+    }
+    data.assign(data.size(), 0);
+    EXPECT_EQ(expected.hidl_data(), copy.hidl_data());
+}
+
+TEST(AuthorizationSetTest, LookupsMatchScan) {
+    // Sizes on both sides of the point where the index is used.
+    for (size_t size : {0, 1, 5, 15, 16, 17, 50}) {
+        expectLookupsMatchScan(makeSetOfSize(size));
+    }
+}
+
+TEST(AuthorizationSetTest, LookupsMatchScanAfterMutation) {
+    for (size_t size : {15, 16, 50}) {
+        SCOPED_TRACE(size);
+        AuthorizationSet set = makeSetOfSize(size);
+        // Each step builds the index with a lookup before changing the set.
+        expectLookupsMatchScan(set);
+
+        set.push_back(TAG_NO_AUTH_REQUIRED);
+        expectLookupsMatchScan(set);
+        set.push_back(TAG_KEY_SIZE, 4096u);
+        expectLookupsMatchScan(set);
+
+        set.erase(0);
+        expectLookupsMatchScan(set);
+        set.erase(set.find(Tag::NO_AUTH_REQUIRED));
+        expectLookupsMatchScan(set);
+
+        set[1].tag = Tag::NO_AUTH_REQUIRED;
+        expectLookupsMatchScan(set);
+
+        set.Sort();
+        expectLookupsMatchScan(set);
+        set.push_back(TAG_DIGEST, Digest::NONE);
+        set.Deduplicate();
+        expectLookupsMatchScan(set);
+        set.Filter([](const KeyParameter& param) { return param.tag != Tag::PURPOSE; });
+        expectLookupsMatchScan(set);
+
+        AuthorizationSet other = makeSetOfSize(size + 3);
+        expectLookupsMatchScan(other);
+        set = other;
+        expectLookupsMatchScan(set);
+        expectLookupsMatchScan(other);
+        set = makeSetOfSize(size + 7);
+        expectLookupsMatchScan(set);
+        set = std::move(other);
+        expectLookupsMatchScan(set);
+        expectLookupsMatchScan(other);
+        other.push_back(TAG_KEY_SIZE, 128u);
+        expectLookupsMatchScan(other);
+
+        std::vector<uint8_t> data = makeSetOfSize(size + 11).Serialize();
+        ASSERT_TRUE(set.Deserialize(data.data(), data.size()));
+        expectLookupsMatchScan(set);
+        ASSERT_TRUE(set.DeserializeView(kKnownEncoding.data(), kKnownEncoding.size()));
+        expectLookupsMatchScan(set);
+
+        set.Clear();
+        expectLookupsMatchScan(set);
+    }
+}
+
+TEST(AuthorizationSetTest, Subtract) {
+    for (size_t size : {5, 16, 50}) {
+        for (size_t otherSize : {0, 3, 16, 40}) {
+            SCOPED_TRACE(std::to_string(size) + " - " + std::to_string(otherSize));
+            AuthorizationSet set = makeSetOfSize(size);
+            AuthorizationSet other = makeSetOfSize(otherSize);
+            // Duplicates on both sides, and an entry that set doesn't have.
+            set.push_back(TAG_KEY_SIZE, 3u);
+            other.push_back(TAG_KEY_SIZE, 3u);
+            other.push_back(TAG_KEY_SIZE, 3u);
+            other.push_back(TAG_NO_AUTH_REQUIRED);
+
+            AuthorizationSet expected = referenceSubtract(set, other);
+            set.Subtract(other);
+            EXPECT_EQ(expected.hidl_data(), set.hidl_data());
+            expectLookupsMatchScan(set);
+        }
+    }
+}
+
+TEST(AuthorizationSetTest, SubtractSelf) {
+    AuthorizationSet set = makeSetOfSize(20);
+    set.Subtract(set);
+    EXPECT_TRUE(set.empty());
+    expectLookupsMatchScan(set);
+}
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
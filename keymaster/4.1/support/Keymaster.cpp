@@ -16,7 +16,11 @@
 
 #include <keymasterV4_1/Keymaster.h>
 
+#include <chrono>
+#include <future>
 #include <iomanip>
+#include <sstream>
+#include <string>
 
 #include <android-base/logging.h>
 #include <android/hidl/manager/1.2/IServiceManager.h>
@@ -72,6 +76,12 @@ namespace V4_1::support {
 
 using ::android::sp;
 using ::android::hidl::manager::V1_2::IServiceManager;
+using ::std::chrono::milliseconds;
+using ::std::chrono::steady_clock;
+
+// Keystore can't do without any of its keymasters, so devices that are slow to respond aren't
+// skipped, but every time this passes without an answer a warning is logged.
+constexpr milliseconds kDeviceWarningTimeout(5000);
 
 std::ostream& operator<<(std::ostream& os, const Keymaster& keymaster) {
     auto& version = keymaster.halVersion();
@@ -81,27 +91,69 @@ std::ostream& operator<<(std::ostream& os, const Keymaster& keymaster) {
     return os;
 }
 
+static int64_t msSince(steady_clock::time_point start) {
+    return std::chrono::duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+template <typename T>
+static T waitForDevice(std::future<T>& future, const std::string& what) {
+    auto start = steady_clock::now();
+    while (future.wait_for(kDeviceWarningTimeout) != std::future_status::ready) {
+        LOG(WARNING) << "Still waiting for " << what << " after " << msSince(start) << " ms";
+    }
+    return future.get();
+}
+
+template <typename Wrapper>
+static sp<Keymaster> getDevice(const hidl_string& name) {
+    auto start = steady_clock::now();
+    auto device = Wrapper::WrappedIKeymasterDevice::getService(name);
+    if (!device) return nullptr;
+    sp<Keymaster> keymaster = new Wrapper(device, name);
+    // The version is needed for sorting right afterwards, so fetch it while we're in parallel.
+    keymaster->halVersion();
+    LOG(INFO) << "Got " << *keymaster << " in " << msSince(start) << " ms";
+    return keymaster;
+}
+
 template <typename Wrapper>
 Keymaster::KeymasterSet enumerateDevices(const sp<IServiceManager>& serviceManager) {
     Keymaster::KeymasterSet result;
 
     bool foundDefault = false;
     auto& descriptor = Wrapper::WrappedIKeymasterDevice::descriptor;
+    std::vector<hidl_string> instanceNames;
     serviceManager->listManifestByInterface(descriptor, [&](const hidl_vec<hidl_string>& names) {
         for (auto& name : names) {
             if (name == "default") foundDefault = true;
-            auto device = Wrapper::WrappedIKeymasterDevice::getService(name);
-            CHECK(device) << "Failed to get service for " << descriptor << " with interface name "
-                          << name;
-            result.push_back(new Wrapper(device, name));
+            instanceNames.push_back(name);
         }
     });
 
+    // getService() blocks until the service is up, so wait for all instances at once instead of
+    // one after the other.
+    std::vector<std::future<sp<Keymaster>>> devices;
+    for (auto& name : instanceNames) {
+        devices.push_back(std::async(std::launch::async, getDevice<Wrapper>, name));
+    }
+    std::future<sp<Keymaster>> passthroughDevice;
     if (!foundDefault) {
         // "default" wasn't provided by listManifestByInterface.  Maybe there's a passthrough
         // implementation.
-        auto device = Wrapper::WrappedIKeymasterDevice::getService("default");
-        if (device) result.push_back(new Wrapper(device, "default"));
+        passthroughDevice =
+                std::async(std::launch::async, getDevice<Wrapper>, hidl_string("default"));
+    }
+
+    for (size_t i = 0; i < devices.size(); ++i) {
+        auto keymaster =
+                waitForDevice(devices[i], std::string(descriptor) + "/" + instanceNames[i].c_str());
+        CHECK(keymaster) << "Failed to get service for " << descriptor << " with interface name "
+                         << instanceNames[i];
+        result.push_back(keymaster);
+    }
+    if (passthroughDevice.valid()) {
+        auto keymaster = waitForDevice(passthroughDevice, std::string(descriptor) + "/default");
+        if (keymaster) result.push_back(keymaster);
     }
 
     return result;
@@ -121,11 +173,13 @@ void Keymaster::logIfKeymasterVendorError(ErrorCode ec) const {
 }
 
 Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
+    auto start = steady_clock::now();
     auto serviceManager = IServiceManager::getService();
     CHECK(serviceManager) << "Could not retrieve ServiceManager";
 
+    auto km3Devices = std::async(std::launch::async, enumerateDevices<Keymaster3>, serviceManager);
     auto km4s = enumerateDevices<Keymaster4>(serviceManager);
-    auto km3s = enumerateDevices<Keymaster3>(serviceManager);
+    auto km3s = km3Devices.get();
 
     auto result = std::move(km4s);
     result.insert(result.end(), std::make_move_iterator(km3s.begin()),
@@ -135,7 +189,7 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
               [](auto& a, auto& b) { return a->halVersion() > b->halVersion(); });
 
     size_t i = 1;
-    LOG(INFO) << "List of Keymaster HALs found:";
+    LOG(INFO) << "List of Keymaster HALs found in " << msSince(start) << " ms:";
     for (auto& hal : result) LOG(INFO) << "Keymaster HAL #" << i++ << ": " << *hal;
 
     return result;
@@ -143,17 +197,32 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
 
 static hidl_vec<HmacSharingParameters> getHmacParameters(
         const Keymaster::KeymasterSet& keymasters) {
-    std::vector<HmacSharingParameters> params_vec;
-    params_vec.reserve(keymasters.size());
+    std::vector<std::pair<const Keymaster*, std::future<HmacSharingParameters>>> requests;
     for (auto& keymaster : keymasters) {
         if (keymaster->halVersion().majorVersion < 4) continue;
-        auto rc = keymaster->getHmacSharingParameters([&](auto error, auto& params) {
-            CHECK(error == V4_0::ErrorCode::OK)
-                    << "Failed to get HMAC parameters from " << *keymaster << " error " << error;
-            params_vec.push_back(params);
-        });
-        CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
-                         << " error: " << rc.description();
+        auto request = [keymaster = keymaster.get()] {
+            auto start = steady_clock::now();
+            HmacSharingParameters result;
+            auto rc = keymaster->getHmacSharingParameters([&](auto error, auto& params) {
+                CHECK(error == V4_0::ErrorCode::OK) << "Failed to get HMAC parameters from "
+                                                    << *keymaster << " error " << error;
+                result = params;
+            });
+            CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
+                             << " error: " << rc.description();
+            LOG(INFO) << "Got HMAC parameters from " << *keymaster << " in " << msSince(start)
+                      << " ms";
+            return result;
+        };
+        requests.emplace_back(keymaster.get(), std::async(std::launch::async, request));
+    }
+
+    std::vector<HmacSharingParameters> params_vec;
+    params_vec.reserve(requests.size());
+    for (auto& [keymaster, params] : requests) {
+        std::stringstream what;
+        what << "HMAC parameters from " << *keymaster;
+        params_vec.push_back(waitForDevice(params, what.str()));
     }
     std::sort(params_vec.begin(), params_vec.end());
 
@@ -164,32 +233,49 @@ static void computeHmac(const Keymaster::KeymasterSet& keymasters,
                         const hidl_vec<HmacSharingParameters>& params) {
     if (!params.size()) return;
 
-    hidl_vec<uint8_t> sharingCheck;
-    bool firstKeymaster = true;
     LOG(DEBUG) << "Computing HMAC with params " << params;
+    std::vector<std::pair<const Keymaster*, std::future<hidl_vec<uint8_t>>>> requests;
     for (auto& keymaster : keymasters) {
         if (keymaster->halVersion().majorVersion < 4) continue;
-        LOG(DEBUG) << "Computing HMAC for " << *keymaster;
-        auto rc = keymaster->computeSharedHmac(
-                params, [&](V4_0::ErrorCode error, const hidl_vec<uint8_t>& curSharingCheck) {
-                    CHECK(error == V4_0::ErrorCode::OK) << "Failed to get HMAC parameters from "
-                                                        << *keymaster << " error " << error;
-                    if (firstKeymaster) {
+        auto request = [keymaster = keymaster.get(), &params] {
+            auto start = steady_clock::now();
+            LOG(DEBUG) << "Computing HMAC for " << *keymaster;
+            hidl_vec<uint8_t> sharingCheck;
+            auto rc = keymaster->computeSharedHmac(
+                    params, [&](V4_0::ErrorCode error, const hidl_vec<uint8_t>& curSharingCheck) {
+                        CHECK(error == V4_0::ErrorCode::OK) << "Failed to get HMAC parameters from "
+                                                            << *keymaster << " error " << error;
                         sharingCheck = curSharingCheck;
-                        firstKeymaster = false;
-                    }
-                    if (curSharingCheck != sharingCheck)
-                        LOG(WARNING) << "HMAC computation failed for " << *keymaster  //
-                                     << " Expected: " << sharingCheck                 //
-                                     << " got: " << curSharingCheck;
-                });
-        CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
-                         << " error: " << rc.description();
+                    });
+            CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
+                             << " error: " << rc.description();
+            LOG(INFO) << "Computed HMAC for " << *keymaster << " in " << msSince(start) << " ms";
+            return sharingCheck;
+        };
+        requests.emplace_back(keymaster.get(), std::async(std::launch::async, request));
+    }
+
+    hidl_vec<uint8_t> sharingCheck;
+    bool firstKeymaster = true;
+    for (auto& [keymaster, result] : requests) {
+        std::stringstream what;
+        what << "HMAC computation by " << *keymaster;
+        hidl_vec<uint8_t> curSharingCheck = waitForDevice(result, what.str());
+        if (firstKeymaster) {
+            sharingCheck = curSharingCheck;
+            firstKeymaster = false;
+        }
+        if (curSharingCheck != sharingCheck)
+            LOG(WARNING) << "HMAC computation failed for " << *keymaster  //
+                         << " Expected: " << sharingCheck                 //
+                         << " got: " << curSharingCheck;
     }
 }
 
 void Keymaster::performHmacKeyAgreement(const KeymasterSet& keymasters) {
+    auto start = steady_clock::now();
     computeHmac(keymasters, getHmacParameters(keymasters));
+    LOG(INFO) << "HMAC key agreement took " << msSince(start) << " ms";
 }
 
 }  // namespace V4_1::support
@@ -17,7 +17,9 @@
 #define LOG_TAG "android.hardware.tv.tuner@1.0-Demux"
 
 #include "Demux.h"
+#include <inttypes.h>
 #include <utils/Log.h>
+#include <algorithm>
 
 namespace android {
 namespace hardware {
@@ -26,8 +28,6 @@ namespace tuner {
 namespace V1_0 {
 namespace implementation {
 
-#define WAIT_TIMEOUT 3000000000
-
 Demux::Demux(uint32_t demuxId, sp<Tuner> tuner) {
     mDemuxId = demuxId;
     mTunerService = tuner;
@@ -161,6 +161,13 @@ Return<Result> Demux::close() {
     }
     mPlaybackFilterIds.clear();
     mRecordFilterIds.clear();
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        for (auto& bucket : mPidFilters) {
+            bucket.clear();
+        }
+        mIndexedFilterTpids.clear();
+    }
     mFilters.clear();
     mLastUsedFilterId = -1;
 
@@ -233,22 +240,88 @@ Result Demux::removeFilter(uint32_t filterId) {
     }
     mPlaybackFilterIds.erase(filterId);
     mRecordFilterIds.erase(filterId);
+    {
+        std::lock_guard<std::mutex> lock(mPidTableLock);
+        unindexFilterTpid(filterId);
+    }
     mFilters.erase(filterId);
 
     return Result::SUCCESS;
 }
 
+void Demux::updateFilterTpid(uint32_t filterId, uint16_t tpid) {
+    if (mPlaybackFilterIds.find(filterId) == mPlaybackFilterIds.end()) {
+        // Record filters take the whole input and are not dispatched by PID.
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    unindexFilterTpid(filterId);
+    uint16_t pid = tpid & (TS_PID_TABLE_SIZE - 1);
+    mPidFilters[pid].push_back(mFilters[filterId]);
+    mIndexedFilterTpids[filterId] = pid;
+}
+
+void Demux::unindexFilterTpid(uint32_t filterId) {
+    map<uint32_t, uint16_t>::iterator it = mIndexedFilterTpids.find(filterId);
+    if (it == mIndexedFilterTpids.end()) {
+        return;
+    }
+
+    vector<sp<Filter>>& bucket = mPidFilters[it->second];
+    sp<Filter> filter = mFilters[filterId];
+    bucket.erase(std::remove(bucket.begin(), bucket.end(), filter), bucket.end());
+    mIndexedFilterTpids.erase(it);
+}
+
 void Demux::startBroadcastTsFilter(vector<uint8_t> data) {
-    set<uint32_t>::iterator it;
+    if (data.size() < 4) {
+        return;
+    }
     uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
     if (DEBUG_DEMUX) {
         ALOGW("[Demux] start ts filter pid: %d", pid);
     }
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updateFilterOutput(data);
+
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    updatePidStats(pid, data);
+    for (const sp<Filter>& filter : mPidFilters[pid]) {
+        filter->updateFilterOutput(data);
+    }
+}
+
+void Demux::updatePidStats(uint16_t pid, const vector<uint8_t>& data) {
+    PidStats& stats = mPidStats[pid];
+    stats.packets++;
+
+    // The continuity counter only increments on packets carrying a payload.
+    // A single duplicate packet with the same counter is allowed by ISO/IEC 13818-1.
+    if ((data[3] & 0x10) == 0) {
+        return;
+    }
+    int8_t continuityCounter = data[3] & 0x0f;
+    if (stats.lastContinuityCounter >= 0 && continuityCounter != stats.lastContinuityCounter &&
+        continuityCounter != ((stats.lastContinuityCounter + 1) & 0x0f)) {
+        stats.continuityErrors++;
+        if (DEBUG_DEMUX) {
+            ALOGW("[Demux] continuity error on pid %d: expected %d, got %d", pid,
+                  (stats.lastContinuityCounter + 1) & 0x0f, continuityCounter);
         }
     }
+    stats.lastContinuityCounter = continuityCounter;
+}
+
+void Demux::dumpPidStats(int fd) {
+    std::lock_guard<std::mutex> lock(mPidTableLock);
+    dprintf(fd, "Demux %d PID stats:\n", mDemuxId);
+    for (uint32_t pid = 0; pid < TS_PID_TABLE_SIZE; pid++) {
+        const PidStats& stats = mPidStats[pid];
+        if (stats.packets == 0 && mPidFilters[pid].empty()) {
+            continue;
+        }
+        dprintf(fd, "  pid 0x%04x: filters %zu, packets %" PRIu64 ", continuity errors %" PRIu64
+                "\n", pid, mPidFilters[pid].size(), stats.packets, stats.continuityErrors);
+    }
 }
 
 void Demux::sendFrontendInputToRecord(vector<uint8_t> data) {
@@ -299,6 +372,8 @@ uint16_t Demux::getFilterTpid(uint32_t filterId) {
 }
 
 void Demux::startFrontendInputLoop() {
+    // Set before the thread starts so that a quick stopFrontendInput() is never missed
+    mFrontendInputThreadRunning = true;
     pthread_create(&mFrontendInputThread, NULL, __threadLoopFrontend, this);
     pthread_setname_np(mFrontendInputThread, "frontend_input_thread");
 }
@@ -311,17 +386,20 @@ void* Demux::__threadLoopFrontend(void* user) {
 
 void Demux::frontendInputThreadLoop() {
     std::lock_guard<std::mutex> lock(mFrontendInputThreadLock);
-    mFrontendInputThreadRunning = true;
 
     while (mFrontendInputThreadRunning) {
         uint32_t efState = 0;
+        // No timeout is needed since stopFrontendInput() wakes the flag
         status_t status = mDvrPlayback->getDvrEventFlag()->wait(
-                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY), &efState, WAIT_TIMEOUT,
-                true /* retry on spurious wake */);
+                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY), &efState,
+                0 /* no timeout */, true /* retry on spurious wake */);
         if (status != OK) {
             ALOGD("[Demux] wait for data ready on the playback FMQ");
             continue;
         }
+        if (!mFrontendInputThreadRunning) {
+            break;
+        }
         // Our current implementation filter the data and write it into the filter FMQ immediately
         // after the DATA_READY from the VTS/framework
         if (!mDvrPlayback->readPlaybackFMQ(true /*isVirtualFrontend*/, mIsRecording) ||
@@ -339,6 +417,11 @@ void Demux::stopFrontendInput() {
     ALOGD("[Demux] stop frontend on demux");
     mKeepFetchingDataFromFrontend = false;
     mFrontendInputThreadRunning = false;
+    if (mDvrPlayback != nullptr && mDvrPlayback->getDvrEventFlag() != nullptr) {
+        // Wake the frontend input thread so it can see that it should exit
+        mDvrPlayback->getDvrEventFlag()->wake(
+                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+    }
     std::lock_guard<std::mutex> lock(mFrontendInputThreadLock);
 }
 
@@ -20,6 +20,8 @@
 #include <android/hardware/tv/tuner/1.0/IDemux.h>
 #include <fmq/MessageQueue.h>
 #include <math.h>
+#include <array>
+#include <atomic>
 #include <set>
 #include "Dvr.h"
 #include "Filter.h"
@@ -47,6 +49,9 @@ using ::android::hardware::tv::tuner::V1_0::Result;
 
 using FilterMQ = MessageQueue<uint8_t, kSynchronizedReadWrite>;
 
+// TS PIDs are 13 bits wide
+#define TS_PID_TABLE_SIZE 0x2000
+
 class Dvr;
 class Filter;
 class Frontend;
@@ -88,6 +93,11 @@ class Demux : public IDemux {
     Result startFilterHandler(uint32_t filterId);
     void updateFilterOutput(uint16_t filterId, vector<uint8_t> data);
     uint16_t getFilterTpid(uint32_t filterId);
+    /**
+     * Re-index a playback filter in the PID table after its tpid has been configured.
+     */
+    void updateFilterTpid(uint32_t filterId, uint16_t tpid);
+    void dumpPidStats(int fd);
     void setIsRecording(bool isRecording);
     void startFrontendInputLoop();
 
@@ -128,6 +138,12 @@ class Demux : public IDemux {
     void deleteEventFlag();
     bool readDataFromMQ();
 
+    /**
+     * Remove a filter from the PID table bucket it is currently indexed in, if any.
+     */
+    void unindexFilterTpid(uint32_t filterId);
+    void updatePidStats(uint16_t pid, const vector<uint8_t>& data);
+
     uint32_t mDemuxId;
     uint32_t mCiCamId;
     set<uint32_t> mPcrFilterIds;
@@ -152,6 +168,31 @@ class Demux : public IDemux {
      */
     std::map<uint32_t, sp<Filter>> mFilters;
 
+    /**
+     * Per PID debugging counters, updated on every dispatched TS packet.
+     */
+    struct PidStats {
+        uint64_t packets = 0;
+        uint64_t continuityErrors = 0;
+        // -1 until the first packet with payload is seen on the PID.
+        int8_t lastContinuityCounter = -1;
+    };
+    /**
+     * PID table to dispatch TS packets to the started playback filters in O(1).
+     * The array index is the 13-bit TS PID. Record filters are not indexed since
+     * they take the whole input stream.
+     */
+    array<vector<sp<Filter>>, TS_PID_TABLE_SIZE> mPidFilters;
+    array<PidStats, TS_PID_TABLE_SIZE> mPidStats;
+    /**
+     * The PID table bucket each indexed filter currently sits in.
+     */
+    std::map<uint32_t, uint16_t> mIndexedFilterTpids;
+    /**
+     * Lock to protect the PID table against filter configure/close
+     */
+    std::mutex mPidTableLock;
+
     /**
      * Local reference to the opened Timer Filter instance.
      */
@@ -168,7 +209,7 @@ class Demux : public IDemux {
     /**
      * If a specific filter's writing loop is still running
      */
-    bool mFrontendInputThreadRunning;
+    std::atomic<bool> mFrontendInputThreadRunning{false};
     bool mKeepFetchingDataFromFrontend;
     /**
      * If the dvr recording is running.
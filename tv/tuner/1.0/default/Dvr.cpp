@@ -26,8 +26,6 @@ namespace tuner {
 namespace V1_0 {
 namespace implementation {
 
-#define WAIT_TIMEOUT 3000000000
-
 Dvr::Dvr() {}
 
 Dvr::Dvr(DvrType type, uint32_t bufferSize, const sp<IDvrCallback>& cb, sp<Demux> demux) {
@@ -112,6 +110,8 @@ Return<Result> Dvr::start() {
     }
 
     if (mType == DvrType::PLAYBACK) {
+        // Set before the thread starts so that a quick stop() is never missed
+        mDvrThreadRunning = true;
         pthread_create(&mDvrThread, NULL, __threadLoopPlayback, this);
         pthread_setname_np(mDvrThread, "playback_waiting_loop");
     } else if (mType == DvrType::RECORD) {
@@ -128,6 +128,10 @@ Return<Result> Dvr::stop() {
     ALOGV("%s", __FUNCTION__);
 
     mDvrThreadRunning = false;
+    if (mType == DvrType::PLAYBACK && mDvrEventFlag != nullptr) {
+        // Wake the playback thread so it can see that it should exit
+        mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+    }
 
     std::lock_guard<std::mutex> lock(mDvrThreadLock);
 
@@ -184,17 +188,20 @@ void* Dvr::__threadLoopPlayback(void* user) {
 void Dvr::playbackThreadLoop() {
     ALOGD("[Dvr] playback threadLoop start.");
     std::lock_guard<std::mutex> lock(mDvrThreadLock);
-    mDvrThreadRunning = true;
 
     while (mDvrThreadRunning) {
         uint32_t efState = 0;
+        // No timeout is needed since stop() wakes the flag
         status_t status =
                 mDvrEventFlag->wait(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY),
-                                    &efState, WAIT_TIMEOUT, true /* retry on spurious wake */);
+                                    &efState, 0 /* no timeout */, true /* retry on spurious wake */);
         if (status != OK) {
             ALOGD("[Dvr] wait for data ready on the playback FMQ");
             continue;
         }
+        if (!mDvrThreadRunning) {
+            break;
+        }
         // Our current implementation filter the data and write it into the filter FMQ immediately
         // after the DATA_READY from the VTS/framework
         if (!readPlaybackFMQ(false /*isVirtualFrontend*/, false /*isRecording*/) ||
@@ -264,16 +271,8 @@ bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
 }
 
 void Dvr::startTpidFilter(vector<uint8_t> data) {
-    std::map<uint32_t, sp<IFilter>>::iterator it;
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_DVR) {
-            ALOGW("[Dvr] start ts filter pid: %d", pid);
-        }
-        if (pid == mDemux->getFilterTpid(it->first)) {
-            mDemux->updateFilterOutput(it->first, data);
-        }
-    }
+    // The demux PID table indexes the same playback filters this DVR was given
+    mDemux->startBroadcastTsFilter(data);
 }
 
 bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
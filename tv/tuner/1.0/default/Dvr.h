@@ -20,6 +20,7 @@
 #include <android/hardware/tv/tuner/1.0/IDvr.h>
 #include <fmq/MessageQueue.h>
 #include <math.h>
+#include <atomic>
 #include <set>
 #include "Demux.h"
 #include "Frontend.h"
@@ -115,7 +116,7 @@ class Dvr : public IDvr {
     void recordThreadLoop();
 
     unique_ptr<DvrMQ> mDvrMQ;
-    EventFlag* mDvrEventFlag;
+    EventFlag* mDvrEventFlag = nullptr;
     /**
      * Demux callbacks used on filter events or IO buffer status
      */
@@ -131,7 +132,7 @@ class Dvr : public IDvr {
     /**
      * If a specific filter's writing loop is still running
      */
-    bool mDvrThreadRunning;
+    std::atomic<bool> mDvrThreadRunning{false};
     bool mKeepFetchingDataFromFrontend;
     /**
      * Lock to protect writes to the FMQs
@@ -26,8 +26,6 @@ namespace tuner {
 namespace V1_0 {
 namespace implementation {
 
-#define WAIT_TIMEOUT 3000000000
-
 Filter::Filter() {}
 
 Filter::Filter(DemuxFilterType type, uint32_t filterId, uint32_t bufferSize,
@@ -71,7 +69,9 @@ Filter::Filter(DemuxFilterType type, uint32_t filterId, uint32_t bufferSize,
     }
 }
 
-Filter::~Filter() {}
+Filter::~Filter() {
+    releaseAvArena();
+}
 
 Return<void> Filter::getId(getId_cb _hidl_cb) {
     ALOGV("%s", __FUNCTION__);
@@ -102,9 +102,11 @@ Return<Result> Filter::configure(const DemuxFilterSettings& settings) {
     ALOGV("%s", __FUNCTION__);
 
     mFilterSettings = settings;
+    restartPesAssembly();
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
             mTpid = settings.ts().tpid;
+            mDemux->updateFilterTpid(mFilterId, mTpid);
             break;
         case DemuxFilterMainType::MMTP:
             break;
@@ -124,13 +126,22 @@ Return<Result> Filter::configure(const DemuxFilterSettings& settings) {
 Return<Result> Filter::start() {
     ALOGV("%s", __FUNCTION__);
 
+    restartPesAssembly();
     return startFilterLoop();
 }
 
 Return<Result> Filter::stop() {
     ALOGV("%s", __FUNCTION__);
 
-    mFilterThreadRunning = false;
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        mFilterThreadRunning = false;
+    }
+    // Wake the filter thread from whichever wait it is blocked in
+    mFilterEventCondition.notify_all();
+    if (mFilterEventFlag != nullptr) {
+        mFilterEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+    }
 
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
 
@@ -145,6 +156,7 @@ Return<Result> Filter::flush() {
     char* buffer = new char[size];
     mFilterMQ->read((unsigned char*)&buffer[0], size);
     delete[] buffer;
+    restartPesAssembly();
     mFilterStatus = DemuxFilterStatus::DATA_READY;
 
     return Result::SUCCESS;
@@ -152,12 +164,17 @@ Return<Result> Filter::flush() {
 
 Return<Result> Filter::releaseAvHandle(const hidl_handle& /*avMemory*/, uint64_t avDataId) {
     ALOGV("%s", __FUNCTION__);
-    if (mDataId2Avfd.find(avDataId) == mDataId2Avfd.end()) {
-        return Result::INVALID_ARGUMENT;
+
+    std::lock_guard<std::mutex> lock(mAvArenaLock);
+    for (AvRegion& region : mAvRegions) {
+        if (region.dataId == avDataId && !region.released) {
+            region.released = true;
+            recycleAvRegions();
+            return Result::SUCCESS;
+        }
     }
 
-    ::close(mDataId2Avfd[avDataId]);
-    return Result::SUCCESS;
+    return Result::INVALID_ARGUMENT;
 }
 
 Return<Result> Filter::close() {
@@ -187,6 +204,8 @@ bool Filter::createFilterMQ() {
 }
 
 Result Filter::startFilterLoop() {
+    // Set before the thread starts so that a quick stop() is never missed
+    mFilterThreadRunning = true;
     pthread_create(&mFilterThread, NULL, __threadLoopFilter, this);
     pthread_setname_np(mFilterThread, "filter_waiting_loop");
 
@@ -202,80 +221,66 @@ void* Filter::__threadLoopFilter(void* user) {
 void Filter::filterThreadLoop() {
     ALOGD("[Filter] filter %d threadLoop start.", mFilterId);
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
-    mFilterThreadRunning = true;
 
+    DemuxFilterEvent filterEvent;
     // For the first time of filter output, implementation needs to send the filter
     // Event Callback without waiting for the DATA_CONSUMED to init the process.
-    while (mFilterThreadRunning) {
-        if (mFilterEvent.events.size() == 0) {
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] wait for filter data output.");
+    if (waitForFilterEvent(filterEvent)) {
+        mCallback->onFilterEvent(filterEvent);
+        mFilterStatus = DemuxFilterStatus::DATA_READY;
+        mCallback->onFilterStatus(mFilterStatus);
+    }
+
+    // We do not wait for the last round of written data to be read to finish the thread
+    // because the VTS can verify the reading itself.
+    for (int i = 0; i < SECTION_WRITE_COUNT && mFilterThreadRunning; i++) {
+        while (mFilterThreadRunning && mIsUsingFMQ) {
+            uint32_t efState = 0;
+            // No timeout is needed since stop() wakes the flag
+            status_t status = mFilterEventFlag->wait(
+                    static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
+                    0 /* no timeout */, true /* retry on spurious wake */);
+            if (status != OK) {
+                ALOGD("[Filter] wait for data consumed");
+                continue;
             }
-            usleep(1000 * 1000);
-            continue;
+            break;
         }
-        // After successfully write, send a callback and wait for the read to be done
-        mCallback->onFilterEvent(mFilterEvent);
-        freeAvHandle();
-        mFilterEvent.events.resize(0);
-        mFilterStatus = DemuxFilterStatus::DATA_READY;
-        if (mCallback == nullptr) {
-            ALOGD("[Filter] filter %d does not hava callback. Ending thread", mFilterId);
+        if (!mFilterThreadRunning) {
             break;
         }
-        mCallback->onFilterStatus(mFilterStatus);
-        break;
-    }
-
-    while (mFilterThreadRunning) {
-        uint32_t efState = 0;
-        // We do not wait for the last round of written data to be read to finish the thread
-        // because the VTS can verify the reading itself.
-        for (int i = 0; i < SECTION_WRITE_COUNT; i++) {
-            while (mFilterThreadRunning && mIsUsingFMQ) {
-                status_t status = mFilterEventFlag->wait(
-                        static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
-                        WAIT_TIMEOUT, true /* retry on spurious wake */);
-                if (status != OK) {
-                    ALOGD("[Filter] wait for data consumed");
-                    continue;
-                }
-                break;
-            }
 
-            maySendFilterStatusCallback();
+        maySendFilterStatusCallback();
 
-            while (mFilterThreadRunning) {
-                std::lock_guard<std::mutex> lock(mFilterEventLock);
-                if (mFilterEvent.events.size() == 0) {
-                    continue;
-                }
-                // After successfully write, send a callback and wait for the read to be done
-                mCallback->onFilterEvent(mFilterEvent);
-                mFilterEvent.events.resize(0);
-                break;
-            }
-            // We do not wait for the last read to be done
-            // VTS can verify the read result itself.
-            if (i == SECTION_WRITE_COUNT - 1) {
-                ALOGD("[Filter] filter %d writing done. Ending thread", mFilterId);
-                break;
-            }
+        // After successfully write, send a callback and wait for the read to be done
+        if (!waitForFilterEvent(filterEvent)) {
+            break;
+        }
+        mCallback->onFilterEvent(filterEvent);
+        // We do not wait for the last read to be done
+        // VTS can verify the read result itself.
+        if (i == SECTION_WRITE_COUNT - 1) {
+            ALOGD("[Filter] filter %d writing done. Ending thread", mFilterId);
         }
-        mFilterThreadRunning = false;
     }
+    mFilterThreadRunning = false;
 
     ALOGD("[Filter] filter thread ended.");
 }
 
-void Filter::freeAvHandle() {
-    if (!mIsMediaFilter) {
-        return;
-    }
-    for (int i = 0; i < mFilterEvent.events.size(); i++) {
-        ::close(mFilterEvent.events[i].media().avMemory.getNativeHandle()->data[0]);
-        native_handle_close(mFilterEvent.events[i].media().avMemory.getNativeHandle());
+bool Filter::waitForFilterEvent(DemuxFilterEvent& filterEvent) {
+    std::unique_lock<std::mutex> lock(mFilterEventLock);
+    mFilterEventCondition.wait(
+            lock, [this] { return !mFilterThreadRunning || mFilterEvent.events.size() > 0; });
+    if (!mFilterThreadRunning) {
+        return false;
     }
+
+    // Hand the pending events over so that the callback is sent without holding the lock.
+    // The AV handles in the events are owned and closed with filterEvent.
+    filterEvent.events = std::move(mFilterEvent.events);
+    mFilterEvent.events.resize(0);
+    return true;
 }
 
 void Filter::maySendFilterStatusCallback() {
@@ -367,6 +372,8 @@ Result Filter::startFilterHandler() {
         default:
             break;
     }
+    // Wake the filter thread for any event the handlers created
+    mFilterEventCondition.notify_one();
     return Result::SUCCESS;
 }
 
@@ -390,59 +397,12 @@ Result Filter::startPesFilterHandler() {
         return Result::SUCCESS;
     }
 
-    for (int i = 0; i < mFilterOutput.size(); i += 188) {
-        if (mPesSizeLeft == 0) {
-            uint32_t prefix = (mFilterOutput[i + 4] << 16) | (mFilterOutput[i + 5] << 8) |
-                              mFilterOutput[i + 6];
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] prefix %d", prefix);
-            }
-            if (prefix == 0x000001) {
-                // TODO handle mulptiple Pes filters
-                mPesSizeLeft = (mFilterOutput[i + 8] << 8) | mFilterOutput[i + 9];
-                mPesSizeLeft += 6;
-                if (DEBUG_FILTER) {
-                    ALOGD("[Filter] pes data length %d", mPesSizeLeft);
-                }
-            } else {
-                continue;
-            }
-        }
-
-        int endPoint = min(184, mPesSizeLeft);
-        // append data and check size
-        vector<uint8_t>::const_iterator first = mFilterOutput.begin() + i + 4;
-        vector<uint8_t>::const_iterator last = mFilterOutput.begin() + i + 4 + endPoint;
-        mPesOutput.insert(mPesOutput.end(), first, last);
-        // size does not match then continue
-        mPesSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] pes data left %d", mPesSizeLeft);
-        }
-        if (mPesSizeLeft > 0) {
-            continue;
-        }
-        // size match then create event
-        if (!writeDataToFilterMQ(mPesOutput)) {
-            ALOGD("[Filter] pes data write failed");
+    for (int i = 0; i + TS_PACKET_SIZE <= mFilterOutput.size(); i += TS_PACKET_SIZE) {
+        Result result = assemblePesPacket(&mFilterOutput[i]);
+        if (result != Result::SUCCESS) {
             mFilterOutput.clear();
-            return Result::INVALID_STATE;
-        }
-        maySendFilterStatusCallback();
-        DemuxFilterPesEvent pesEvent;
-        pesEvent = {
-                // temp dump meta data
-                .streamId = mPesOutput[3],
-                .dataLength = static_cast<uint16_t>(mPesOutput.size()),
-        };
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] assembled pes data length %d", pesEvent.dataLength);
+            return result;
         }
-
-        int size = mFilterEvent.events.size();
-        mFilterEvent.events.resize(size + 1);
-        mFilterEvent.events[size].pes(pesEvent);
-        mPesOutput.clear();
     }
 
     mFilterOutput.clear();
@@ -456,88 +416,267 @@ Result Filter::startTsFilterHandler() {
 }
 
 Result Filter::startMediaFilterHandler() {
-    std::lock_guard<std::mutex> lock(mFilterEventLock);
-    if (mFilterOutput.empty()) {
+    // The reassembler writes media filter payloads into the AV arena instead of mPesOutput
+    return startPesFilterHandler();
+}
+
+Result Filter::assemblePesPacket(const uint8_t* packet) {
+    if (packet[0] != 0x47) {
+        ALOGW("[Filter] filter %d lost TS sync", mFilterId);
+        resetPes();
         return Result::SUCCESS;
     }
-    for (int i = 0; i < mFilterOutput.size(); i += 188) {
-        if (mPesSizeLeft == 0) {
-            uint32_t prefix = (mFilterOutput[i + 4] << 16) | (mFilterOutput[i + 5] << 8) |
-                              mFilterOutput[i + 6];
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] prefix %d", prefix);
-            }
-            if (prefix == 0x000001) {
-                // TODO handle mulptiple Pes filters
-                mPesSizeLeft = (mFilterOutput[i + 8] << 8) | mFilterOutput[i + 9];
-                mPesSizeLeft += 6;
-                if (DEBUG_FILTER) {
-                    ALOGD("[Filter] pes data length %d", mPesSizeLeft);
-                }
+
+    bool payloadUnitStart = (packet[1] & 0x40) != 0;
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x03;
+    int8_t continuityCounter = packet[3] & 0x0f;
+    if ((adaptationFieldControl & 0x01) == 0) {
+        // Adaptation field only, the continuity counter does not increment
+        return Result::SUCCESS;
+    }
+    if (mLastContinuityCounter != kContinuityCounterUnset) {
+        if (continuityCounter == mLastContinuityCounter) {
+            // Duplicate packet
+            return Result::SUCCESS;
+        }
+        if (continuityCounter != ((mLastContinuityCounter + 1) & 0x0f) && mPesStarted) {
+            ALOGW("[Filter] filter %d continuity error, dropping partial pes", mFilterId);
+            resetPes();
+        }
+    }
+    mLastContinuityCounter = continuityCounter;
+
+    uint32_t payloadOffset = 4;
+    if (adaptationFieldControl & 0x02) {
+        payloadOffset += 1 + packet[4];
+    }
+    if (payloadOffset >= TS_PACKET_SIZE) {
+        return Result::SUCCESS;
+    }
+    const uint8_t* payload = packet + payloadOffset;
+    uint32_t payloadSize = TS_PACKET_SIZE - payloadOffset;
+
+    if (payloadUnitStart) {
+        if (mPesStarted) {
+            if (!mPesUnbounded) {
+                ALOGW("[Filter] filter %d pes truncated, %d bytes missing", mFilterId,
+                      mPesSizeLeft);
+                resetPes();
             } else {
-                continue;
+                Result result = finishPes();
+                if (result != Result::SUCCESS) {
+                    return result;
+                }
             }
         }
 
-        int endPoint = min(184, mPesSizeLeft);
-        // append data and check size
-        vector<uint8_t>::const_iterator first = mFilterOutput.begin() + i + 4;
-        vector<uint8_t>::const_iterator last = mFilterOutput.begin() + i + 4 + endPoint;
-        mPesOutput.insert(mPesOutput.end(), first, last);
-        // size does not match then continue
-        mPesSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] pes data left %d", mPesSizeLeft);
+        uint32_t prefix = (payload[0] << 16) | (payload[1] << 8) | payload[2];
+        if (payloadSize < 6 || prefix != 0x000001) {
+            return Result::SUCCESS;
         }
-        if (mPesSizeLeft > 0 || mAvBufferCopyCount++ < 10) {
-            continue;
+        mPesStarted = true;
+        mPesStreamId = payload[3];
+        uint16_t pesPacketLength = (payload[4] << 8) | payload[5];
+        mPesUnbounded = pesPacketLength == 0;
+        mPesSizeLeft = pesPacketLength + 6;
+        // PTS_DTS_flags of the optional PES header
+        mPesPtsPresent = payloadSize >= 14 && (payload[7] & 0x80) != 0;
+        if (mPesPtsPresent) {
+            mPesPts = (static_cast<uint64_t>((payload[9] >> 1) & 0x07) << 30) |
+                      (payload[10] << 22) | ((payload[11] >> 1) << 15) | (payload[12] << 7) |
+                      (payload[13] >> 1);
         }
-
-        int av_fd = createAvIonFd(mPesOutput.size());
-        if (av_fd == -1) {
-            return Result::UNKNOWN_ERROR;
-        }
-        // copy the filtered data to the buffer
-        uint8_t* avBuffer = getIonBuffer(av_fd, mPesOutput.size());
-        if (avBuffer == NULL) {
-            return Result::UNKNOWN_ERROR;
+        if (DEBUG_FILTER) {
+            ALOGD("[Filter] pes data length %d", mPesUnbounded ? -1 : mPesSizeLeft);
         }
-        memcpy(avBuffer, mPesOutput.data(), mPesOutput.size() * sizeof(uint8_t));
+    } else if (!mPesStarted) {
+        return Result::SUCCESS;
+    }
+
+    uint32_t size = mPesUnbounded ? payloadSize : min(payloadSize, (uint32_t)mPesSizeLeft);
+    if (!appendPesPayload(payload, size)) {
+        ALOGW("[Filter] filter %d out of pes buffer space, dropping pes", mFilterId);
+        resetPes();
+        return Result::SUCCESS;
+    }
+    if (mPesUnbounded) {
+        return Result::SUCCESS;
+    }
 
-        native_handle_t* nativeHandle = createNativeHandle(av_fd);
-        if (nativeHandle == NULL) {
-            return Result::UNKNOWN_ERROR;
+    mPesSizeLeft -= size;
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] pes data left %d", mPesSizeLeft);
+    }
+    if (mPesSizeLeft > 0) {
+        return Result::SUCCESS;
+    }
+    return finishPes();
+}
+
+bool Filter::appendPesPayload(const uint8_t* data, uint32_t size) {
+    if (mIsMediaFilter) {
+        if (!appendToAvArena(data, size)) {
+            return false;
         }
-        hidl_handle handle;
-        handle.setTo(nativeHandle, /*shouldOwn=*/true);
-
-        // Create a dataId and add a <dataId, av_fd> pair into the dataId2Avfd map
-        uint64_t dataId = mLastUsedDataId++ /*createdUID*/;
-        mDataId2Avfd[dataId] = dup(av_fd);
-
-        // Create mediaEvent and send callback
-        DemuxFilterMediaEvent mediaEvent;
-        mediaEvent = {
-                .avMemory = std::move(handle),
-                .dataLength = static_cast<uint32_t>(mPesOutput.size()),
-                .avDataId = dataId,
-        };
-        int size = mFilterEvent.events.size();
-        mFilterEvent.events.resize(size + 1);
-        mFilterEvent.events[size].media(mediaEvent);
-
-        // Clear and log
-        mPesOutput.clear();
-        mAvBufferCopyCount = 0;
+    } else {
+        mPesOutput.insert(mPesOutput.end(), data, data + size);
+    }
+    mPesLength += size;
+    return true;
+}
+
+Result Filter::finishPes() {
+    Result result = mIsMediaFilter ? createMediaEvent() : createPesEvent();
+    resetPes();
+    return result;
+}
+
+void Filter::resetPes() {
+    mPesStarted = false;
+    mPesUnbounded = false;
+    mPesSizeLeft = 0;
+    mPesLength = 0;
+    mPesPtsPresent = false;
+    mPesOutput.clear();
+}
+
+void Filter::restartPesAssembly() {
+    // Same lock order as startFilterHandler()
+    std::lock_guard<std::mutex> outputLock(mFilterOutputLock);
+    std::lock_guard<std::mutex> eventLock(mFilterEventLock);
+    resetPes();
+    mLastContinuityCounter = kContinuityCounterUnset;
+}
+
+Result Filter::createPesEvent() {
+    if (!writeDataToFilterMQ(mPesOutput)) {
+        ALOGD("[Filter] pes data write failed");
+        return Result::INVALID_STATE;
+    }
+    maySendFilterStatusCallback();
+    DemuxFilterPesEvent pesEvent;
+    pesEvent = {
+            .streamId = mPesStreamId,
+            .dataLength = static_cast<uint16_t>(mPesOutput.size()),
+    };
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] assembled pes data length %d", pesEvent.dataLength);
+    }
+
+    int size = mFilterEvent.events.size();
+    mFilterEvent.events.resize(size + 1);
+    mFilterEvent.events[size].pes(pesEvent);
+    return Result::SUCCESS;
+}
+
+Result Filter::createMediaEvent() {
+    std::lock_guard<std::mutex> lock(mAvArenaLock);
+    native_handle_t* nativeHandle = createNativeHandle(mAvArenaFd);
+    if (nativeHandle == NULL) {
+        return Result::UNKNOWN_ERROR;
+    }
+    hidl_handle handle;
+    handle.setTo(nativeHandle, /*shouldOwn=*/true);
+
+    // Hand the assembled region to the client until it calls releaseAvHandle
+    uint64_t dataId = mLastUsedDataId++ /*createdUID*/;
+    mAvRegions.push_back({
+            .dataId = dataId,
+            .offset = mAvPesOffset,
+            .length = mPesLength,
+            .released = false,
+    });
+
+    DemuxFilterMediaEvent mediaEvent;
+    mediaEvent = {
+            .streamId = mPesStreamId,
+            .isPtsPresent = mPesPtsPresent,
+            .pts = mPesPts,
+            .dataLength = mPesLength,
+            .offset = mAvPesOffset,
+            .avMemory = std::move(handle),
+            .avDataId = dataId,
+    };
+    int size = mFilterEvent.events.size();
+    mFilterEvent.events.resize(size + 1);
+    mFilterEvent.events[size].media(mediaEvent);
+
+    // Keep the regions page aligned so that the client can map them individually
+    uint32_t pageSize = getpagesize();
+    mAvPesOffset = (mAvPesOffset + mPesLength + pageSize - 1) / pageSize * pageSize;
+    if (mAvPesOffset >= mAvArenaSize) {
+        mAvPesOffset = 0;
+    }
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] assembled av data length %d", mediaEvent.dataLength);
+    }
+    return Result::SUCCESS;
+}
+
+bool Filter::createAvArena() {
+    int av_fd = createAvIonFd(AV_ARENA_SIZE);
+    if (av_fd == -1) {
+        return false;
+    }
+    uint8_t* avBuffer = getIonBuffer(av_fd, AV_ARENA_SIZE);
+    if (avBuffer == NULL) {
         ::close(av_fd);
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] assembled av data length %d", mediaEvent.dataLength);
+        return false;
+    }
+
+    mAvArenaFd = av_fd;
+    mAvArenaBuffer = avBuffer;
+    mAvArenaSize = AV_ARENA_SIZE;
+    mAvPesOffset = 0;
+    return true;
+}
+
+void Filter::releaseAvArena() {
+    std::lock_guard<std::mutex> lock(mAvArenaLock);
+    if (mAvArenaBuffer != nullptr) {
+        munmap(mAvArenaBuffer, mAvArenaSize);
+        mAvArenaBuffer = nullptr;
+    }
+    if (mAvArenaFd != -1) {
+        ::close(mAvArenaFd);
+        mAvArenaFd = -1;
+    }
+    mAvRegions.clear();
+}
+
+bool Filter::appendToAvArena(const uint8_t* data, uint32_t size) {
+    std::lock_guard<std::mutex> lock(mAvArenaLock);
+    if (mAvArenaBuffer == nullptr && !createAvArena()) {
+        return false;
+    }
+    if (mPesLength == 0 && mAvRegions.empty()) {
+        mAvPesOffset = 0;
+    }
+
+    // The PES may grow up to the oldest in-flight region, or to the arena end
+    // when the oldest region lies behind it.
+    uint32_t limit = mAvArenaSize;
+    if (!mAvRegions.empty() && mAvRegions.front().offset >= mAvPesOffset) {
+        limit = mAvRegions.front().offset;
+    }
+    if (mAvPesOffset + mPesLength + size > limit) {
+        // Move the partial PES to the arena start if it fits there
+        uint32_t head = mAvRegions.empty() ? mAvArenaSize : mAvRegions.front().offset;
+        if (limit != mAvArenaSize || mPesLength + size > head) {
+            return false;
         }
+        memmove(mAvArenaBuffer, mAvArenaBuffer + mAvPesOffset, mPesLength);
+        mAvPesOffset = 0;
     }
 
-    mFilterOutput.clear();
+    memcpy(mAvArenaBuffer + mAvPesOffset + mPesLength, data, size);
+    return true;
+}
 
-    return Result::SUCCESS;
+void Filter::recycleAvRegions() {
+    while (!mAvRegions.empty() && mAvRegions.front().released) {
+        mAvRegions.pop_front();
+    }
 }
 
 Result Filter::startRecordFilterHandler() {
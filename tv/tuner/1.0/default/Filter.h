@@ -21,6 +21,9 @@
 #include <fmq/MessageQueue.h>
 #include <ion/ion.h>
 #include <math.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <set>
 #include "Demux.h"
 #include "Dvr.h"
@@ -88,7 +91,6 @@ class Filter : public IFilter {
     Result startRecordFilterHandler();
     void attachFilterToRecord(const sp<Dvr> dvr);
     void detachFilterFromRecord();
-    void freeAvHandle();
     bool isMediaFilter() { return mIsMediaFilter; };
     bool isPcrFilter() { return mIsPcrFilter; };
     bool isRecordFilter() { return mIsRecordFilter; };
@@ -118,8 +120,12 @@ class Filter : public IFilter {
     vector<uint8_t> mRecordFilterOutput;
     unique_ptr<FilterMQ> mFilterMQ;
     bool mIsUsingFMQ = false;
-    EventFlag* mFilterEventFlag;
+    EventFlag* mFilterEventFlag = nullptr;
     DemuxFilterEvent mFilterEvent;
+    /**
+     * Signaled when the filter handlers add events to mFilterEvent or the filter stops
+     */
+    std::condition_variable mFilterEventCondition;
 
     // Thread handlers
     pthread_t mFilterThread;
@@ -129,7 +135,7 @@ class Filter : public IFilter {
     /**
      * If a specific filter's writing loop is still running
      */
-    bool mFilterThreadRunning;
+    std::atomic<bool> mFilterThreadRunning{false};
     bool mKeepFetchingDataFromFrontend;
 
     /**
@@ -153,6 +159,30 @@ class Filter : public IFilter {
     Result startTemiFilterHandler();
     Result startFilterLoop();
 
+    /**
+     * Incremental PES reassembly shared by the PES and the media filters.
+     * Each TS packet is consumed once as it is dispatched to the filter; the
+     * reassembly state persists across handler calls.
+     */
+    Result assemblePesPacket(const uint8_t* packet);
+    bool appendPesPayload(const uint8_t* data, uint32_t size);
+    Result finishPes();
+    void resetPes();
+    // Drops any partial PES and forgets the last continuity counter
+    void restartPesAssembly();
+    Result createPesEvent();
+    Result createMediaEvent();
+
+    /**
+     * The AV memory arena is a single ion buffer mapped once per media filter.
+     * Each assembled PES is written straight into it and handed out as an
+     * (offset, length) region, which is recycled on releaseAvHandle.
+     */
+    bool createAvArena();
+    void releaseAvArena();
+    bool appendToAvArena(const uint8_t* data, uint32_t size);
+    void recycleAvRegions();
+
     void deleteEventFlag();
     bool writeDataToFilterMQ(const std::vector<uint8_t>& data);
     bool readDataFromMQ();
@@ -168,6 +198,11 @@ class Filter : public IFilter {
     bool startFilterDispatcher();
     static void* __threadLoopFilter(void* user);
     void filterThreadLoop();
+    /**
+     * Block until the filter handlers created events or the filter is stopped.
+     * Return false if the filter is stopped.
+     */
+    bool waitForFilterEvent(DemuxFilterEvent& filterEvent);
 
     int createAvIonFd(int size);
     uint8_t* getIonBuffer(int fd, int size);
@@ -190,15 +225,42 @@ class Filter : public IFilter {
     std::mutex mFilterOutputLock;
     std::mutex mRecordFilterOutputLock;
 
-    // temp handle single PES filter
-    // TODO handle mulptiple Pes filters
+    /**
+     * PES reassembly state.
+     * mPesSizeLeft is the number of bytes still expected for a PES with a known
+     * length. A PES with PES_packet_length 0 (unbounded video) ends on the next
+     * payload unit start.
+     */
+    bool mPesStarted = false;
+    bool mPesUnbounded = false;
     int mPesSizeLeft = 0;
+    uint32_t mPesLength = 0;
+    uint8_t mPesStreamId = 0;
+    bool mPesPtsPresent = false;
+    uint64_t mPesPts = 0;
+    static constexpr int8_t kContinuityCounterUnset = -1;
+    int8_t mLastContinuityCounter = kContinuityCounterUnset;
+    // Output buffer for the PES filter. Cleared but never shrunk between PESs.
     vector<uint8_t> mPesOutput;
 
-    // A map from data id to ion handle
-    std::map<uint64_t, int> mDataId2Avfd;
+    struct AvRegion {
+        uint64_t dataId;
+        uint32_t offset;
+        uint32_t length;
+        bool released;
+    };
+    int mAvArenaFd = -1;
+    uint8_t* mAvArenaBuffer = nullptr;
+    uint32_t mAvArenaSize = 0;
+    // Page aligned arena offset of the PES currently being assembled.
+    uint32_t mAvPesOffset = 0;
+    // AV regions handed to the client, in allocation order.
+    std::deque<AvRegion> mAvRegions;
+    std::mutex mAvArenaLock;
     uint64_t mLastUsedDataId = 1;
-    int mAvBufferCopyCount = 0;
+
+    const uint32_t AV_ARENA_SIZE = 4 * 1024 * 1024;
+    const uint16_t TS_PACKET_SIZE = 188;
 };
 
 }  // namespace implementation
@@ -229,6 +229,18 @@ Return<void> Tuner::openLnbByName(const hidl_string& /*lnbName*/, openLnbByName_
     return Void();
 }
 
+Return<void> Tuner::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+
+    map<uint32_t, sp<Demux>>::iterator it;
+    for (it = mDemuxes.begin(); it != mDemuxes.end(); it++) {
+        it->second->dumpPidStats(fd->data[0]);
+    }
+    return Void();
+}
+
 void Tuner::setFrontendAsDemuxSource(uint32_t frontendId, uint32_t demuxId) {
     mFrontendToDemux[frontendId] = demuxId;
     if (mFrontends[frontendId] != nullptr && mFrontends[frontendId]->isLocked()) {
@@ -59,6 +59,9 @@ class Tuner : public ITuner {
     virtual Return<void> openLnbByName(const hidl_string& lnbName,
                                        openLnbByName_cb _hidl_cb) override;
 
+    virtual Return<void> debug(const hidl_handle& fd,
+                               const hidl_vec<hidl_string>& options) override;
+
     sp<Frontend> getFrontendById(uint32_t frontendId);
 
     void setFrontendAsDemuxSource(uint32_t frontendId, uint32_t demuxId);
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.tv.tuner@1.0-FilterBenchmark"
+
+#include <stdlib.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Demux.h"
+#include "Filter.h"
+
+using ::android::sp;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterEvent;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterMainType;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterSettings;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterStatus;
+using ::android::hardware::tv::tuner::V1_0::DemuxFilterType;
+using ::android::hardware::tv::tuner::V1_0::DemuxTsFilterType;
+using ::android::hardware::tv::tuner::V1_0::IFilter;
+using ::android::hardware::tv::tuner::V1_0::IFilterCallback;
+using ::android::hardware::tv::tuner::V1_0::Result;
+using ::android::hardware::tv::tuner::V1_0::implementation::Demux;
+
+namespace {
+
+// The recording the VTS plays back, and the PID of its video stream
+std::string gInputFile = "/data/local/tmp/segment000000.ts";
+uint16_t gVideoTpid = 256;
+
+constexpr uint32_t kTsPacketSize = 188;
+constexpr uint32_t kFilterBufferSize = 0x1000000;
+// Packets handed to the filters per dispatch, like one read of a 64 KiB playback FMQ
+constexpr uint32_t kPacketsPerDispatch = 0x10000 / kTsPacketSize;
+
+// The AV handles in the events are closed when the events go away
+class FilterCallback : public IFilterCallback {
+  public:
+    virtual Return<void> onFilterEvent(const DemuxFilterEvent& /*filterEvent*/) override {
+        return Void();
+    }
+    virtual Return<void> onFilterStatus(const DemuxFilterStatus /*status*/) override {
+        return Void();
+    }
+};
+
+std::vector<uint8_t> readInputFile() {
+    std::ifstream input(gInputFile, std::ifstream::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)),
+                              std::istreambuf_iterator<char>());
+    data.resize(data.size() / kTsPacketSize * kTsPacketSize);
+    return data;
+}
+
+// Plays the recording through a demux into a media filter on its video PID, so that every PES
+// is reassembled into the AV arena. Regions are released right after each dispatch, as a client
+// that keeps up with the decoder would.
+void BM_MediaFilterPlayback(benchmark::State& state) {
+    std::vector<uint8_t> input = readInputFile();
+    if (input.empty()) {
+        state.SkipWithError(("could not read " + gInputFile).c_str());
+        return;
+    }
+
+    sp<Demux> demux = new Demux(0 /* demuxId */, nullptr /* tuner */);
+    DemuxFilterType type;
+    type.mainType = DemuxFilterMainType::TS;
+    type.subType.tsFilterType(DemuxTsFilterType::VIDEO);
+    sp<IFilter> filter;
+    demux->openFilter(type, kFilterBufferSize, new FilterCallback(),
+                      [&](Result result, const sp<IFilter>& openedFilter) {
+                          if (result == Result::SUCCESS) {
+                              filter = openedFilter;
+                          }
+                      });
+    if (filter == nullptr) {
+        state.SkipWithError("failed to open the media filter");
+        return;
+    }
+    DemuxFilterSettings settings;
+    settings.ts().tpid = gVideoTpid;
+    settings.ts().filterSettings.av({.isPassthrough = false});
+    filter->configure(settings);
+
+    // AV data ids are handed out in order, starting from 1
+    uint64_t nextDataId = 1;
+    for (auto _ : state) {
+        // The filter thread only sends a limited number of callbacks per start, so restart it
+        // for every playback
+        filter->start();
+        for (size_t offset = 0; offset < input.size();) {
+            for (uint32_t i = 0; i < kPacketsPerDispatch && offset < input.size(); i++) {
+                demux->startBroadcastTsFilter(std::vector<uint8_t>(
+                        input.begin() + offset, input.begin() + offset + kTsPacketSize));
+                offset += kTsPacketSize;
+            }
+            if (!demux->startBroadcastFilterDispatcher()) {
+                state.SkipWithError("failed to dispatch the playback data");
+                break;
+            }
+            while (filter->releaseAvHandle(hidl_handle(), nextDataId) == Result::SUCCESS) {
+                nextDataId++;
+            }
+        }
+        filter->stop();
+    }
+    filter->close();
+
+    state.SetBytesProcessed(state.iterations() * input.size());
+    state.counters["pes"] = benchmark::Counter(nextDataId - 1, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_MediaFilterPlayback)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+// Usage: android.hardware.tv.tuner@1.0-filter-benchmark [benchmark flags] [input file [video PID]]
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (argc > 1) {
+        gInputFile = argv[1];
+    }
+    if (argc > 2) {
+        gVideoTpid = strtoul(argv[2], nullptr, 0);
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
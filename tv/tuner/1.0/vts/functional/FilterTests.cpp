@@ -116,7 +116,7 @@ bool FilterCallback::dumpAvData(DemuxFilterMediaEvent event) {
 
     int av_fd = handle.getNativeHandle()->data[0];
     uint8_t* buffer = static_cast<uint8_t*>(
-            mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, av_fd, 0 /*offset*/));
+            mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, av_fd, event.offset));
     if (buffer == MAP_FAILED) {
         ALOGE("[vts] fail to allocate av buffer, errno=%d", errno);
         return false;
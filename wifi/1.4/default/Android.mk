@@ -39,6 +39,9 @@ endif
 ifdef WIFI_AVOID_IFACE_RESET_MAC_CHANGE
 LOCAL_CPPFLAGS += -DWIFI_AVOID_IFACE_RESET_MAC_CHANGE
 endif
+ifdef WIFI_LINK_LAYER_STATS_CACHE_MS
+LOCAL_CPPFLAGS += -DWIFI_LINK_LAYER_STATS_CACHE_MS=$(WIFI_LINK_LAYER_STATS_CACHE_MS)
+endif
 # Allow implicit fallthroughs in wifi_legacy_hal.cpp until they are fixed.
 LOCAL_CFLAGS += -Wno-error=implicit-fallthrough
 LOCAL_SRC_FILES := \
@@ -146,6 +149,7 @@ LOCAL_PROPRIETARY_MODULE := true
 LOCAL_CPPFLAGS := -Wall -Werror -Wextra
 LOCAL_SRC_FILES := \
     tests/hidl_struct_util_unit_tests.cpp \
+    tests/hidl_sync_util_unit_tests.cpp \
     tests/main.cpp \
     tests/mock_interface_tool.cpp \
     tests/mock_wifi_feature_flags.cpp \
@@ -175,3 +179,32 @@ LOCAL_SHARED_LIBRARIES := \
     libwifi-hal \
     libwifi-system-iface
 include $(BUILD_NATIVE_TEST)
+
+###
+### android.hardware.wifi benchmarks.
+###
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.wifi@1.0-service-benchmarks
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_CPPFLAGS := -Wall -Werror -Wextra
+LOCAL_SRC_FILES := \
+    tests/allocation_counter.cpp \
+    tests/hidl_struct_util_benchmark.cpp \
+    tests/ringbuffer_benchmark.cpp
+LOCAL_STATIC_LIBRARIES := \
+    android.hardware.wifi@1.0 \
+    android.hardware.wifi@1.1 \
+    android.hardware.wifi@1.2 \
+    android.hardware.wifi@1.3 \
+    android.hardware.wifi@1.4 \
+    android.hardware.wifi@1.0-service-lib
+LOCAL_SHARED_LIBRARIES := \
+    libbase \
+    libcutils \
+    libhidlbase \
+    liblog \
+    libnl \
+    libutils \
+    libwifi-hal \
+    libwifi-system-iface
+include $(BUILD_NATIVE_BENCHMARK)
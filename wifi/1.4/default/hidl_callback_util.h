@@ -17,6 +17,7 @@
 #ifndef HIDL_CALLBACK_UTIL_H_
 #define HIDL_CALLBACK_UTIL_H_
 
+#include <mutex>
 #include <set>
 
 #include <hidl/HidlSupport.h>
@@ -58,6 +59,9 @@ namespace hidl_callback_util {
 template <typename CallbackType>
 // Provides a class to manage callbacks for the various HIDL interfaces and
 // handle the death of the process hosting each callback.
+// The callback set has its own lock since it is read from the legacy HAL event
+// loop thread, death notifications arrive on a binder thread and neither of
+// them hold the global lock.
 class HidlCallbackHandler {
    public:
     HidlCallbackHandler()
@@ -71,6 +75,7 @@ class HidlCallbackHandler {
         // (callback proxy's raw pointer) to track the death of individual
         // clients.
         uint64_t cookie = reinterpret_cast<uint64_t>(cb.get());
+        std::lock_guard<std::mutex> lock(cb_set_lock_);
         if (cb_set_.find(cb) != cb_set_.end()) {
             LOG(WARNING) << "Duplicate death notification registration";
             return true;
@@ -83,13 +88,17 @@ class HidlCallbackHandler {
         return true;
     }
 
-    const std::set<android::sp<CallbackType>>& getCallbacks() {
+    // Returns a copy of the callbacks, so that they can be invoked without
+    // holding the lock.
+    std::set<android::sp<CallbackType>> getCallbacks() {
+        std::lock_guard<std::mutex> lock(cb_set_lock_);
         return cb_set_;
     }
 
     // Death notification for callbacks.
     void onObjectDeath(uint64_t cookie) {
         CallbackType* cb = reinterpret_cast<CallbackType*>(cookie);
+        std::lock_guard<std::mutex> lock(cb_set_lock_);
         const auto& iter = cb_set_.find(cb);
         if (iter == cb_set_.end()) {
             LOG(ERROR) << "Unknown callback death notification received";
@@ -100,15 +109,20 @@ class HidlCallbackHandler {
     }
 
     void invalidate() {
-        for (const sp<CallbackType>& cb : cb_set_) {
+        std::set<sp<CallbackType>> cb_set;
+        {
+            std::lock_guard<std::mutex> lock(cb_set_lock_);
+            std::swap(cb_set, cb_set_);
+        }
+        for (const sp<CallbackType>& cb : cb_set) {
             if (!cb->unlinkToDeath(death_handler_)) {
                 LOG(ERROR) << "Failed to deregister death notification";
             }
         }
-        cb_set_.clear();
     }
 
    private:
+    std::mutex cb_set_lock_;
     std::set<sp<CallbackType>> cb_set_;
     sp<HidlDeathHandler<CallbackType>> death_handler_;
 
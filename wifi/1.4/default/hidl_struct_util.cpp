@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 #include <utils/SystemClock.h>
 
@@ -539,22 +541,22 @@ bool convertLegacyIeToHidl(
     }
     *hidl_ie = {};
     hidl_ie->id = legacy_ie.id;
-    hidl_ie->data =
-        std::vector<uint8_t>(legacy_ie.data, legacy_ie.data + legacy_ie.len);
+    hidl_ie->data.resize(legacy_ie.len);
+    std::copy(legacy_ie.data, legacy_ie.data + legacy_ie.len,
+              hidl_ie->data.data());
     return true;
 }
 
-bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
-                               std::vector<WifiInformationElement>* hidl_ies) {
-    if (!ie_blob || !hidl_ies) {
-        return false;
-    }
-    *hidl_ies = {};
+// Returns the number of IEs in the blob which can be fully parsed and sets
+// |ies_len| to the length of the blob covered by them.
+uint32_t getNumLegacyIesInBlob(const uint8_t* ie_blob, uint32_t ie_blob_len,
+                               uint32_t* ies_len) {
     const uint8_t* ies_begin = ie_blob;
     const uint8_t* ies_end = ie_blob + ie_blob_len;
     const uint8_t* next_ie = ies_begin;
     using wifi_ie = legacy_hal::wifi_information_element;
     constexpr size_t kIeHeaderLen = sizeof(wifi_ie);
+    uint32_t num_ies = 0;
     // Each IE should atleast have the header (i.e |id| & |len| fields).
     while (next_ie + kIeHeaderLen <= ies_end) {
         const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
@@ -565,13 +567,7 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
                        << ", IEs End: " << (void*)ies_end;
             break;
         }
-        WifiInformationElement hidl_ie;
-        if (!convertLegacyIeToHidl(legacy_ie, &hidl_ie)) {
-            LOG(ERROR) << "Error converting IE. Id: " << legacy_ie.id
-                       << ", len: " << legacy_ie.len;
-            break;
-        }
-        hidl_ies->push_back(std::move(hidl_ie));
+        num_ies++;
         next_ie += curr_ie_len;
     }
     // Check if the blob has been fully consumed.
@@ -579,21 +575,67 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
         LOG(ERROR) << "Failed to fully parse IE blob. Next IE: "
                    << (void*)next_ie << ", IEs End: " << (void*)ies_end;
     }
+    *ies_len = next_ie - ies_begin;
+    return num_ies;
+}
+
+// If |ie_backing_store| is non-null, the IE blob is copied into it once and the
+// data of each IE refers to that copy. Otherwise, each IE owns its data.
+bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
+                               std::vector<uint8_t>* ie_backing_store,
+                               hidl_vec<WifiInformationElement>* hidl_ies) {
+    if (!ie_blob || !hidl_ies) {
+        return false;
+    }
+    uint32_t ies_len;
+    const uint32_t num_ies =
+        getNumLegacyIesInBlob(ie_blob, ie_blob_len, &ies_len);
+    *hidl_ies = {};
+    hidl_ies->resize(num_ies);
+    uint8_t* ies_data = nullptr;
+    if (ie_backing_store) {
+        ie_backing_store->assign(ie_blob, ie_blob + ies_len);
+        ies_data = ie_backing_store->data();
+    }
+    using wifi_ie = legacy_hal::wifi_information_element;
+    constexpr size_t kIeHeaderLen = sizeof(wifi_ie);
+    uint32_t ie_offset = 0;
+    for (uint32_t ie_idx = 0; ie_idx < num_ies; ie_idx++) {
+        const wifi_ie& legacy_ie =
+            (*reinterpret_cast<const wifi_ie*>(ie_blob + ie_offset));
+        WifiInformationElement& hidl_ie = (*hidl_ies)[ie_idx];
+        if (ies_data) {
+            hidl_ie.id = legacy_ie.id;
+            hidl_ie.data.setToExternal(ies_data + ie_offset + kIeHeaderLen,
+                                       legacy_ie.len);
+        } else if (!convertLegacyIeToHidl(legacy_ie, &hidl_ie)) {
+            return false;
+        }
+        ie_offset += kIeHeaderLen + legacy_ie.len;
+    }
     return true;
 }
 
 bool convertLegacyGscanResultToHidl(
     const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
     StaScanResult* hidl_scan_result) {
+    return convertLegacyGscanResultToHidl(legacy_scan_result, has_ie_data,
+                                          nullptr, hidl_scan_result);
+}
+
+bool convertLegacyGscanResultToHidl(
+    const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
+    std::vector<uint8_t>* ie_backing_store, StaScanResult* hidl_scan_result) {
     if (!hidl_scan_result) {
         return false;
     }
     *hidl_scan_result = {};
     hidl_scan_result->timeStampInUs = legacy_scan_result.ts;
-    hidl_scan_result->ssid = std::vector<uint8_t>(
-        legacy_scan_result.ssid,
-        legacy_scan_result.ssid + strnlen(legacy_scan_result.ssid,
-                                          sizeof(legacy_scan_result.ssid) - 1));
+    const size_t ssid_len = strnlen(legacy_scan_result.ssid,
+                                    sizeof(legacy_scan_result.ssid) - 1);
+    hidl_scan_result->ssid.resize(ssid_len);
+    std::copy(legacy_scan_result.ssid, legacy_scan_result.ssid + ssid_len,
+              hidl_scan_result->ssid.data());
     memcpy(hidl_scan_result->bssid.data(), legacy_scan_result.bssid,
            hidl_scan_result->bssid.size());
     hidl_scan_result->frequency = legacy_scan_result.channel;
@@ -601,13 +643,12 @@ bool convertLegacyGscanResultToHidl(
     hidl_scan_result->beaconPeriodInMs = legacy_scan_result.beacon_period;
     hidl_scan_result->capability = legacy_scan_result.capability;
     if (has_ie_data) {
-        std::vector<WifiInformationElement> ies;
         if (!convertLegacyIeBlobToHidl(
                 reinterpret_cast<const uint8_t*>(legacy_scan_result.ie_data),
-                legacy_scan_result.ie_length, &ies)) {
+                legacy_scan_result.ie_length, ie_backing_store,
+                &hidl_scan_result->informationElements)) {
             return false;
         }
-        hidl_scan_result->informationElements = std::move(ies);
     }
     return true;
 }
@@ -631,18 +672,15 @@ bool convertLegacyCachedGscanResultsToHidl(
 
     CHECK(legacy_cached_scan_result.num_results >= 0 &&
           legacy_cached_scan_result.num_results <= MAX_AP_CACHE_PER_SCAN);
-    std::vector<StaScanResult> hidl_scan_results;
+    hidl_scan_data->results.resize(legacy_cached_scan_result.num_results);
     for (int32_t result_idx = 0;
          result_idx < legacy_cached_scan_result.num_results; result_idx++) {
-        StaScanResult hidl_scan_result;
         if (!convertLegacyGscanResultToHidl(
                 legacy_cached_scan_result.results[result_idx], false,
-                &hidl_scan_result)) {
+                &hidl_scan_data->results[result_idx])) {
             return false;
         }
-        hidl_scan_results.push_back(hidl_scan_result);
     }
-    hidl_scan_data->results = std::move(hidl_scan_results);
     return true;
 }
 
@@ -654,13 +692,12 @@ bool convertLegacyVectorOfCachedGscanResultsToHidl(
         return false;
     }
     *hidl_scan_datas = {};
-    for (const auto& legacy_cached_scan_result : legacy_cached_scan_results) {
-        StaScanData hidl_scan_data;
-        if (!convertLegacyCachedGscanResultsToHidl(legacy_cached_scan_result,
-                                                   &hidl_scan_data)) {
+    hidl_scan_datas->resize(legacy_cached_scan_results.size());
+    for (size_t idx = 0; idx < legacy_cached_scan_results.size(); idx++) {
+        if (!convertLegacyCachedGscanResultsToHidl(
+                legacy_cached_scan_results[idx], &(*hidl_scan_datas)[idx])) {
             return false;
         }
-        hidl_scan_datas->push_back(hidl_scan_data);
     }
     return true;
 }
@@ -836,10 +873,12 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
     hidl_radio_stat->onTimeInMsForHs20Scan =
         legacy_radio_stat.stats.on_time_hs20;
 
-    std::vector<V1_3::WifiChannelStats> hidl_channel_stats;
-
-    for (const auto& channel_stat : legacy_radio_stat.channel_stats) {
-        V1_3::WifiChannelStats hidl_channel_stat;
+    hidl_radio_stat->channelStats.resize(
+        legacy_radio_stat.channel_stats.size());
+    for (size_t idx = 0; idx < legacy_radio_stat.channel_stats.size(); idx++) {
+        const auto& channel_stat = legacy_radio_stat.channel_stats[idx];
+        V1_3::WifiChannelStats& hidl_channel_stat =
+            hidl_radio_stat->channelStats[idx];
         hidl_channel_stat.onTimeInMs = channel_stat.on_time;
         hidl_channel_stat.ccaBusyTimeInMs = channel_stat.cca_busy_time;
         /*
@@ -852,11 +891,8 @@ bool convertLegacyLinkLayerRadioStatsToHidl(
             channel_stat.channel.center_freq0;
         hidl_channel_stat.channel.centerFreq1 =
             channel_stat.channel.center_freq1;
-        hidl_channel_stats.push_back(hidl_channel_stat);
     }
 
-    hidl_radio_stat->channelStats = hidl_channel_stats;
-
     return true;
 }
 
@@ -903,16 +939,13 @@ bool convertLegacyLinkLayerStatsToHidl(
     hidl_stats->iface.wmeVoPktStats.retries =
         legacy_stats.iface.ac[legacy_hal::WIFI_AC_VO].retries;
     // radio legacy_stats conversion.
-    std::vector<V1_3::StaLinkLayerRadioStats> hidl_radios_stats;
-    for (const auto& legacy_radio_stats : legacy_stats.radios) {
-        V1_3::StaLinkLayerRadioStats hidl_radio_stats;
-        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_radio_stats,
-                                                    &hidl_radio_stats)) {
+    hidl_stats->radios.resize(legacy_stats.radios.size());
+    for (size_t idx = 0; idx < legacy_stats.radios.size(); idx++) {
+        if (!convertLegacyLinkLayerRadioStatsToHidl(legacy_stats.radios[idx],
+                                                    &hidl_stats->radios[idx])) {
             return false;
         }
-        hidl_radios_stats.push_back(hidl_radio_stats);
     }
-    hidl_stats->radios = hidl_radios_stats;
     // Timestamp in the HAL wrapper here since it's not provided in the legacy
     // HAL API.
     hidl_stats->timeStampInMs = uptimeMillis();
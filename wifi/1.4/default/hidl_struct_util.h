@@ -87,6 +87,12 @@ bool convertHidlGscanParamsToLegacy(
 bool convertLegacyGscanResultToHidl(
     const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
     StaScanResult* hidl_scan_result);
+// Same as above, but the IEs are copied once into |ie_backing_store| and the
+// IE data in |hidl_scan_result| refers to it instead of owning a copy of each
+// IE. |ie_backing_store| must outlive |hidl_scan_result|.
+bool convertLegacyGscanResultToHidl(
+    const legacy_hal::wifi_scan_result& legacy_scan_result, bool has_ie_data,
+    std::vector<uint8_t>* ie_backing_store, StaScanResult* hidl_scan_result);
 // |cached_results| is assumed to not include IEs.
 bool convertLegacyVectorOfCachedGscanResultsToHidl(
     const std::vector<legacy_hal::wifi_cached_scan_results>&
@@ -17,10 +17,16 @@
 #ifndef HIDL_SYNC_UTIL_H_
 #define HIDL_SYNC_UTIL_H_
 
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <utility>
+
+#include <android-base/macros.h>
 
 // Utility that provides a global lock to synchronize access between
-// the HIDL thread and the legacy HAL's event loop.
+// the HIDL thread and the legacy HAL's event loop, and a callback holder
+// which lets the event loop invoke callbacks without that lock.
 namespace android {
 namespace hardware {
 namespace wifi {
@@ -28,6 +34,71 @@ namespace V1_4 {
 namespace implementation {
 namespace hidl_sync_util {
 std::unique_lock<std::recursive_mutex> acquireGlobalLock();
+
+// Holds a std::function callback which is set/reset on the HIDL thread and
+// invoked on the legacy HAL event loop thread.
+// Updates atomically publish a new immutable copy of the callback and readers
+// invoke a reference counted snapshot of it, so an invocation never needs the
+// global lock and a concurrent reset never destroys the callback while it is
+// still running.
+template <typename Signature>
+class AtomicCallback {
+   public:
+    using Function = std::function<Signature>;
+
+    AtomicCallback() = default;
+
+    AtomicCallback& operator=(Function callback) {
+        std::shared_ptr<const Function> snapshot;
+        if (callback) {
+            snapshot = std::make_shared<const Function>(std::move(callback));
+        }
+        std::atomic_store(&callback_, std::move(snapshot));
+        return *this;
+    }
+
+    AtomicCallback& operator=(std::nullptr_t) {
+        std::atomic_store(&callback_, std::shared_ptr<const Function>());
+        return *this;
+    }
+
+    explicit operator bool() const { return load() != nullptr; }
+
+    std::shared_ptr<const Function> load() const {
+        return std::atomic_load(&callback_);
+    }
+
+    // Invokes the current callback if one is set.
+    // Returns true if the callback was invoked.
+    template <typename... Args>
+    bool invoke(Args&&... args) const {
+        const auto callback = load();
+        if (!callback) {
+            return false;
+        }
+        (*callback)(std::forward<Args>(args)...);
+        return true;
+    }
+
+    // Same as |invoke|, but resets the callback afterwards unless it was
+    // replaced while running. Used for callbacks which should only fire once.
+    template <typename... Args>
+    bool invokeOnce(Args&&... args) {
+        auto callback = load();
+        if (!callback) {
+            return false;
+        }
+        (*callback)(std::forward<Args>(args)...);
+        std::atomic_compare_exchange_strong(
+            &callback_, &callback, std::shared_ptr<const Function>());
+        return true;
+    }
+
+   private:
+    std::shared_ptr<const Function> callback_;
+
+    DISALLOW_COPY_AND_ASSIGN(AtomicCallback);
+};
 }  // namespace hidl_sync_util
 }  // namespace implementation
 }  // namespace V1_4
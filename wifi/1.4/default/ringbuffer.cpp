@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 #include "ringbuffer.h"
@@ -24,27 +28,99 @@ namespace wifi {
 namespace V1_4 {
 namespace implementation {
 
-Ringbuffer::Ringbuffer(size_t maxSize) : size_(0), maxSize_(maxSize) {}
+Ringbuffer::Ringbuffer(size_t maxSize)
+    : head_(0), size_(0), numRecords_(0), maxSize_(maxSize) {}
 
 void Ringbuffer::append(const std::vector<uint8_t>& input) {
-    if (input.size() == 0) {
+    append(input.data(), input.size());
+}
+
+void Ringbuffer::append(const uint8_t* data, size_t size) {
+    if (size == 0) {
         return;
     }
-    if (input.size() > maxSize_) {
-        LOG(INFO) << "Oversized message of " << input.size()
-                  << " bytes is dropped";
+    if (size > maxSize_ || maxSize_ - size < kRecordHeaderSize) {
+        LOG(INFO) << "Oversized message of " << size << " bytes is dropped";
         return;
     }
-    data_.push_back(input);
-    size_ += input.size() * sizeof(input[0]);
-    while (size_ > maxSize_) {
-        size_ -= data_.front().size() * sizeof(data_.front()[0]);
-        data_.pop_front();
+    const size_t recordSize = kRecordHeaderSize + size;
+    if (capacity() - size_ < recordSize && capacity() < maxSize_) {
+        grow(size_ + recordSize);
+    }
+    while (capacity() - size_ < recordSize) {
+        popFront();
     }
+    size_t tail = (head_ + size_) % capacity();
+    uint32_t header = size;
+    write(tail, reinterpret_cast<const uint8_t*>(&header), kRecordHeaderSize);
+    write((tail + kRecordHeaderSize) % capacity(), data, size);
+    size_ += kRecordHeaderSize + size;
+    numRecords_++;
+}
+
+Ringbuffer::const_iterator Ringbuffer::begin() const {
+    return const_iterator(this, head_, 0);
+}
+
+Ringbuffer::const_iterator Ringbuffer::end() const {
+    // Iterators only compare their record index, so the offset doesn't matter.
+    return const_iterator(this, 0, numRecords_);
 }
 
-const std::list<std::vector<uint8_t>>& Ringbuffer::getData() const {
-    return data_;
+Ringbuffer::Record Ringbuffer::const_iterator::operator*() const {
+    size_t size = buffer_->recordSizeAt(offset_);
+    size_t start = (offset_ + kRecordHeaderSize) % buffer_->capacity();
+    size_t headSize = std::min(size, buffer_->capacity() - start);
+    const uint8_t* data = buffer_->buffer_.data();
+    return {{data + start, headSize}, {data, size - headSize}};
+}
+
+Ringbuffer::const_iterator& Ringbuffer::const_iterator::operator++() {
+    offset_ = (offset_ + kRecordHeaderSize + buffer_->recordSizeAt(offset_)) %
+              buffer_->capacity();
+    index_++;
+    return *this;
+}
+
+void Ringbuffer::grow(size_t minCapacity) {
+    size_t newCapacity = std::min(
+        maxSize_, std::max({minCapacity, 2 * capacity(), kMinCapacity}));
+    std::vector<uint8_t> grown(newCapacity);
+    if (size_ > 0) {
+        // Unwrap the records to the start of the new buffer.
+        read(head_, grown.data(), size_);
+    }
+    buffer_.swap(grown);
+    head_ = 0;
+}
+
+void Ringbuffer::write(size_t offset, const uint8_t* data, size_t size) {
+    size_t headSize = std::min(size, capacity() - offset);
+    memcpy(buffer_.data() + offset, data, headSize);
+    memcpy(buffer_.data(), data + headSize, size - headSize);
+}
+
+void Ringbuffer::read(size_t offset, uint8_t* data, size_t size) const {
+    size_t headSize = std::min(size, capacity() - offset);
+    memcpy(data, buffer_.data() + offset, headSize);
+    memcpy(data + headSize, buffer_.data(), size - headSize);
+}
+
+uint32_t Ringbuffer::recordSizeAt(size_t offset) const {
+    uint32_t size;
+    read(offset, reinterpret_cast<uint8_t*>(&size), kRecordHeaderSize);
+    return size;
+}
+
+void Ringbuffer::popFront() {
+    size_t recordSize = kRecordHeaderSize + recordSizeAt(head_);
+    head_ = (head_ + recordSize) % capacity();
+    size_ -= recordSize;
+    numRecords_--;
+    if (numRecords_ == 0) {
+        // Start over at the beginning, so records wrap around less often.
+        head_ = 0;
+    }
 }
 
 }  // namespace implementation
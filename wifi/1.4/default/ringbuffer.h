@@ -17,7 +17,8 @@
 #ifndef RINGBUFFER_H_
 #define RINGBUFFER_H_
 
-#include <list>
+#include <cstdint>
+#include <iterator>
 #include <vector>
 
 namespace android {
@@ -28,19 +29,90 @@ namespace implementation {
 
 /**
  * Ringbuffer object used to store debug data.
+ *
+ * Records are stored back to back in a single buffer, each prefixed with its
+ * length. The buffer starts empty and doubles as records are appended, up to
+ * |maxSize| bytes; from then on the oldest records are overwritten when a
+ * new one doesn't fit. Unused and quiet rings cost little memory.
  */
 class Ringbuffer {
    public:
+    // Bytes taken up by the length prefix of every record.
+    static constexpr size_t kRecordHeaderSize = sizeof(uint32_t);
+
+    struct Span {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    // A record in the buffer. A record which wraps around the end of the
+    // buffer is split into |head| and |tail|, otherwise |tail| is empty.
+    struct Record {
+        Span head;
+        Span tail;
+
+        size_t size() const { return head.size + tail.size; }
+    };
+
+    class const_iterator {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Record;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Record*;
+        using reference = Record;
+
+        Record operator*() const;
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const {
+            return index_ == other.index_;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+       private:
+        friend class Ringbuffer;
+        const_iterator(const Ringbuffer* buffer, size_t offset, size_t index)
+            : buffer_(buffer), offset_(offset), index_(index) {}
+
+        const Ringbuffer* buffer_;
+        size_t offset_;
+        size_t index_;
+    };
+
     explicit Ringbuffer(size_t maxSize);
 
-    // Appends the data buffer and deletes from the front until buffer is
-    // within |maxSize_|.
+    // Appends the data buffer as one record and drops records from the front
+    // until everything fits within |maxSize_|, including record headers.
     void append(const std::vector<uint8_t>& input);
-    const std::list<std::vector<uint8_t>>& getData() const;
+    void append(const uint8_t* data, size_t size);
+
+    // Iterates over the records, oldest first.
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    bool empty() const { return numRecords_ == 0; }
+    size_t numRecords() const { return numRecords_; }
+    // Bytes in use, including record headers.
+    size_t size() const { return size_; }
+    // Bytes currently allocated, never more than |maxSize_|.
+    size_t capacity() const { return buffer_.size(); }
 
    private:
-    std::list<std::vector<uint8_t>> data_;
+    // Smallest buffer allocated by the first append.
+    static constexpr size_t kMinCapacity = 4096;
+
+    void grow(size_t minCapacity);
+    void write(size_t offset, const uint8_t* data, size_t size);
+    void read(size_t offset, uint8_t* data, size_t size) const;
+    uint32_t recordSizeAt(size_t offset) const;
+    void popFront();
+
+    std::vector<uint8_t> buffer_;
+    size_t head_;
     size_t size_;
+    size_t numRecords_;
     size_t maxSize_;
 };
 
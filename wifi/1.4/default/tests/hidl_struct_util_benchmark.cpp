@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#undef NAN
+#include "allocation_counter.h"
+#include "hidl_struct_util.h"
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+namespace {
+
+using ::android::hardware::wifi::V1_0::StaScanResult;
+
+// Number of BSSs in a scan of a crowded area.
+constexpr size_t kNumScanResults = 500;
+
+// The IEs of a typical WPA2 access point beacon: SSID, rates, DS parameter
+// set, TIM, country, RSN, HT capabilities and operation, extended
+// capabilities and vendor specific WMM and WPS elements. The SSID is filled
+// in per BSS.
+std::vector<uint8_t> makeIeBlob(const std::string& ssid) {
+    std::vector<uint8_t> blob = {0, static_cast<uint8_t>(ssid.size())};
+    blob.insert(blob.end(), ssid.begin(), ssid.end());
+    const std::vector<std::pair<uint8_t, uint8_t>> ies = {
+        {1, 8},  {3, 1},  {5, 4},   {7, 6},   {48, 20},  {45, 26},
+        {61, 22}, {127, 8}, {221, 24}, {221, 30}, {221, 9}};
+    for (const auto& [id, len] : ies) {
+        blob.push_back(id);
+        blob.push_back(len);
+        blob.insert(blob.end(), len, id);
+    }
+    return blob;
+}
+
+// Returns kNumScanResults legacy scan results, each in its own buffer since
+// the IEs follow the wifi_scan_result struct.
+std::vector<std::vector<uint8_t>> makeScanDump() {
+    std::vector<std::vector<uint8_t>> dump;
+    for (size_t i = 0; i < kNumScanResults; ++i) {
+        std::string ssid = "network-" + std::to_string(i);
+        std::vector<uint8_t> ie_blob = makeIeBlob(ssid);
+        std::vector<uint8_t> buffer(sizeof(legacy_hal::wifi_scan_result) +
+                                    ie_blob.size());
+        auto* result =
+            reinterpret_cast<legacy_hal::wifi_scan_result*>(buffer.data());
+        memcpy(result->ssid, ssid.data(), ssid.size());
+        result->bssid[5] = i;
+        result->channel = 2412 + 5 * (i % 13);
+        result->rssi = -40 - static_cast<int>(i % 50);
+        result->beacon_period = 100;
+        result->ie_length = ie_blob.size();
+        memcpy(result->ie_data, ie_blob.data(), ie_blob.size());
+        dump.push_back(std::move(buffer));
+    }
+    return dump;
+}
+
+// Converts a full scan dump to HIDL, one result at a time like the full scan
+// result callback does. With |useBackingStore|, the IEs of each result are
+// copied once instead of once per IE.
+void convertScanDump(benchmark::State& state, bool useBackingStore) {
+    std::vector<std::vector<uint8_t>> dump = makeScanDump();
+    size_t allocations = allocation_counter::count();
+    for (auto _ : state) {
+        for (const auto& buffer : dump) {
+            const auto& legacy_result =
+                *reinterpret_cast<const legacy_hal::wifi_scan_result*>(
+                    buffer.data());
+            std::vector<uint8_t> ie_backing_store;
+            StaScanResult hidl_result;
+            if (!hidl_struct_util::convertLegacyGscanResultToHidl(
+                    legacy_result, true,
+                    useBackingStore ? &ie_backing_store : nullptr,
+                    &hidl_result)) {
+                state.SkipWithError("conversion failed");
+                return;
+            }
+            benchmark::DoNotOptimize(hidl_result);
+        }
+    }
+    allocations = allocation_counter::count() - allocations;
+
+    state.SetItemsProcessed(state.iterations() * dump.size());
+    state.counters["allocs_per_result"] = benchmark::Counter(
+        static_cast<double>(allocations) / dump.size(),
+        benchmark::Counter::kAvgIterations);
+}
+
+void BM_ConvertScanResultsOwningIes(benchmark::State& state) {
+    convertScanDump(state, false);
+}
+BENCHMARK(BM_ConvertScanResultsOwningIes);
+
+void BM_ConvertScanResultsWithBackingStore(benchmark::State& state) {
+    convertScanDump(state, true);
+}
+BENCHMARK(BM_ConvertScanResultsWithBackingStore);
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
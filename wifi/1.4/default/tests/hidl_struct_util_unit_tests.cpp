@@ -30,6 +30,10 @@ constexpr uint32_t kIfaceChannel1 = 3;
 constexpr uint32_t kIfaceChannel2 = 5;
 constexpr char kIfaceName1[] = "wlan0";
 constexpr char kIfaceName2[] = "wlan1";
+constexpr char kSsid[] = "test-ssid";
+constexpr uint8_t kIeIdSsid = 0;
+constexpr uint8_t kIeIdRsn = 48;
+constexpr uint8_t kIeIdVendor = 221;
 }  // namespace
 namespace android {
 namespace hardware {
@@ -287,6 +291,57 @@ TEST_F(HidlStructUtilTest, CanConvertLegacyFeaturesToHidl) {
                   HidlChipCaps::DEBUG_MEMORY_DRIVER_DUMP,
               hidle_caps);
 }
+
+TEST_F(HidlStructUtilTest, CanConvertLegacyGscanResultWithIesToHidl) {
+    const std::vector<uint8_t> ie_blob = {
+        kIeIdSsid, 4, 't', 'e', 's', 't',  //
+        kIeIdVendor, 0,                    //
+        kIeIdRsn, 2, 0x01, 0x00,           //
+        // Truncated IE, which should be dropped.
+        kIeIdVendor, 8, 0x01};
+    std::vector<uint8_t> buffer(sizeof(legacy_hal::wifi_scan_result) +
+                                ie_blob.size());
+    auto* legacy_scan_result =
+        reinterpret_cast<legacy_hal::wifi_scan_result*>(buffer.data());
+    memcpy(legacy_scan_result->ssid, kSsid, sizeof(kSsid));
+    legacy_scan_result->channel = 2412;
+    legacy_scan_result->rssi = -50;
+    legacy_scan_result->ie_length = ie_blob.size();
+    memcpy(legacy_scan_result->ie_data, ie_blob.data(), ie_blob.size());
+
+    StaScanResult owned_result;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyGscanResultToHidl(
+        *legacy_scan_result, true, &owned_result));
+    std::vector<uint8_t> ie_backing_store;
+    StaScanResult external_result;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyGscanResultToHidl(
+        *legacy_scan_result, true, &ie_backing_store, &external_result));
+
+    for (const StaScanResult* hidl_scan_result :
+         {&owned_result, &external_result}) {
+        EXPECT_EQ(std::vector<uint8_t>(kSsid, kSsid + strlen(kSsid)),
+                  std::vector<uint8_t>(hidl_scan_result->ssid));
+        EXPECT_EQ(2412u, hidl_scan_result->frequency);
+        EXPECT_EQ(-50, hidl_scan_result->rssi);
+        ASSERT_EQ(3u, hidl_scan_result->informationElements.size());
+        EXPECT_EQ(kIeIdSsid, hidl_scan_result->informationElements[0].id);
+        EXPECT_EQ(std::vector<uint8_t>({'t', 'e', 's', 't'}),
+                  std::vector<uint8_t>(
+                      hidl_scan_result->informationElements[0].data));
+        EXPECT_EQ(kIeIdVendor, hidl_scan_result->informationElements[1].id);
+        EXPECT_EQ(0u, hidl_scan_result->informationElements[1].data.size());
+        EXPECT_EQ(kIeIdRsn, hidl_scan_result->informationElements[2].id);
+        EXPECT_EQ(std::vector<uint8_t>({0x01, 0x00}),
+                  std::vector<uint8_t>(
+                      hidl_scan_result->informationElements[2].data));
+    }
+    // The complete IEs are copied once into the backing store.
+    ASSERT_EQ(12u, ie_backing_store.size());
+    EXPECT_EQ(ie_backing_store.data() + 2,
+              external_result.informationElements[0].data.data());
+    EXPECT_EQ(ie_backing_store.data() + 10,
+              external_result.informationElements[2].data.data());
+}
 }  // namespace implementation
 }  // namespace V1_4
 }  // namespace wifi
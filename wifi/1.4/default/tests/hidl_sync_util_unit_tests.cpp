@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <vector>
+
+#include <gmock/gmock.h>
+
+#include "hidl_sync_util.h"
+
+using testing::Test;
+
+namespace {
+constexpr uint32_t kNumStressIterations = 10000;
+constexpr auto kCallbackTimeout = std::chrono::seconds(5);
+}  // namespace
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+using hidl_sync_util::AtomicCallback;
+
+class HidlSyncUtilTest : public Test {};
+
+TEST_F(HidlSyncUtilTest, InvokeUnsetCallback) {
+    AtomicCallback<void(int)> callback;
+    ASSERT_FALSE(callback);
+    ASSERT_FALSE(callback.invoke(1));
+    ASSERT_FALSE(callback.invokeOnce(1));
+}
+
+TEST_F(HidlSyncUtilTest, InvokeAndResetCallback) {
+    AtomicCallback<void(int)> callback;
+    int value = 0;
+    callback = [&value](int new_value) { value = new_value; };
+    ASSERT_TRUE(callback);
+    ASSERT_TRUE(callback.invoke(5));
+    ASSERT_EQ(5, value);
+
+    callback = nullptr;
+    ASSERT_FALSE(callback);
+    ASSERT_FALSE(callback.invoke(6));
+    ASSERT_EQ(5, value);
+
+    callback = std::function<void(int)>();
+    ASSERT_FALSE(callback);
+}
+
+TEST_F(HidlSyncUtilTest, InvokeOnceResetsCallback) {
+    AtomicCallback<void()> callback;
+    uint32_t num_invocations = 0;
+    callback = [&num_invocations]() { num_invocations++; };
+    ASSERT_TRUE(callback.invokeOnce());
+    ASSERT_FALSE(callback);
+    ASSERT_FALSE(callback.invokeOnce());
+    ASSERT_EQ(1u, num_invocations);
+}
+
+TEST_F(HidlSyncUtilTest, InvokeOnceKeepsCallbackReplacedWhileRunning) {
+    AtomicCallback<void()> callback;
+    bool replacement_invoked = false;
+    callback = [&callback, &replacement_invoked]() {
+        callback = [&replacement_invoked]() { replacement_invoked = true; };
+    };
+    ASSERT_TRUE(callback.invokeOnce());
+    ASSERT_TRUE(callback);
+    ASSERT_TRUE(callback.invoke());
+    ASSERT_TRUE(replacement_invoked);
+}
+
+TEST_F(HidlSyncUtilTest, ResetCallbackWhileRunning) {
+    AtomicCallback<void()> callback;
+    auto state = std::make_shared<int>(0);
+    callback = [&callback, state]() {
+        // Resetting the holder must not destroy the running callback.
+        callback = nullptr;
+        (*state)++;
+    };
+    ASSERT_TRUE(callback.invoke());
+    ASSERT_FALSE(callback);
+    ASSERT_EQ(1, *state);
+    ASSERT_EQ(1, state.use_count());
+}
+
+TEST_F(HidlSyncUtilTest, InvokeDoesNotWaitForGlobalLock) {
+    AtomicCallback<void()> callback;
+    callback = []() {};
+    const auto lock = hidl_sync_util::acquireGlobalLock();
+    auto result = std::async(std::launch::async,
+                             [&callback]() { return callback.invoke(); });
+    ASSERT_EQ(std::future_status::ready, result.wait_for(kCallbackTimeout));
+    ASSERT_TRUE(result.get());
+}
+
+// Mimics the HIDL thread starting and stopping STA, NAN and RTT operations
+// while the legacy HAL event loop keeps delivering events for all of them.
+TEST_F(HidlSyncUtilTest, ConcurrentStaNanRttCallbacks) {
+    AtomicCallback<void(uint32_t)> sta_callback;
+    AtomicCallback<void(uint32_t)> nan_callback;
+    AtomicCallback<void(uint32_t)> rtt_callback;
+    std::atomic<uint32_t> num_sta_events{0};
+    std::atomic<uint32_t> num_nan_events{0};
+    std::atomic<uint32_t> num_rtt_events{0};
+    std::atomic<bool> stop{false};
+
+    auto hidl_thread = std::async(std::launch::async, [&]() {
+        for (uint32_t i = 0; i < kNumStressIterations; i++) {
+            const auto lock = hidl_sync_util::acquireGlobalLock();
+            sta_callback = [&num_sta_events](uint32_t) { num_sta_events++; };
+            nan_callback = [&num_nan_events](uint32_t) { num_nan_events++; };
+            rtt_callback = [&num_rtt_events](uint32_t) { num_rtt_events++; };
+            if (i % 2) {
+                sta_callback = nullptr;
+                nan_callback = nullptr;
+            }
+        }
+        stop = true;
+    });
+    // RTT results are one-shot events. NAN events are delivered the same way
+    // here so that two threads race |invokeOnce| against the HIDL thread.
+    const auto run_event_loop = [&stop](
+                                    AtomicCallback<void(uint32_t)>* callback,
+                                    bool once) {
+        uint32_t num_invocations = 0;
+        for (uint32_t i = 0; !stop; i++) {
+            if (once ? callback->invokeOnce(i) : callback->invoke(i)) {
+                num_invocations++;
+            }
+        }
+        return num_invocations;
+    };
+    std::vector<std::future<uint32_t>> event_threads;
+    event_threads.push_back(std::async(std::launch::async, run_event_loop,
+                                       &sta_callback, false));
+    event_threads.push_back(std::async(std::launch::async, run_event_loop,
+                                       &nan_callback, true));
+    event_threads.push_back(std::async(std::launch::async, run_event_loop,
+                                       &rtt_callback, true));
+
+    ASSERT_EQ(std::future_status::ready,
+              hidl_thread.wait_for(kCallbackTimeout));
+    hidl_thread.get();
+    ASSERT_EQ(std::future_status::ready,
+              event_threads[0].wait_for(kCallbackTimeout));
+    ASSERT_EQ(num_sta_events, event_threads[0].get());
+    ASSERT_EQ(std::future_status::ready,
+              event_threads[1].wait_for(kCallbackTimeout));
+    ASSERT_EQ(num_nan_events, event_threads[1].get());
+    ASSERT_EQ(std::future_status::ready,
+              event_threads[2].wait_for(kCallbackTimeout));
+    ASSERT_EQ(num_rtt_events, event_threads[2].get());
+    // The RTT callback is only registered once per iteration.
+    ASSERT_LE(num_rtt_events, kNumStressIterations);
+}
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
@@ -44,6 +44,12 @@ class MockWifiLegacyHal : public WifiLegacyHal {
                                          const std::string& iface_name));
     MOCK_METHOD1(getDriverVersion, std::pair<wifi_error, std::string>(
                                        const std::string& iface_name));
+    MOCK_METHOD2(registerRingBufferCallbackHandler,
+                 wifi_error(const std::string&,
+                            const on_ring_buffer_data_callback&));
+    MOCK_METHOD5(startRingBufferLogging,
+                 wifi_error(const std::string&, const std::string&, uint32_t,
+                            uint32_t, uint32_t));
 
     MOCK_METHOD2(selectTxPowerScenario,
                  wifi_error(const std::string& iface_name,
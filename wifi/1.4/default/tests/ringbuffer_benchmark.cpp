@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocation_counter.h"
+#include "ringbuffer.h"
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_4 {
+namespace implementation {
+namespace {
+
+// The size of the rings the legacy HAL fills with debug data.
+constexpr size_t kRingSize = 1024 * 1024;
+
+// Appends records of state.range(0) bytes to a full ring, so that every
+// append also drops old records.
+void BM_RingbufferAppend(benchmark::State& state) {
+    Ringbuffer buffer(kRingSize);
+    std::vector<uint8_t> record(state.range(0), 0x5a);
+    const size_t recordSize = Ringbuffer::kRecordHeaderSize + record.size();
+    while (buffer.size() + recordSize <= kRingSize) {
+        buffer.append(record);
+    }
+
+    size_t allocations = allocation_counter::count();
+    for (auto _ : state) {
+        buffer.append(record);
+    }
+    allocations = allocation_counter::count() - allocations;
+
+    state.SetBytesProcessed(state.iterations() * record.size());
+    state.counters["allocs_per_append"] = benchmark::Counter(
+        allocations, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RingbufferAppend)->Arg(64)->Arg(256)->Arg(2048);
+
+// Fills an empty ring once, which includes growing its buffer.
+void BM_RingbufferFill(benchmark::State& state) {
+    std::vector<uint8_t> record(state.range(0), 0x5a);
+    const size_t records =
+        kRingSize / (Ringbuffer::kRecordHeaderSize + record.size());
+    for (auto _ : state) {
+        Ringbuffer buffer(kRingSize);
+        for (size_t i = 0; i < records; ++i) {
+            buffer.append(record);
+        }
+        benchmark::DoNotOptimize(buffer.size());
+    }
+    state.SetBytesProcessed(state.iterations() * records * record.size());
+}
+BENCHMARK(BM_RingbufferFill)->Arg(256);
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_4
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -29,66 +29,145 @@ namespace implementation {
 
 class RingbufferTest : public Test {
    public:
-    const uint32_t maxBufferSize_ = 10;
+    // Room for two records of |recordSize_| bytes.
+    const uint32_t recordSize_ = 5;
+    const uint32_t maxBufferSize_ =
+        2 * (Ringbuffer::kRecordHeaderSize + recordSize_);
+    const uint32_t maxRecordSize_ =
+        maxBufferSize_ - Ringbuffer::kRecordHeaderSize;
     Ringbuffer buffer_{maxBufferSize_};
+
+    std::vector<std::vector<uint8_t>> getRecords() {
+        std::vector<std::vector<uint8_t>> records;
+        for (const auto& record : buffer_) {
+            std::vector<uint8_t> data(record.head.data,
+                                      record.head.data + record.head.size);
+            data.insert(data.end(), record.tail.data,
+                        record.tail.data + record.tail.size);
+            records.push_back(data);
+        }
+        return records;
+    }
 };
 
 TEST_F(RingbufferTest, CreateEmptyBuffer) {
-    ASSERT_TRUE(buffer_.getData().empty());
+    ASSERT_TRUE(buffer_.empty());
+    ASSERT_TRUE(getRecords().empty());
 }
 
 TEST_F(RingbufferTest, CanUseFullBufferCapacity) {
-    const std::vector<uint8_t> input(maxBufferSize_ / 2, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
+    const std::vector<uint8_t> input(recordSize_, '0');
+    const std::vector<uint8_t> input2(recordSize_, '1');
     buffer_.append(input);
     buffer_.append(input2);
-    ASSERT_EQ(2u, buffer_.getData().size());
-    EXPECT_EQ(input, buffer_.getData().front());
-    EXPECT_EQ(input2, buffer_.getData().back());
+    ASSERT_EQ(2u, buffer_.numRecords());
+    EXPECT_EQ(maxBufferSize_, buffer_.size());
+    EXPECT_EQ(input, getRecords().front());
+    EXPECT_EQ(input2, getRecords().back());
 }
 
 TEST_F(RingbufferTest, OldDataIsRemovedOnOverflow) {
-    const std::vector<uint8_t> input(maxBufferSize_ / 2, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
+    const std::vector<uint8_t> input(recordSize_, '0');
+    const std::vector<uint8_t> input2(recordSize_, '1');
     const std::vector<uint8_t> input3 = {'G'};
     buffer_.append(input);
     buffer_.append(input2);
     buffer_.append(input3);
-    ASSERT_EQ(2u, buffer_.getData().size());
-    EXPECT_EQ(input2, buffer_.getData().front());
-    EXPECT_EQ(input3, buffer_.getData().back());
+    ASSERT_EQ(2u, buffer_.numRecords());
+    EXPECT_EQ(input2, getRecords().front());
+    EXPECT_EQ(input3, getRecords().back());
 }
 
 TEST_F(RingbufferTest, MultipleOldDataIsRemovedOnOverflow) {
-    const std::vector<uint8_t> input(maxBufferSize_ / 2, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ / 2, '1');
-    const std::vector<uint8_t> input3(maxBufferSize_, '2');
+    const std::vector<uint8_t> input(recordSize_, '0');
+    const std::vector<uint8_t> input2(recordSize_, '1');
+    const std::vector<uint8_t> input3(maxRecordSize_, '2');
     buffer_.append(input);
     buffer_.append(input2);
     buffer_.append(input3);
-    ASSERT_EQ(1u, buffer_.getData().size());
-    EXPECT_EQ(input3, buffer_.getData().front());
+    ASSERT_EQ(1u, buffer_.numRecords());
+    EXPECT_EQ(input3, getRecords().front());
 }
 
 TEST_F(RingbufferTest, AppendingEmptyBufferDoesNotAddGarbage) {
     const std::vector<uint8_t> input = {};
     buffer_.append(input);
-    ASSERT_TRUE(buffer_.getData().empty());
+    ASSERT_TRUE(buffer_.empty());
 }
 
 TEST_F(RingbufferTest, OversizedAppendIsDropped) {
-    const std::vector<uint8_t> input(maxBufferSize_ + 1, '0');
+    const std::vector<uint8_t> input(maxRecordSize_ + 1, '0');
     buffer_.append(input);
-    ASSERT_TRUE(buffer_.getData().empty());
+    ASSERT_TRUE(buffer_.empty());
 }
 
 TEST_F(RingbufferTest, OversizedAppendDoesNotDropExistingData) {
-    const std::vector<uint8_t> input(maxBufferSize_, '0');
-    const std::vector<uint8_t> input2(maxBufferSize_ + 1, '1');
+    const std::vector<uint8_t> input(maxRecordSize_, '0');
+    const std::vector<uint8_t> input2(maxRecordSize_ + 1, '1');
+    buffer_.append(input);
+    buffer_.append(input2);
+    ASSERT_EQ(1u, buffer_.numRecords());
+    EXPECT_EQ(input, getRecords().front());
+}
+
+TEST_F(RingbufferTest, RecordsWrapAroundTheEnd) {
+    const std::vector<uint8_t> input = {'0'};
+    const std::vector<uint8_t> input2(recordSize_ - 1, '1');
+    const std::vector<uint8_t> input3 = {'a', 'b', 'c', 'd', 'e'};
     buffer_.append(input);
     buffer_.append(input2);
-    ASSERT_EQ(1u, buffer_.getData().size());
-    EXPECT_EQ(input, buffer_.getData().front());
+    // Overwrites |input|, the data of |input3| starts just before the end of
+    // the buffer and continues at its start.
+    buffer_.append(input3);
+    ASSERT_EQ(2u, buffer_.numRecords());
+    const Ringbuffer::Record record = *std::next(buffer_.begin());
+    EXPECT_NE(0u, record.head.size);
+    EXPECT_NE(0u, record.tail.size);
+    EXPECT_EQ(input2, getRecords().front());
+    EXPECT_EQ(input3, getRecords().back());
+}
+
+TEST_F(RingbufferTest, BufferGrowsUpToMaxSize) {
+    const size_t maxSize = 1024 * 1024;
+    const std::vector<uint8_t> input(1000, 'a');
+    const size_t numRecordsThatFit =
+        maxSize / (Ringbuffer::kRecordHeaderSize + input.size());
+    Ringbuffer buffer(maxSize);
+    ASSERT_EQ(0u, buffer.capacity());
+    buffer.append(input);
+    EXPECT_LT(buffer.capacity(), maxSize / 2);
+    for (size_t i = 1; i < numRecordsThatFit; i++) {
+        buffer.append(std::vector<uint8_t>(input.size(), i));
+        EXPECT_GE(buffer.capacity(), buffer.size());
+    }
+    EXPECT_EQ(maxSize, buffer.capacity());
+    // Growing the buffer must not lose or reorder any record.
+    ASSERT_EQ(numRecordsThatFit, buffer.numRecords());
+    const Ringbuffer::Record front = *buffer.begin();
+    EXPECT_EQ(input, std::vector<uint8_t>(front.head.data,
+                                          front.head.data + front.head.size));
+    // Once full, the buffer drops old records instead of growing.
+    buffer.append(input);
+    EXPECT_EQ(maxSize, buffer.capacity());
+    EXPECT_EQ(numRecordsThatFit, buffer.numRecords());
+}
+
+TEST_F(RingbufferTest, KeepsNewestRecordsThatFit) {
+    std::vector<std::vector<uint8_t>> appended;
+    for (uint8_t i = 0; i < 100; i++) {
+        const std::vector<uint8_t> input(1 + i % recordSize_, i);
+        buffer_.append(input);
+        appended.push_back(input);
+    }
+    // Walk back from the newest record to find those that should be left.
+    std::vector<std::vector<uint8_t>> expected;
+    size_t size = 0;
+    for (auto it = appended.rbegin(); it != appended.rend(); ++it) {
+        size += Ringbuffer::kRecordHeaderSize + it->size();
+        if (size > maxBufferSize_) break;
+        expected.insert(expected.begin(), *it);
+    }
+    EXPECT_EQ(expected, getRecords());
 }
 }  // namespace implementation
 }  // namespace V1_4
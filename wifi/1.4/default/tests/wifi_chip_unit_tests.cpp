@@ -16,8 +16,10 @@
 
 #include <android-base/logging.h>
 #include <android-base/macros.h>
+#include <android-base/unique_fd.h>
 #include <cutils/properties.h>
 #include <gmock/gmock.h>
+#include <unistd.h>
 
 #undef NAN  // This is weird, NAN is defined in bionic/libc/include/math.h:38
 #include "wifi_chip.h"
@@ -28,14 +30,18 @@
 #include "mock_wifi_legacy_hal.h"
 #include "mock_wifi_mode_controller.h"
 
+using testing::_;
+using testing::DoAll;
 using testing::NiceMock;
 using testing::Return;
+using testing::SaveArg;
 using testing::Test;
 
 namespace {
 using android::hardware::wifi::V1_0::ChipId;
 
 constexpr ChipId kFakeChipId = 5;
+constexpr char kFakeRingName[] = "fake_ring";
 }  // namespace
 
 namespace android {
@@ -893,6 +899,77 @@ TEST_F(WifiChip_MultiIfaceTest, CreateApStartsWithIdx1) {
     ASSERT_EQ(createIface(IfaceType::STA), "wlan2");
     ASSERT_EQ(createIface(IfaceType::STA), "wlan3");
 }
+
+////////// Debug ring buffers //////////
+class WifiChipRingBufferTest : public WifiChipV1IfaceCombinationTest {
+   public:
+    void SetUp() override {
+        WifiChipV1IfaceCombinationTest::SetUp();
+        EXPECT_CALL(*legacy_hal_, registerRingBufferCallbackHandler(_, _))
+            .WillOnce(DoAll(SaveArg<1>(&ring_buffer_data_cb_),
+                            Return(legacy_hal::WIFI_SUCCESS)));
+        EXPECT_CALL(*legacy_hal_,
+                    startRingBufferLogging(_, kFakeRingName, _, _, _))
+            .WillOnce(Return(legacy_hal::WIFI_SUCCESS));
+        chip_->startLoggingToDebugRingBuffer(
+            kFakeRingName, WifiDebugRingBufferVerboseLevel::DEFAULT, 0, 0,
+            [](const WifiStatus& status) {
+                ASSERT_EQ(WifiStatusCode::SUCCESS, status.code);
+            });
+        ASSERT_TRUE(ring_buffer_data_cb_);
+    }
+
+    void appendToRing(const std::string& data) {
+        const legacy_hal::wifi_ring_buffer_status status = {};
+        ring_buffer_data_cb_(kFakeRingName,
+                             std::vector<uint8_t>(data.begin(), data.end()),
+                             status);
+    }
+
+    // Returns the archive written by |IWifiChip::debug|.
+    std::string dumpChip() {
+        FILE* file = tmpfile();
+        if (file == nullptr) {
+            return "";
+        }
+        base::unique_fd fd(dup(fileno(file)));
+        fclose(file);
+        native_handle_t* native_handle = native_handle_create(1, 0);
+        native_handle->data[0] = fd.get();
+        chip_->debug(hidl_handle(native_handle), {});
+        native_handle_delete(native_handle);
+
+        std::string dump;
+        char buf[4096];
+        ssize_t len;
+        lseek(fd.get(), 0, SEEK_SET);
+        while ((len = read(fd.get(), buf, sizeof(buf))) > 0) {
+            dump.append(buf, len);
+        }
+        return dump;
+    }
+
+    legacy_hal::on_ring_buffer_data_callback ring_buffer_data_cb_;
+};
+
+TEST_F(WifiChipRingBufferTest, DebugArchivesRingBufferContents) {
+    appendToRing("first record;");
+    appendToRing("second record;");
+    const std::string dump = dumpChip();
+    EXPECT_NE(std::string::npos, dump.find(kFakeRingName));
+    EXPECT_NE(std::string::npos, dump.find("first record;second record;"));
+    EXPECT_NE(std::string::npos, dump.find("TRAILER!!!"));
+}
+
+TEST_F(WifiChipRingBufferTest, DebugDoesNotClearRingBuffers) {
+    appendToRing("first record;");
+    ASSERT_NE(std::string::npos, dumpChip().find("first record;"));
+    appendToRing("second record;");
+    // Every archive holds the whole ring, not only what was added since the
+    // previous one.
+    EXPECT_NE(std::string::npos,
+              dumpChip().find("first record;second record;"));
+}
 }  // namespace implementation
 }  // namespace V1_4
 }  // namespace wifi
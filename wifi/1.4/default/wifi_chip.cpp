@@ -19,8 +19,11 @@
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <cutils/properties.h>
+#include <limits.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
+#include <sys/uio.h>
 
 #include "hidl_return_util.h"
 #include "hidl_struct_util.h"
@@ -35,6 +38,7 @@ using android::hardware::hidl_vec;
 using android::hardware::wifi::V1_0::ChipModeId;
 using android::hardware::wifi::V1_0::IfaceType;
 using android::hardware::wifi::V1_0::IWifiChip;
+using android::hardware::wifi::V1_4::implementation::Ringbuffer;
 
 constexpr char kCpioMagic[] = "070701";
 constexpr size_t kMaxBufferSizeBytes = 1024 * 1024 * 3;
@@ -182,62 +186,89 @@ bool removeOldFilesInternal() {
     return success;
 }
 
+// Writes all of |iovs|, picking up where a partial write left off.
+bool writevFully(int fd, struct iovec* iovs, size_t count) {
+    size_t start = 0;
+    while (start < count) {
+        const int batch = std::min<size_t>(count - start, IOV_MAX);
+        ssize_t written = TEMP_FAILURE_RETRY(writev(fd, &iovs[start], batch));
+        if (written == -1) {
+            return false;
+        }
+        while (start < count &&
+               static_cast<size_t>(written) >= iovs[start].iov_len) {
+            written -= iovs[start].iov_len;
+            start++;
+        }
+        if (written > 0) {
+            iovs[start].iov_base =
+                static_cast<uint8_t*>(iovs[start].iov_base) + written;
+            iovs[start].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Returns the data of all records in |buffer|, without their headers, as
+// iovecs pointing into the buffer.
+std::vector<struct iovec> getRingbufferIovecs(const Ringbuffer& buffer) {
+    std::vector<struct iovec> iovs;
+    for (const auto& record : buffer) {
+        for (const auto& span : {record.head, record.tail}) {
+            if (span.size != 0) {
+                iovs.push_back({const_cast<uint8_t*>(span.data), span.size});
+            }
+        }
+    }
+    return iovs;
+}
+
 // Helper function for |cpioArchiveFilesInDir|
 bool cpioWriteHeader(int out_fd, struct stat& st, const char* file_name,
                      size_t file_name_len) {
-    std::array<char, 32 * 1024> read_buf;
+    std::array<char, 128> header;
     ssize_t llen =
-        sprintf(read_buf.data(),
+        sprintf(header.data(),
                 "%s%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
                 kCpioMagic, static_cast<int>(st.st_ino), st.st_mode, st.st_uid,
                 st.st_gid, static_cast<int>(st.st_nlink),
                 static_cast<int>(st.st_mtime), static_cast<int>(st.st_size),
                 major(st.st_dev), minor(st.st_dev), major(st.st_rdev),
                 minor(st.st_rdev), static_cast<uint32_t>(file_name_len), 0);
-    if (write(out_fd, read_buf.data(), llen) == -1) {
+    // NUL Pad header up to 4 multiple bytes.
+    const uint32_t zero = 0;
+    const size_t pad_len = (4 - (llen + file_name_len) % 4) % 4;
+    struct iovec iovs[] = {
+        {header.data(), static_cast<size_t>(llen)},
+        {const_cast<char*>(file_name), file_name_len},
+        {const_cast<uint32_t*>(&zero), pad_len},
+    };
+    if (!writevFully(out_fd, iovs, 3)) {
         PLOG(ERROR) << "Error writing cpio header to file " << file_name;
         return false;
     }
-    if (write(out_fd, file_name, file_name_len) == -1) {
-        PLOG(ERROR) << "Error writing filename to file " << file_name;
-        return false;
-    }
-
-    // NUL Pad header up to 4 multiple bytes.
-    llen = (llen + file_name_len) % 4;
-    if (llen != 0) {
-        const uint32_t zero = 0;
-        if (write(out_fd, &zero, 4 - llen) == -1) {
-            PLOG(ERROR) << "Error padding 0s to file " << file_name;
-            return false;
-        }
-    }
     return true;
 }
 
 // Helper function for |cpioArchiveFilesInDir|
 size_t cpioWriteFileContent(int fd_read, int out_fd, struct stat& st) {
-    // writing content of file
-    std::array<char, 32 * 1024> read_buf;
+    // writing content of file, without copying it through user space
     ssize_t llen = st.st_size;
     size_t n_error = 0;
     while (llen > 0) {
-        ssize_t bytes_read = read(fd_read, read_buf.data(), read_buf.size());
-        if (bytes_read == -1) {
-            PLOG(ERROR) << "Error reading file";
-            return ++n_error;
-        }
-        llen -= bytes_read;
-        if (write(out_fd, read_buf.data(), bytes_read) == -1) {
+        ssize_t bytes_sent =
+            TEMP_FAILURE_RETRY(sendfile(out_fd, fd_read, nullptr, llen));
+        if (bytes_sent == -1) {
             PLOG(ERROR) << "Error writing data to file";
             return ++n_error;
         }
-        if (bytes_read == 0) {  // this should never happen, but just in case
+        if (bytes_sent == 0) {  // this should never happen, but just in case
                                 // to unstuck from while loop
             PLOG(ERROR) << "Unexpected read result";
             n_error++;
             break;
         }
+        llen -= bytes_sent;
     }
     llen = st.st_size % 4;
     if (llen != 0) {
@@ -250,6 +281,37 @@ size_t cpioWriteFileContent(int fd_read, int out_fd, struct stat& st) {
     return n_error;
 }
 
+// Helper function for |cpioArchiveFilesInDir|. Writes the records in |buffer|
+// as a file named |file_name| straight from memory.
+size_t cpioWriteRingbuffer(int out_fd, const std::string& file_name,
+                           const Ringbuffer& buffer, ino_t ino) {
+    std::vector<struct iovec> iovs = getRingbufferIovecs(buffer);
+    size_t data_len = 0;
+    for (const auto& iov : iovs) {
+        data_len += iov.iov_len;
+    }
+    struct stat st = {};
+    st.st_ino = ino;
+    st.st_mode = S_IFREG | S_IRUSR | S_IWUSR;
+    st.st_uid = getuid();
+    st.st_gid = getgid();
+    st.st_nlink = 1;
+    st.st_mtime = time(0);
+    st.st_size = data_len;
+    // string.size() does not include the null terminator. The cpio FreeBSD
+    // file header expects the null character to be included in the length.
+    if (!cpioWriteHeader(out_fd, st, file_name.c_str(), file_name.size() + 1)) {
+        return 1;
+    }
+    const uint32_t zero = 0;
+    iovs.push_back({const_cast<uint32_t*>(&zero), (4 - data_len % 4) % 4});
+    if (!writevFully(out_fd, iovs.data(), iovs.size())) {
+        PLOG(ERROR) << "Error writing data of " << file_name;
+        return 1;
+    }
+    return 0;
+}
+
 // Helper function for |cpioArchiveFilesInDir|
 bool cpioWriteFileTrailer(int out_fd) {
     std::array<char, 4096> read_buf;
@@ -264,19 +326,23 @@ bool cpioWriteFileTrailer(int out_fd) {
     return true;
 }
 
-// Archives all files in |input_dir| and writes result into |out_fd|
+// Archives all files in |input_dir|, followed by the ring buffer contents in
+// |snapshots|, and writes result into |out_fd|
 // Logic obtained from //external/toybox/toys/posix/cpio.c "Output cpio archive"
 // portion
-size_t cpioArchiveFilesInDir(int out_fd, const char* input_dir) {
+size_t cpioArchiveFilesInDir(
+    int out_fd, const char* input_dir,
+    const std::vector<std::pair<std::string, Ringbuffer>>& snapshots) {
     struct dirent* dp;
     size_t n_error = 0;
     std::unique_ptr<DIR, decltype(&closedir)> dir_dump(opendir(input_dir),
                                                        closedir);
     if (!dir_dump) {
+        // Still archive the ring buffer contents below.
         PLOG(ERROR) << "Failed to open directory";
-        return ++n_error;
+        n_error++;
     }
-    while ((dp = readdir(dir_dump.get()))) {
+    while (dir_dump && (dp = readdir(dir_dump.get()))) {
         if (dp->d_type != DT_REG) {
             continue;
         }
@@ -307,6 +373,17 @@ size_t cpioArchiveFilesInDir(int out_fd, const char* input_dir) {
             return n_error + write_error;
         }
     }
+    // Ring buffer contents which haven't made it to flash yet. Their inode
+    // numbers only need to be distinct from each other.
+    ino_t ino = 1;
+    const std::string suffix = std::to_string(time(0));
+    for (const auto& item : snapshots) {
+        size_t write_error = cpioWriteRingbuffer(out_fd, item.first + suffix,
+                                                 item.second, ino++);
+        if (write_error) {
+            return n_error + write_error;
+        }
+    }
     if (!cpioWriteFileTrailer(out_fd)) {
         return ++n_error;
     }
@@ -321,6 +398,39 @@ std::vector<char> makeCharVec(const std::string& str) {
     return vec;
 }
 
+// Writes the records in |buffer| to a new file in the tombstone folder.
+bool writeRingbufferFile(const std::string& ring_name,
+                         const Ringbuffer& buffer) {
+    const std::string file_path_raw =
+        kTombstoneFolderPath + ring_name + "XXXXXXXXXX";
+    const int dump_fd = mkstemp(makeCharVec(file_path_raw).data());
+    if (dump_fd == -1) {
+        PLOG(ERROR) << "create file failed";
+        return false;
+    }
+    unique_fd file_auto_closer(dump_fd);
+    std::vector<struct iovec> iovs = getRingbufferIovecs(buffer);
+    if (!writevFully(dump_fd, iovs.data(), iovs.size())) {
+        PLOG(ERROR) << "Error writing to file";
+        return false;
+    }
+    return true;
+}
+
+// Saves every ring buffer in |snapshots| to flash, after making room for them.
+bool writeRingbufferSnapshots(
+    const std::vector<std::pair<std::string, Ringbuffer>>& snapshots) {
+    if (!removeOldFilesInternal()) {
+        LOG(ERROR) << "Error occurred while deleting old tombstone files";
+        return false;
+    }
+    bool success = true;
+    for (const auto& item : snapshots) {
+        success &= writeRingbufferFile(item.first, item.second);
+    }
+    return success;
+}
+
 }  // namespace
 
 namespace android {
@@ -625,12 +735,22 @@ Return<void> WifiChip::debug(const hidl_handle& handle,
                              const hidl_vec<hidl_string>&) {
     if (handle != nullptr && handle->numFds >= 1) {
         int fd = handle->data[0];
-        if (!writeRingbufferFilesInternal()) {
-            LOG(ERROR) << "Error writing files to flash";
-        }
-        uint32_t n_error = cpioArchiveFilesInDir(fd, kTombstoneFolderPath);
-        if (n_error != 0) {
-            LOG(ERROR) << n_error << " errors occured in cpio function";
+        // The current ring buffer contents are archived from memory, and then
+        // saved to flash in the background.
+        auto snapshots = takeRingbufferSnapshots();
+        {
+            std::unique_lock<std::mutex> lk(ringbuffer_writer_lock_);
+            // Let the previous write finish, so that all files are complete.
+            if (ringbuffer_writer_.valid()) {
+                ringbuffer_writer_.wait();
+            }
+            uint32_t n_error =
+                cpioArchiveFilesInDir(fd, kTombstoneFolderPath, *snapshots);
+            if (n_error != 0) {
+                LOG(ERROR) << n_error << " errors occured in cpio function";
+            }
+            startRingbufferWriteLocked(snapshots);
+            // unlock
         }
         fsync(fd);
     } else {
@@ -1084,8 +1204,14 @@ WifiStatus WifiChip::startLoggingToDebugRingBufferInternal(
                 std::underlying_type<WifiDebugRingBufferVerboseLevel>::type>(
                 verbose_level),
             max_interval_in_sec, min_data_size_in_bytes);
-    ringbuffer_map_.insert(std::pair<std::string, Ringbuffer>(
-        ring_name, Ringbuffer(kMaxBufferSizeBytes)));
+    {
+        // The ring buffer data callback looks up this map without the global
+        // lock.
+        std::unique_lock<std::mutex> lk(lock_t);
+        ringbuffer_map_.insert(std::pair<std::string, Ringbuffer>(
+            ring_name, Ringbuffer(kMaxBufferSizeBytes)));
+        // unlock
+    }
     // if verbose logging enabled, turn up HAL daemon logging as well.
     if (verbose_level < WifiDebugRingBufferVerboseLevel::VERBOSE) {
         android::base::SetMinimumLogSeverity(android::base::DEBUG);
@@ -1609,37 +1735,45 @@ std::string WifiChip::allocateStaIfaceName() {
     return allocateApOrStaIfaceName(0);
 }
 
-bool WifiChip::writeRingbufferFilesInternal() {
-    if (!removeOldFilesInternal()) {
-        LOG(ERROR) << "Error occurred while deleting old tombstone files";
-        return false;
-    }
-    // write ringbuffers to file
+std::shared_ptr<const WifiChip::RingbufferSnapshots>
+WifiChip::takeRingbufferSnapshots() {
+    auto snapshots = std::make_shared<RingbufferSnapshots>();
     {
         std::unique_lock<std::mutex> lk(lock_t);
+        snapshots->reserve(ringbuffer_map_.size());
         for (const auto& item : ringbuffer_map_) {
-            const Ringbuffer& cur_buffer = item.second;
-            if (cur_buffer.getData().empty()) {
+            if (item.second.empty()) {
                 continue;
             }
-            const std::string file_path_raw =
-                kTombstoneFolderPath + item.first + "XXXXXXXXXX";
-            const int dump_fd = mkstemp(makeCharVec(file_path_raw).data());
-            if (dump_fd == -1) {
-                PLOG(ERROR) << "create file failed";
-                return false;
-            }
-            unique_fd file_auto_closer(dump_fd);
-            for (const auto& cur_block : cur_buffer.getData()) {
-                if (write(dump_fd, cur_block.data(),
-                          sizeof(cur_block[0]) * cur_block.size()) == -1) {
-                    PLOG(ERROR) << "Error writing to file";
-                }
-            }
+            // Copy the contents, so that the lock isn't held for writing them
+            // out. The rings themselves are left untouched.
+            snapshots->emplace_back(item.first, item.second);
         }
         // unlock
     }
-    return true;
+    return snapshots;
+}
+
+void WifiChip::startRingbufferWriteLocked(
+    std::shared_ptr<const RingbufferSnapshots> snapshots) {
+    // Only one write at a time, so that old files are removed in order.
+    if (ringbuffer_writer_.valid()) {
+        ringbuffer_writer_.wait();
+    }
+    ringbuffer_writer_ = std::async(std::launch::async, [snapshots]() {
+        if (!writeRingbufferSnapshots(*snapshots)) {
+            LOG(ERROR) << "Error writing files to flash";
+        }
+    });
+}
+
+bool WifiChip::writeRingbufferFilesInternal() {
+    auto snapshots = takeRingbufferSnapshots();
+    std::unique_lock<std::mutex> lk(ringbuffer_writer_lock_);
+    if (ringbuffer_writer_.valid()) {
+        ringbuffer_writer_.wait();
+    }
+    return writeRingbufferSnapshots(*snapshots);
 }
 
 }  // namespace implementation
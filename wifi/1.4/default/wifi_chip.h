@@ -17,8 +17,11 @@
 #ifndef WIFI_CHIP_H_
 #define WIFI_CHIP_H_
 
+#include <atomic>
+#include <future>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 
 #include <android-base/macros.h>
@@ -258,6 +261,15 @@ class WifiChip : public V1_4::IWifiChip {
     std::string allocateApOrStaIfaceName(uint32_t start_idx);
     std::string allocateApIfaceName();
     std::string allocateStaIfaceName();
+    // Copies of the ring buffers, keyed by ring name, taken from
+    // |ringbuffer_map_| to be written out without holding |lock_t|.
+    using RingbufferSnapshots = std::vector<std::pair<std::string, Ringbuffer>>;
+    std::shared_ptr<const RingbufferSnapshots> takeRingbufferSnapshots();
+    // Saves |snapshots| to flash in the background. Must be called with
+    // |ringbuffer_writer_lock_| held.
+    void startRingbufferWriteLocked(
+        std::shared_ptr<const RingbufferSnapshots> snapshots);
+    // Saves the ring buffer contents to flash before returning.
     bool writeRingbufferFilesInternal();
 
     ChipId chip_id_;
@@ -270,10 +282,14 @@ class WifiChip : public V1_4::IWifiChip {
     std::vector<sp<WifiStaIface>> sta_ifaces_;
     std::vector<sp<WifiRttController>> rtt_controllers_;
     std::map<std::string, Ringbuffer> ringbuffer_map_;
-    bool is_valid_;
+    // Read by callbacks on the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
     // Members pertaining to chip configuration.
     uint32_t current_mode_id_;
     std::mutex lock_t;
+    // Background write of ring buffer snapshots to flash, if any.
+    std::future<void> ringbuffer_writer_;
+    std::mutex ringbuffer_writer_lock_;
     std::vector<IWifiChip::ChipMode> modes_;
     // The legacy ring buffer callback API has only a global callback
     // registration mechanism. Use this to check if we have already
@@ -272,18 +272,18 @@ class WifiLegacyHal {
         const std::string& iface_name);
     std::pair<wifi_error, WakeReasonStats> getWakeReasonStats(
         const std::string& iface_name);
-    wifi_error registerRingBufferCallbackHandler(
+    virtual wifi_error registerRingBufferCallbackHandler(
         const std::string& iface_name,
         const on_ring_buffer_data_callback& on_data_callback);
     wifi_error deregisterRingBufferCallbackHandler(
         const std::string& iface_name);
     std::pair<wifi_error, std::vector<wifi_ring_buffer_status>>
     getRingBuffersStatus(const std::string& iface_name);
-    wifi_error startRingBufferLogging(const std::string& iface_name,
-                                      const std::string& ring_name,
-                                      uint32_t verbose_level,
-                                      uint32_t max_interval_sec,
-                                      uint32_t min_data_size);
+    virtual wifi_error startRingBufferLogging(const std::string& iface_name,
+                                              const std::string& ring_name,
+                                              uint32_t verbose_level,
+                                              uint32_t max_interval_sec,
+                                              uint32_t min_data_size);
     wifi_error getRingBufferData(const std::string& iface_name,
                                  const std::string& ring_name);
     wifi_error registerErrorAlertCallbackHandler(
@@ -17,6 +17,8 @@
 #ifndef WIFI_NAN_IFACE_H_
 #define WIFI_NAN_IFACE_H_
 
+#include <atomic>
+
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.0/IWifiNanIfaceEventCallback.h>
 #include <android/hardware/wifi/1.4/IWifiNanIface.h>
@@ -168,7 +170,8 @@ class WifiNanIface : public V1_4::IWifiNanIface {
     bool is_dedicated_iface_;
     std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal_;
     std::weak_ptr<iface_util::WifiIfaceUtil> iface_util_;
-    bool is_valid_;
+    // Read by callbacks on the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
     hidl_callback_util::HidlCallbackHandler<V1_0::IWifiNanIfaceEventCallback>
         event_cb_handler_;
     hidl_callback_util::HidlCallbackHandler<V1_2::IWifiNanIfaceEventCallback>
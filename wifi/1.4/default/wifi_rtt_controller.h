@@ -17,6 +17,8 @@
 #ifndef WIFI_RTT_CONTROLLER_H_
 #define WIFI_RTT_CONTROLLER_H_
 
+#include <atomic>
+
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.0/IWifiIface.h>
 #include <android/hardware/wifi/1.4/IWifiRttController.h>
@@ -116,7 +118,8 @@ class WifiRttController : public V1_4::IWifiRttController {
     sp<IWifiIface> bound_iface_;
     std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal_;
     std::vector<sp<IWifiRttControllerEventCallback>> event_callbacks_;
-    bool is_valid_;
+    // Read by callbacks on the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiRttController);
 };
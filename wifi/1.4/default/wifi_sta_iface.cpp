@@ -15,12 +15,26 @@
  */
 
 #include <android-base/logging.h>
+#include <utils/SystemClock.h>
 
 #include "hidl_return_util.h"
 #include "hidl_struct_util.h"
 #include "wifi_sta_iface.h"
 #include "wifi_status_util.h"
 
+namespace {
+// Link layer stats requested within this window of the last driver query are
+// served from the cache instead of querying the driver again.
+// Devices polling the stats from multiple clients can set
+// WIFI_LINK_LAYER_STATS_CACHE_MS in their makefile to enable this.
+#ifdef WIFI_LINK_LAYER_STATS_CACHE_MS
+constexpr int64_t kLinkLayerStatsCacheDurationMs =
+    WIFI_LINK_LAYER_STATS_CACHE_MS;
+#else
+constexpr int64_t kLinkLayerStatsCacheDurationMs = 0;
+#endif
+}  // namespace
+
 namespace android {
 namespace hardware {
 namespace wifi {
@@ -35,7 +49,8 @@ WifiStaIface::WifiStaIface(
     : ifname_(ifname),
       legacy_hal_(legacy_hal),
       iface_util_(iface_util),
-      is_valid_(true) {
+      is_valid_(true),
+      link_layer_stats_cache_valid_(false) {
     // Turn on DFS channel usage for STA iface.
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->setDfsFlag(ifname_, true);
@@ -47,6 +62,7 @@ WifiStaIface::WifiStaIface(
 
 void WifiStaIface::invalidate() {
     legacy_hal_.reset();
+    link_layer_stats_cache_valid_ = false;
     event_cb_handler_.invalidate();
     is_valid_ = false;
 }
@@ -423,9 +439,12 @@ WifiStatus WifiStaIface::startBackgroundScanInternal(
             LOG(ERROR) << "Callback invoked on an invalid object";
             return;
         }
+        // The result is only used for the duration of the callbacks, so avoid
+        // copying each IE into its own buffer.
+        std::vector<uint8_t> ie_backing_store;
         StaScanResult hidl_scan_result;
         if (!hidl_struct_util::convertLegacyGscanResultToHidl(
-                *result, true, &hidl_scan_result)) {
+                *result, true, &ie_backing_store, &hidl_scan_result)) {
             LOG(ERROR) << "Failed to convert full scan results to HIDL structs";
             return;
         }
@@ -452,12 +471,14 @@ WifiStatus WifiStaIface::stopBackgroundScanInternal(uint32_t cmd_id) {
 }
 
 WifiStatus WifiStaIface::enableLinkLayerStatsCollectionInternal(bool debug) {
+    link_layer_stats_cache_valid_ = false;
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->enableLinkLayerStats(ifname_, debug);
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
 WifiStatus WifiStaIface::disableLinkLayerStatsCollectionInternal() {
+    link_layer_stats_cache_valid_ = false;
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->disableLinkLayerStats(ifname_);
     return createWifiStatusFromLegacyError(legacy_status);
@@ -470,6 +491,16 @@ WifiStaIface::getLinkLayerStatsInternal() {
 
 std::pair<WifiStatus, V1_3::StaLinkLayerStats>
 WifiStaIface::getLinkLayerStatsInternal_1_3() {
+    // |timeStampInMs| is the time at which the cached stats were fetched, so
+    // the clients still see the right time for them.
+    if (link_layer_stats_cache_valid_ &&
+        uptimeMillis() -
+                static_cast<int64_t>(link_layer_stats_cache_.timeStampInMs) <
+            kLinkLayerStatsCacheDurationMs) {
+        return {createWifiStatus(WifiStatusCode::SUCCESS),
+                link_layer_stats_cache_};
+    }
+    link_layer_stats_cache_valid_ = false;
     legacy_hal::wifi_error legacy_status;
     legacy_hal::LinkLayerStats legacy_stats;
     std::tie(legacy_status, legacy_stats) =
@@ -477,12 +508,12 @@ WifiStaIface::getLinkLayerStatsInternal_1_3() {
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
         return {createWifiStatusFromLegacyError(legacy_status), {}};
     }
-    V1_3::StaLinkLayerStats hidl_stats;
-    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(legacy_stats,
-                                                             &hidl_stats)) {
+    if (!hidl_struct_util::convertLegacyLinkLayerStatsToHidl(
+            legacy_stats, &link_layer_stats_cache_)) {
         return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), {}};
     }
-    return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_stats};
+    link_layer_stats_cache_valid_ = kLinkLayerStatsCacheDurationMs > 0;
+    return {createWifiStatus(WifiStatusCode::SUCCESS), link_layer_stats_cache_};
 }
 
 WifiStatus WifiStaIface::startRssiMonitoringInternal(uint32_t cmd_id,
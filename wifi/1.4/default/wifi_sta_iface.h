@@ -17,6 +17,8 @@
 #ifndef WIFI_STA_IFACE_H_
 #define WIFI_STA_IFACE_H_
 
+#include <atomic>
+
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.0/IWifiStaIfaceEventCallback.h>
 #include <android/hardware/wifi/1.3/IWifiStaIface.h>
@@ -164,9 +166,14 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     std::string ifname_;
     std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal_;
     std::weak_ptr<iface_util::WifiIfaceUtil> iface_util_;
-    bool is_valid_;
+    // Read by callbacks on the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
     hidl_callback_util::HidlCallbackHandler<IWifiStaIfaceEventCallback>
         event_cb_handler_;
+    // Most recently fetched link layer stats. Only valid if the cache is
+    // enabled (see |kLinkLayerStatsCacheDurationMs|).
+    V1_3::StaLinkLayerStats link_layer_stats_cache_;
+    bool link_layer_stats_cache_valid_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiStaIface);
 };